@@ -0,0 +1,143 @@
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+std::atomic<uint64_t> allocations{ 0 };
+std::atomic<uint64_t> allocated_bytes{ 0 };
+
+void* counted_alloc( std::size_t size )
+{
+  allocations.fetch_add( 1, std::memory_order_relaxed );
+  allocated_bytes.fetch_add( size, std::memory_order_relaxed );
+  if ( void* ptr = std::malloc( size ? size : 1 ) )
+    return ptr;
+  throw std::bad_alloc();
+}
+
+void* counted_alloc( std::size_t size, std::align_val_t alignment )
+{
+  allocations.fetch_add( 1, std::memory_order_relaxed );
+  allocated_bytes.fetch_add( size, std::memory_order_relaxed );
+  auto align = static_cast<std::size_t>( alignment );
+  // `aligned_alloc` needs a size that is a multiple of the alignment.
+  size = ( ( size ? size : 1 ) + align - 1 ) / align * align;
+#ifdef _WIN32
+  void* ptr = _aligned_malloc( size, align );
+#else
+  void* ptr = std::aligned_alloc( align, size );
+#endif
+  if ( ptr )
+    return ptr;
+  throw std::bad_alloc();
+}
+
+void counted_free( void* ptr, std::align_val_t )
+{
+#ifdef _WIN32
+  _aligned_free( ptr );
+#else
+  std::free( ptr );
+#endif
+}
+}  // namespace
+
+// The nothrow forms forward to these in the standard library.
+void* operator new( std::size_t size )
+{
+  return counted_alloc( size );
+}
+
+void* operator new[]( std::size_t size )
+{
+  return counted_alloc( size );
+}
+
+void* operator new( std::size_t size, std::align_val_t alignment )
+{
+  return counted_alloc( size, alignment );
+}
+
+void* operator new[]( std::size_t size, std::align_val_t alignment )
+{
+  return counted_alloc( size, alignment );
+}
+
+void operator delete( void* ptr ) noexcept
+{
+  std::free( ptr );
+}
+
+void operator delete[]( void* ptr ) noexcept
+{
+  std::free( ptr );
+}
+
+void operator delete( void* ptr, std::size_t ) noexcept
+{
+  std::free( ptr );
+}
+
+void operator delete[]( void* ptr, std::size_t ) noexcept
+{
+  std::free( ptr );
+}
+
+void operator delete( void* ptr, std::align_val_t alignment ) noexcept
+{
+  counted_free( ptr, alignment );
+}
+
+void operator delete[]( void* ptr, std::align_val_t alignment ) noexcept
+{
+  counted_free( ptr, alignment );
+}
+
+void operator delete( void* ptr, std::size_t, std::align_val_t alignment ) noexcept
+{
+  counted_free( ptr, alignment );
+}
+
+void operator delete[]( void* ptr, std::size_t, std::align_val_t alignment ) noexcept
+{
+  counted_free( ptr, alignment );
+}
+
+namespace VSCodeEscript::Benchmark
+{
+AllocationCount allocation_count()
+{
+  return AllocationCount{ allocations.load( std::memory_order_relaxed ),
+                          allocated_bytes.load( std::memory_order_relaxed ) };
+}
+
+uint64_t peak_rss()
+{
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters;
+  if ( GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof( counters ) ) )
+    return counters.PeakWorkingSetSize;
+  return 0;
+#else
+  struct rusage usage;
+  if ( getrusage( RUSAGE_SELF, &usage ) != 0 )
+    return 0;
+#ifdef __APPLE__
+  return static_cast<uint64_t>( usage.ru_maxrss );
+#else
+  // Kilobytes on Linux.
+  return static_cast<uint64_t>( usage.ru_maxrss ) * 1024;
+#endif
+#endif
+}
+}  // namespace VSCodeEscript::Benchmark
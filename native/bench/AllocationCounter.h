@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+namespace VSCodeEscript::Benchmark
+{
+struct AllocationCount
+{
+  uint64_t allocations = 0;
+  uint64_t bytes = 0;
+};
+
+// The number and total size of `operator new` calls made by the addon so far,
+// on any thread. Only available in benchmark builds, which replace the global
+// allocation functions.
+AllocationCount allocation_count();
+
+// The peak resident set size of the process, in bytes.
+uint64_t peak_rss();
+}  // namespace VSCodeEscript::Benchmark
@@ -0,0 +1,101 @@
+#include "Benchmark.h"
+
+#include "AllocationCounter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+namespace VSCodeEscript::Benchmark
+{
+namespace
+{
+// Nearest-rank percentile of sorted `samples`.
+double percentile( const std::vector<double>& samples, double p )
+{
+  if ( samples.empty() )
+    return 0;
+  auto rank = static_cast<size_t>( std::ceil( p / 100 * samples.size() ) );
+  return samples[std::clamp<size_t>( rank, 1, samples.size() ) - 1];
+}
+
+uint32_t get_count( const Napi::Object& options, const char* name, uint32_t default_value )
+{
+  if ( !options.Has( name ) )
+    return default_value;
+  auto value = options.Get( name );
+  if ( !value.IsNumber() )
+    throw Napi::TypeError::New( options.Env(), "Invalid arguments" );
+  return value.As<Napi::Number>().Uint32Value();
+}
+}  // namespace
+
+Napi::Object GetObject( Napi::Env env )
+{
+  auto benchmark = Napi::Object::New( env );
+  benchmark["measure"] = Napi::Function::New( env, &Measure );
+  benchmark["peakRss"] = Napi::Function::New( env, &PeakRss );
+  return benchmark;
+}
+
+Napi::Value Measure( const Napi::CallbackInfo& info )
+{
+  auto env = info.Env();
+  if ( info.Length() < 1 || !info[0].IsFunction() ||
+       ( info.Length() > 1 && !info[1].IsObject() && !info[1].IsUndefined() ) )
+  {
+    Napi::TypeError::New( env, "Invalid arguments" ).ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  auto fn = info[0].As<Napi::Function>();
+  auto options = info.Length() > 1 && info[1].IsObject() ? info[1].As<Napi::Object>()
+                                                         : Napi::Object::New( env );
+  auto iterations = std::max<uint32_t>( get_count( options, "iterations", 100 ), 1 );
+  auto warmup = get_count( options, "warmup", 5 );
+
+  for ( uint32_t i = 0; i < warmup; ++i )
+  {
+    fn.Call( {} );
+  }
+
+  std::vector<double> samples;
+  samples.reserve( iterations );
+  auto allocations_before = allocation_count();
+  for ( uint32_t i = 0; i < iterations; ++i )
+  {
+    auto start = std::chrono::steady_clock::now();
+    fn.Call( {} );
+    auto end = std::chrono::steady_clock::now();
+    samples.push_back( std::chrono::duration<double, std::milli>( end - start ).count() );
+  }
+  auto allocations_after = allocation_count();
+
+  double total = 0;
+  for ( auto sample : samples )
+  {
+    total += sample;
+  }
+  std::sort( samples.begin(), samples.end() );
+
+  auto result = Napi::Object::New( env );
+  result["iterations"] = Napi::Number::New( env, iterations );
+  result["p50Ms"] = Napi::Number::New( env, percentile( samples, 50 ) );
+  result["p99Ms"] = Napi::Number::New( env, percentile( samples, 99 ) );
+  result["meanMs"] = Napi::Number::New( env, total / iterations );
+  result["allocationsPerOp"] = Napi::Number::New(
+      env,
+      static_cast<double>( allocations_after.allocations - allocations_before.allocations ) /
+          iterations );
+  result["bytesPerOp"] = Napi::Number::New(
+      env, static_cast<double>( allocations_after.bytes - allocations_before.bytes ) / iterations );
+  result["peakRssBytes"] = Napi::Number::New( env, static_cast<double>( peak_rss() ) );
+  return result;
+}
+
+Napi::Value PeakRss( const Napi::CallbackInfo& info )
+{
+  return Napi::Number::New( info.Env(), static_cast<double>( peak_rss() ) );
+}
+}  // namespace VSCodeEscript::Benchmark
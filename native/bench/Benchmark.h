@@ -0,0 +1,18 @@
+#pragma once
+
+#include <napi.h>
+
+namespace VSCodeEscript::Benchmark
+{
+// The `Benchmark` export of benchmark builds (`-DBUILD_BENCHMARKS=ON`):
+//
+// - `measure(fn, { iterations?, warmup? })` calls `fn` `warmup` times, then
+//   `iterations` times while timing each call, and returns the p50, p99 and
+//   mean latency in milliseconds along with the allocations and allocated
+//   bytes per call and the process' peak RSS afterwards.
+// - `peakRss()` returns the process' peak RSS in bytes.
+Napi::Object GetObject( Napi::Env env );
+
+Napi::Value Measure( const Napi::CallbackInfo& info );
+Napi::Value PeakRss( const Napi::CallbackInfo& info );
+}  // namespace VSCodeEscript::Benchmark
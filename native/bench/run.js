@@ -0,0 +1,199 @@
+// Benchmarks the native addon's LSP queries over the polserver testsuite and
+// synthetic large scripts. Requires a build with the benchmark harness:
+//
+//   npm run build-bench
+//   node bench/run.js [--iterations 100] [--files 50] [--filter <regexp>]
+//                     [--json <output>] [--baseline <json> [--threshold 10]]
+//
+// With `--baseline`, exits with an error if any operation's p50 or p99
+// latency regressed by more than `--threshold` percent. The option is cached
+// by CMake, so configure with `--CDBUILD_BENCHMARKS=OFF` to go back to a
+// regular build.
+
+const { resolve, join } = require('path');
+const { mkdtempSync, mkdirSync, writeFileSync, readFileSync, rmSync } = require('fs');
+const { tmpdir } = require('os');
+const { native } = require('../out/index');
+
+const { LSPWorkspace, Benchmark } = native;
+
+if (!Benchmark) {
+    console.error('The addon was built without benchmarks; run `npm run build-bench` first.');
+    process.exit(1);
+}
+
+function parseArgs(argv) {
+    const args = { iterations: 100, files: 50, threshold: 10 };
+    for (let i = 0; i < argv.length; i += 2) {
+        const [name, value] = [argv[i].replace(/^--/, ''), argv[i + 1]];
+        if (value === undefined) {
+            throw new Error(`Missing value for ${argv[i]}`);
+        }
+        args[name] = ['iterations', 'files', 'threshold'].includes(name) ? Number(value) : value;
+    }
+    return args;
+}
+
+const args = parseArgs(process.argv.slice(2));
+const filter = args.filter ? new RegExp(args.filter) : undefined;
+
+const polserver = resolve(__dirname, '..', 'polserver');
+const moduleDirectory = resolve(polserver, 'pol-core', 'support', 'scripts');
+const polDirectory = resolve(polserver, 'testsuite', 'pol');
+const includeDirectory = resolve(polDirectory, 'scripts', 'include');
+
+// A script of `count` functions, each declaring locals, calling module
+// functions and the previous function, so analysis, references and queries
+// have realistic work to do.
+function syntheticScript(count) {
+    const lines = ['use uo;', 'use os;', ''];
+    for (let i = 0; i < count; ++i) {
+        lines.push(`const CONSTANT_${i} := ${i};`);
+    }
+    lines.push('');
+    for (let i = 0; i < count; ++i) {
+        lines.push(
+            `function synthetic_${i}( value, other := CONSTANT_${i} )`,
+            '  var result := array{ value, other };',
+            `  foreach entry in ( result )`,
+            '    if ( entry > MOVEOBJECT_FORCELOCATION )',
+            '      Print( entry );',
+            '    endif',
+            '  endforeach',
+            i > 0 ? `  return synthetic_${i - 1}( value + 1, other );` : '  return result;',
+            'endfunction',
+            ''
+        );
+    }
+    lines.push(`Print( synthetic_${count - 1}( 0 ) );`, 'SleepMs( 1 );', '');
+    return lines.join('\n');
+}
+
+function setUp() {
+    const root = mkdtempSync(join(tmpdir(), 'escript-bench-'));
+    const scripts = join(root, 'scripts');
+    mkdirSync(scripts);
+    writeFileSync(join(scripts, 'ecompile.cfg'), [
+        `ModuleDirectory ${moduleDirectory}`,
+        `IncludeDirectory ${includeDirectory}`,
+        `PolScriptRoot ${polDirectory}`,
+        `PackageRoot ${polDirectory}`,
+        ''
+    ].join('\n'));
+
+    const synthetic = [1000, 10000].map(count => {
+        const pathname = join(scripts, `synthetic-${count}.src`);
+        writeFileSync(pathname, syntheticScript(count));
+        return pathname;
+    });
+
+    const workspace = new LSPWorkspace({});
+    workspace.open(root);
+    const testsuite = workspace.autoCompiledScripts
+        .filter(pathname => pathname.endsWith('.src'))
+        .slice(0, args.files);
+    return { root, workspace, testsuite, synthetic };
+}
+
+// Positions of every identifier-like semantic token in the document, 1-based
+// like the positions taken by the LSPDocument queries.
+function tokenPositions(document) {
+    return document.tokens().map(([line, character]) => ({ line: line + 1, character: character + 1 }));
+}
+
+// Calls `fn` with each document (and position) in turn.
+function cycle(items, fn) {
+    let index = 0;
+    return () => fn(items[index++ % items.length]);
+}
+
+function benchmarkSuite(name, workspace, pathnames) {
+    const documents = pathnames.map(pathname => workspace.getDocument(pathname));
+    documents.forEach(document => document.analyze());
+
+    // Up to 20 positions per document, spread across it.
+    const positions = documents.flatMap(document => {
+        const all = tokenPositions(document);
+        const step = Math.max(1, Math.floor(all.length / 20));
+        return all.filter((_, i) => i % step === 0).slice(0, 20).map(position => ({ document, position }));
+    });
+
+    const operations = {
+        'analyze': cycle(documents, document => document.analyze()),
+        'references.build': cycle(documents, document => document.buildReferences()),
+        'references.find': cycle(positions, ({ document, position }) => document.references(position)),
+        'hover': cycle(positions, ({ document, position }) => document.hover(position)),
+        'definition': cycle(positions, ({ document, position }) => document.definition(position)),
+        'completion': cycle(positions, ({ document, position }) => document.completion(position)),
+        'signatureHelp': cycle(positions, ({ document, position }) => document.signatureHelp(position)),
+        'symbols': cycle(documents, document => document.symbols()),
+        'format': cycle(documents, document => document.toFormattedString()),
+    };
+
+    const results = {};
+    for (const [operation, fn] of Object.entries(operations)) {
+        const key = `${name}/${operation}`;
+        if (filter && !filter.test(key)) {
+            continue;
+        }
+        // Slow operations on large scripts get fewer iterations.
+        const iterations = name.startsWith('synthetic') && ['analyze', 'format'].includes(operation)
+            ? Math.max(1, Math.floor(args.iterations / 10))
+            : args.iterations;
+        results[key] = Benchmark.measure(fn, { iterations, warmup: Math.min(5, iterations) });
+    }
+    return results;
+}
+
+function report(results) {
+    const rows = Object.entries(results).map(([key, result]) => ({
+        operation: key,
+        'p50 ms': result.p50Ms.toFixed(3),
+        'p99 ms': result.p99Ms.toFixed(3),
+        'allocs/op': Math.round(result.allocationsPerOp),
+        'KiB/op': (result.bytesPerOp / 1024).toFixed(1),
+        'peak RSS MiB': (result.peakRssBytes / 1024 / 1024).toFixed(1),
+    }));
+    console.table(rows);
+}
+
+function compare(results, baseline) {
+    const regressions = [];
+    for (const [key, result] of Object.entries(results)) {
+        const previous = baseline[key];
+        if (!previous) {
+            continue;
+        }
+        for (const metric of ['p50Ms', 'p99Ms']) {
+            const change = (result[metric] - previous[metric]) / previous[metric] * 100;
+            if (change > args.threshold) {
+                regressions.push(`${key} ${metric}: ${previous[metric].toFixed(3)} -> ${result[metric].toFixed(3)} (+${change.toFixed(1)}%)`);
+            }
+        }
+    }
+    return regressions;
+}
+
+const { root, workspace, testsuite, synthetic } = setUp();
+try {
+    const results = {
+        ...benchmarkSuite('testsuite', workspace, testsuite),
+        ...benchmarkSuite('synthetic-1000', workspace, [synthetic[0]]),
+        ...benchmarkSuite('synthetic-10000', workspace, [synthetic[1]]),
+    };
+    report(results);
+
+    if (args.json) {
+        writeFileSync(args.json, JSON.stringify(results, undefined, 2));
+    }
+
+    if (args.baseline) {
+        const regressions = compare(results, JSON.parse(readFileSync(args.baseline, 'utf-8')));
+        if (regressions.length) {
+            console.error(`Regressions over ${args.threshold}%:\n  ${regressions.join('\n  ')}`);
+            process.exitCode = 1;
+        }
+    }
+} finally {
+    rmSync(root, { recursive: true, force: true });
+}
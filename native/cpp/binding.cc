@@ -3,6 +3,11 @@
 #include "napi/ExtensionConfig.h"
 #include "napi/LSPDocument.h"
 #include "napi/LSPWorkspace.h"
+#include "napi/Tracing.h"
+
+#ifdef VSCODE_ESCRIPT_BENCHMARKS
+#include "../bench/Benchmark.h"
+#endif
 
 using namespace Pol::Bscript;
 
@@ -21,6 +26,17 @@ Napi::Object Init( Napi::Env env, Napi::Object exports )
       Napi::Function::New( env, &VSCodeEscript::ExtensionConfiguration::Get );
   exports.Set( Napi::String::New( env, "ExtensionConfiguration" ), ExtensionConfiguration );
 
+  auto Tracing = Napi::Object::New( env );
+  Tracing["start"] = Napi::Function::New( env, &VSCodeEscript::Tracing::Start );
+  Tracing["stop"] = Napi::Function::New( env, &VSCodeEscript::Tracing::Stop );
+  Tracing["enabled"] = Napi::Function::New( env, &VSCodeEscript::Tracing::Enabled );
+  Tracing["write"] = Napi::Function::New( env, &VSCodeEscript::Tracing::Write );
+  exports.Set( Napi::String::New( env, "Tracing" ), Tracing );
+
+#ifdef VSCODE_ESCRIPT_BENCHMARKS
+  exports.Set( Napi::String::New( env, "Benchmark" ), VSCodeEscript::Benchmark::GetObject( env ) );
+#endif
+
   env.SetInstanceData( new Napi::Reference<Napi::Object>( Napi::Persistent( exports ) ) );
   return exports;
 }
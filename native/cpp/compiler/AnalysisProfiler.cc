@@ -0,0 +1,118 @@
+#include "AnalysisProfiler.h"
+
+#include "TrackedSourceFileCache.h"
+
+using namespace std::chrono;
+
+namespace VSCodeEscript::CompilerExt
+{
+namespace
+{
+int64_t micros_since( steady_clock::time_point start, steady_clock::time_point end )
+{
+  return duration_cast<microseconds>( end - start ).count();
+}
+}  // namespace
+
+AnalysisStats& AnalysisStats::operator+=( const AnalysisStats& other )
+{
+  analyses += other.analyses;
+  total_micros += other.total_micros;
+  build_workspace_micros += other.build_workspace_micros;
+  parse_src_micros += other.parse_src_micros;
+  parse_inc_micros += other.parse_inc_micros;
+  parse_em_micros += other.parse_em_micros;
+  parse_src_count += other.parse_src_count;
+  parse_inc_count += other.parse_inc_count;
+  parse_em_count += other.parse_em_count;
+  semantic_analysis_micros += other.semantic_analysis_micros;
+  build_references_micros += other.build_references_micros;
+  em_cache.hits += other.em_cache.hits;
+  em_cache.misses += other.em_cache.misses;
+  inc_cache.hits += other.inc_cache.hits;
+  inc_cache.misses += other.inc_cache.misses;
+  return *this;
+}
+
+AnalysisProfiler::AnalysisProfiler() : start_time( steady_clock::now() ) {}
+
+void AnalysisProfiler::start( std::shared_ptr<TrackedSourceFileCache> new_em_cache,
+                              std::shared_ptr<TrackedSourceFileCache> new_inc_cache )
+{
+  em_cache = std::move( new_em_cache );
+  inc_cache = std::move( new_inc_cache );
+  em_start = snapshot( *em_cache, true );
+  inc_start = snapshot( *inc_cache, false );
+  start_time = steady_clock::now();
+}
+
+void AnalysisProfiler::start_build_references()
+{
+  build_references_time = steady_clock::now();
+}
+
+AnalysisStats AnalysisProfiler::finish() const
+{
+  auto now = steady_clock::now();
+
+  AnalysisStats stats;
+  stats.analyses = 1;
+  stats.total_micros = micros_since( start_time, now );
+  if ( build_references_time != steady_clock::time_point() )
+  {
+    stats.build_references_micros = micros_since( build_references_time, now );
+  }
+
+  stats.build_workspace_micros = _profile.build_workspace_micros;
+  stats.parse_src_micros = _profile.parse_src_micros;
+  stats.parse_src_count = _profile.parse_src_count;
+  stats.parse_inc_micros = _profile.parse_inc_micros;
+  stats.parse_inc_count = _profile.parse_inc_count;
+  stats.parse_em_micros = _profile.parse_em_micros;
+  stats.parse_em_count = _profile.parse_em_count;
+  stats.semantic_analysis_micros =
+      _profile.register_const_declarations_micros + _profile.analyze_micros;
+
+  if ( em_cache )
+  {
+    auto em_end = snapshot( *em_cache, true );
+    stats.parse_em_micros += em_end.parse_micros - em_start.parse_micros;
+    stats.parse_em_count += em_end.parse_count - em_start.parse_count;
+    stats.em_cache.hits = em_end.counters.hits - em_start.counters.hits;
+    stats.em_cache.misses = em_end.counters.misses - em_start.counters.misses;
+  }
+  if ( inc_cache )
+  {
+    auto inc_end = snapshot( *inc_cache, false );
+    stats.parse_inc_micros += inc_end.parse_micros - inc_start.parse_micros;
+    stats.parse_inc_count += inc_end.parse_count - inc_start.parse_count;
+    stats.inc_cache.hits = inc_end.counters.hits - inc_start.counters.hits;
+    stats.inc_cache.misses = inc_end.counters.misses - inc_start.counters.misses;
+  }
+  return stats;
+}
+
+std::optional<uint64_t> AnalysisProfiler::contents_hash( const std::string& pathname ) const
+{
+  for ( const auto* cache : { em_cache.get(), inc_cache.get() } )
+  {
+    if ( !cache )
+      continue;
+    if ( auto hash = cache->contents_hash( pathname ) )
+      return hash;
+  }
+  return {};
+}
+
+AnalysisProfiler::CacheSnapshot AnalysisProfiler::snapshot( const TrackedSourceFileCache& cache,
+                                                            bool em )
+{
+  const auto& profile = cache.profile;
+  CacheSnapshot result;
+  result.parse_micros = em ? profile.parse_em_micros : profile.parse_inc_micros;
+  result.parse_count = em ? profile.parse_em_count : profile.parse_inc_count;
+  result.counters.hits = profile.cache_hits;
+  result.counters.misses = profile.cache_misses;
+  return result;
+}
+}  // namespace VSCodeEscript::CompilerExt
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "bscript/compiler/Profile.h"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace VSCodeEscript::CompilerExt
+{
+class TrackedSourceFileCache;
+
+struct ParseTreeCacheStats
+{
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+};
+
+// Timings, in microseconds, and counters of one or more analyses.
+struct AnalysisStats
+{
+  uint64_t analyses = 0;
+  int64_t total_micros = 0;
+  // Loading, parsing and building the syntax tree of the script and
+  // everything it includes.
+  int64_t build_workspace_micros = 0;
+  // Lexing and parsing, included in `build_workspace_micros`. ANTLR lexes on
+  // demand while parsing, so the two cannot be told apart.
+  int64_t parse_src_micros = 0;
+  int64_t parse_inc_micros = 0;
+  int64_t parse_em_micros = 0;
+  uint64_t parse_src_count = 0;
+  uint64_t parse_inc_count = 0;
+  uint64_t parse_em_count = 0;
+  // Constant registration and semantic analysis.
+  int64_t semantic_analysis_micros = 0;
+  int64_t build_references_micros = 0;
+  ParseTreeCacheStats em_cache;
+  ParseTreeCacheStats inc_cache;
+
+  AnalysisStats& operator+=( const AnalysisStats& other );
+};
+
+// Measures one analysis. The compiler records its phases into `profile()`;
+// the parse tree caches are shared, so their counters are read before and
+// after, and may include work done for analyses running on other threads at
+// the same time.
+class AnalysisProfiler
+{
+public:
+  AnalysisProfiler();
+
+  // Called when the compiler is created, with the caches it uses.
+  void start( std::shared_ptr<TrackedSourceFileCache> em_cache,
+              std::shared_ptr<TrackedSourceFileCache> inc_cache );
+
+  // Called once the compiler finished, before building references.
+  void start_build_references();
+
+  AnalysisStats finish() const;
+
+  // The hash of the text the compiler's parse tree caches parsed for
+  // `pathname`, if either of them holds it.
+  std::optional<uint64_t> contents_hash( const std::string& pathname ) const;
+
+  Pol::Bscript::Compiler::Profile& profile() { return _profile; }
+
+private:
+  struct CacheSnapshot
+  {
+    int64_t parse_micros = 0;
+    uint64_t parse_count = 0;
+    ParseTreeCacheStats counters;
+  };
+
+  static CacheSnapshot snapshot( const TrackedSourceFileCache& cache, bool em );
+
+  Pol::Bscript::Compiler::Profile _profile;
+  std::shared_ptr<TrackedSourceFileCache> em_cache;
+  std::shared_ptr<TrackedSourceFileCache> inc_cache;
+  CacheSnapshot em_start;
+  CacheSnapshot inc_start;
+  std::chrono::steady_clock::time_point start_time;
+  std::chrono::steady_clock::time_point build_references_time;
+};
+}  // namespace VSCodeEscript::CompilerExt
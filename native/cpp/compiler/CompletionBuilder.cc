@@ -1,4 +1,5 @@
 #include "CompletionBuilder.h"
+#include "TokenIndex.h"
 
 #include <set>
 
@@ -22,8 +23,9 @@ using namespace EscriptGrammar;
 
 namespace VSCodeEscript::CompilerExt
 {
-CompletionBuilder::CompletionBuilder( CompilerWorkspace& workspace, const Position& position )
-    : workspace( workspace ), position( position )
+CompletionBuilder::CompletionBuilder( CompilerWorkspace& workspace, const TokenIndex& token_index,
+                                      const Position& position )
+    : workspace( workspace ), token_index( token_index ), position( position )
 {
 }
 
@@ -34,89 +36,21 @@ std::vector<CompletionItem> CompletionBuilder::context()
     return {};
   }
 
-  antlr4::Token* result = nullptr;
-  antlr4::Token* prev_token = nullptr;
-  antlr4::Token* second_prev_token = nullptr;
-  auto tokens = workspace.source->get_all_tokens();
-
-  bool waiting_for_function = false;
-  bool waiting_for_class = false;
-  bool in_enum = false;
-
-  for ( const auto& token : tokens )
-  {
-    if ( token->getType() == EscriptLexer::CLASS )
-    {
-      waiting_for_class = true;
-    }
-    else if ( token->getType() == EscriptLexer::ENUM )
-    {
-      in_enum = true;
-    }
-    else if ( token->getType() == EscriptLexer::ENDENUM )
-    {
-      in_enum = false;
-    }
-    else if ( token->getType() == EscriptLexer::FUNCTION )
-    {
-      waiting_for_function = true;
-    }
-    else if ( token->getType() == EscriptLexer::ENDCLASS )
-    {
-      calling_scope = "";
-    }
-    else if ( token->getType() == EscriptLexer::ENDFUNCTION )
-    {
-      current_user_function = "";
-    }
-    else if ( waiting_for_class )
-    {
-      if ( token->getType() == EscriptLexer::IDENTIFIER )
-      {
-        waiting_for_class = false;
-        calling_scope = token->getText();
-      }
-      else if ( token->getType() != EscriptLexer::WS )
-      {
-        waiting_for_class = false;
-      }
-    }
-    else if ( waiting_for_function )
-    {
-      if ( token->getType() == EscriptLexer::IDENTIFIER )
-      {
-        waiting_for_function = false;
-        current_user_function = token->getText();
-      }
-      else if ( token->getType() != EscriptLexer::WS )
-      {
-        waiting_for_function = false;
-      }
-    }
-
-    if ( token->getLine() == position.line_number &&
-         token->getCharPositionInLine() + 1 <= position.character_column &&
-         token->getCharPositionInLine() + 1 + token->getText().length() >=
-             position.character_column )
-    {
-      result = token;
-      if ( token->getTokenIndex() > 0 )
-      {
-        prev_token = tokens[token->getTokenIndex() - 1];
-      }
-      if ( token->getTokenIndex() > 1 )
-      {
-        second_prev_token = tokens[token->getTokenIndex() - 2];
-      }
-      break;
-    }
-  }
-
-  if ( !result )
+  const auto& tokens = token_index.tokens();
+  auto index = token_index.find_at_cursor( position );
+  if ( !index )
   {
     return {};
   }
 
+  antlr4::Token* result = tokens[*index];
+  antlr4::Token* prev_token = *index > 0 ? tokens[*index - 1] : nullptr;
+  antlr4::Token* second_prev_token = *index > 1 ? tokens[*index - 2] : nullptr;
+
+  calling_scope = token_index.enclosing_class( *index );
+  current_user_function = token_index.enclosing_function( *index );
+  bool in_enum = token_index.in_enum( *index );
+
   ScopeTreeQuery query;
   bool is_object_access_query = false;
   bool is_class_query = false;
@@ -12,6 +12,7 @@ struct Position;
 
 namespace VSCodeEscript::CompilerExt
 {
+class TokenIndex;
 
 /**
  * The kind of a completion entry.
@@ -54,13 +55,14 @@ struct CompletionItem
 class CompletionBuilder
 {
 public:
-  CompletionBuilder( Pol::Bscript::Compiler::CompilerWorkspace&,
+  CompletionBuilder( Pol::Bscript::Compiler::CompilerWorkspace&, const TokenIndex&,
                      const Pol::Bscript::Compiler::Position& position );
 
   std::vector<CompletionItem> context();
 
 protected:
   Pol::Bscript::Compiler::CompilerWorkspace& workspace;
+  const TokenIndex& token_index;
   const Pol::Bscript::Compiler::Position& position;
   std::string calling_scope = "";
   std::string current_user_function = "";
@@ -12,8 +12,9 @@ using namespace Pol;
 
 namespace VSCodeEscript::CompilerExt
 {
-DefinitionBuilder::DefinitionBuilder( CompilerWorkspace& workspace, const Position& position )
-    : SemanticContextBuilder( workspace, position )
+DefinitionBuilder::DefinitionBuilder( CompilerWorkspace& workspace, const ScopeIndex& scopes,
+                                      const Position& position )
+    : SemanticContextBuilder( workspace, scopes, position )
 {
 }
 
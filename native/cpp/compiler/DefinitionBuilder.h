@@ -8,7 +8,7 @@ namespace VSCodeEscript::CompilerExt
 class DefinitionBuilder : public SemanticContextBuilder<Pol::Bscript::Compiler::SourceLocation>
 {
 public:
-  DefinitionBuilder( Pol::Bscript::Compiler::CompilerWorkspace&,
+  DefinitionBuilder( Pol::Bscript::Compiler::CompilerWorkspace&, const ScopeIndex& scopes,
                      const Pol::Bscript::Compiler::Position& position );
 
   ~DefinitionBuilder() override = default;
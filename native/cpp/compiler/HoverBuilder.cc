@@ -22,8 +22,8 @@ using namespace EscriptGrammar;
 namespace VSCodeEscript::CompilerExt
 {
 HoverBuilder::HoverBuilder( LSPWorkspace* lsp_workspace, CompilerWorkspace& workspace,
-                            const Position& position )
-    : SemanticContextBuilder( workspace, position ), _lsp_workspace( lsp_workspace )
+                            const ScopeIndex& scopes, const Position& position )
+    : SemanticContextBuilder( workspace, scopes, position ), _lsp_workspace( lsp_workspace )
 {
 }
 
@@ -320,13 +320,9 @@ HoverResult& HoverBuilder::append_comment( const SourceLocation& source_location
   }
 
 
-  auto xmlDoc = _lsp_workspace->get_xml_doc_path( pathname );
-  if ( !xmlDoc.has_value() )
-    return result;
-
   if ( result.type == HoverResult::SymbolType::MODULE_FUNCTION_PARAMETER )
   {
-    auto parsed = XmlDocParser::parse_function( xmlDoc.value(), result.function_def->name );
+    auto parsed = _lsp_workspace->get_xml_doc( pathname, result.function_def->name );
     if ( !parsed )
       return result;
 
@@ -341,7 +337,7 @@ HoverResult& HoverBuilder::append_comment( const SourceLocation& source_location
   }
   else if ( result.type == HoverResult::SymbolType::MODULE_FUNCTION )
   {
-    auto parsed = XmlDocParser::parse_function( xmlDoc.value(), result.symbol );
+    auto parsed = _lsp_workspace->get_xml_doc( pathname, result.symbol );
     if ( !parsed )
       return result;
 
@@ -45,7 +45,7 @@ class HoverBuilder : public SemanticContextBuilder<HoverResult>
 {
 public:
   HoverBuilder( VSCodeEscript::LSPWorkspace*, Pol::Bscript::Compiler::CompilerWorkspace&,
-                const Pol::Bscript::Compiler::Position& position );
+                const ScopeIndex& scopes, const Pol::Bscript::Compiler::Position& position );
 
   ~HoverBuilder() override = default;
 
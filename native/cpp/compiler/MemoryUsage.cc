@@ -0,0 +1,97 @@
+#include "MemoryUsage.h"
+
+#include "bscript/compiler/ast/Node.h"
+#include "bscript/compiler/ast/NodeVisitor.h"
+#include "bscript/compiler/file/SourceFile.h"
+#include "bscript/compiler/model/CompilerWorkspace.h"
+#include <CommonToken.h>
+#include <EscriptGrammar/EscriptParserBaseVisitor.h>
+#include <ParserRuleContext.h>
+#include <tree/TerminalNodeImpl.h>
+
+using namespace Pol::Bscript::Compiler;
+
+namespace VSCodeEscript::CompilerExt
+{
+namespace
+{
+class ParseTreeEstimator : public EscriptGrammar::EscriptParserBaseVisitor
+{
+public:
+  antlrcpp::Any visitChildren( antlr4::tree::ParseTree* node ) override
+  {
+    bytes += sizeof( antlr4::ParserRuleContext ) +
+             node->children.capacity() * sizeof( antlr4::tree::ParseTree* );
+    return EscriptParserBaseVisitor::visitChildren( node );
+  }
+
+  antlrcpp::Any visitTerminal( antlr4::tree::TerminalNode* ) override
+  {
+    bytes += sizeof( antlr4::tree::TerminalNodeImpl );
+    return {};
+  }
+
+  size_t bytes = 0;
+};
+
+class AstEstimator : public NodeVisitor
+{
+public:
+  void visit_children( Node& node ) override
+  {
+    bytes += sizeof( Node ) + vector_memory_usage( node.children );
+    NodeVisitor::visit_children( node );
+  }
+
+  size_t bytes = 0;
+};
+}  // namespace
+
+SourceFileMemoryUsage estimate_memory_usage( SourceFile& source )
+{
+  SourceFileMemoryUsage usage;
+
+  ParseTreeEstimator parse_tree;
+  source.accept( parse_tree );
+  usage.parse_tree = parse_tree.bytes;
+
+  auto tokens = source.get_all_tokens();
+  // The input stream keeps the text as UTF-32, up to the last token. The EOF
+  // token is empty, so it stops before it starts.
+  size_t characters = 0;
+  for ( auto itr = tokens.rbegin(); itr != tokens.rend(); ++itr )
+  {
+    if ( ( *itr )->getStopIndex() + 1 > ( *itr )->getStartIndex() )
+    {
+      characters = ( *itr )->getStopIndex() + 1;
+      break;
+    }
+  }
+  usage.tokens = tokens.size() * ( sizeof( antlr4::CommonToken ) + sizeof( antlr4::Token* ) ) +
+                 characters * sizeof( char32_t );
+  return usage;
+}
+
+size_t estimate_ast_memory_usage( CompilerWorkspace& workspace )
+{
+  AstEstimator estimator;
+  workspace.accept( estimator );
+  return estimator.bytes;
+}
+
+size_t estimate_semantic_tokens_memory_usage( const CompilerWorkspace& workspace )
+{
+  size_t bytes = vector_memory_usage( workspace.tokens );
+  for ( const auto& token : workspace.tokens )
+  {
+    bytes += vector_memory_usage( token.modifiers );
+  }
+  return bytes;
+}
+
+size_t string_memory_usage( const std::string& value )
+{
+  static const size_t small_capacity = std::string().capacity();
+  return value.capacity() > small_capacity ? value.capacity() + 1 : 0;
+}
+}  // namespace VSCodeEscript::CompilerExt
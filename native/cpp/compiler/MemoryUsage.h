@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Pol::Bscript::Compiler
+{
+class CompilerWorkspace;
+class SourceFile;
+}  // namespace Pol::Bscript::Compiler
+
+namespace VSCodeEscript::CompilerExt
+{
+// Estimators for the memory held by parse trees, syntax trees and the
+// indices built from them, in bytes. Objects are counted, and their `sizeof`s
+// and container capacities added up. Allocator overhead and the size of each
+// generated node class are not known here, so the results are lower bounds,
+// meant for comparing documents and components with each other.
+
+struct SourceFileMemoryUsage
+{
+  // ANTLR rule contexts and terminal nodes.
+  size_t parse_tree = 0;
+  // Lexer tokens, and the source text held by the input stream.
+  size_t tokens = 0;
+};
+
+// The memory held by an analyzed document, by component.
+struct DocumentMemoryUsage
+{
+  size_t parse_tree = 0;
+  size_t tokens = 0;
+  size_t ast = 0;
+  // Semantic tokens and the lookup indices built from the analysis.
+  size_t indices = 0;
+
+  size_t total() const { return parse_tree + tokens + ast + indices; }
+};
+
+SourceFileMemoryUsage estimate_memory_usage( Pol::Bscript::Compiler::SourceFile& source );
+
+// The syntax tree of the script and the user functions it uses.
+size_t estimate_ast_memory_usage( Pol::Bscript::Compiler::CompilerWorkspace& workspace );
+
+// The semantic tokens found by the analysis.
+size_t estimate_semantic_tokens_memory_usage(
+    const Pol::Bscript::Compiler::CompilerWorkspace& workspace );
+
+// Heap bytes of a string, zero if it fits the small string buffer.
+size_t string_memory_usage( const std::string& value );
+
+template <typename T>
+size_t vector_memory_usage( const std::vector<T>& values )
+{
+  return values.capacity() * sizeof( T );
+}
+
+// The buckets and nodes of an unordered map or set, without what the
+// elements own themselves.
+template <typename HashTable>
+size_t hash_table_memory_usage( const HashTable& table )
+{
+  return table.bucket_count() * sizeof( void* ) +
+         table.size() * ( sizeof( typename HashTable::value_type ) + 2 * sizeof( void* ) );
+}
+}  // namespace VSCodeEscript::CompilerExt
@@ -0,0 +1,493 @@
+#include "ReferenceIndexFile.h"
+
+#include "../misc/Hash.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <type_traits>
+
+namespace fs = std::filesystem;
+using namespace Pol::Bscript::Compiler;
+
+namespace VSCodeEscript::CompilerExt
+{
+namespace
+{
+constexpr char INDEX_MAGIC[8] = { 'E', 'S', 'C', 'R', 'I', 'D', 'X', '\0' };
+constexpr uint32_t INDEX_VERSION = 1;
+
+// On-disk layout, all little-endian and 8-byte aligned:
+//   Header
+//   StringRecord[string_count]
+//   FileRecord[file_count]
+//   DependencyRecord[dependency_count]
+//   ReferenceRecord[reference_count]
+//   char[string_data_size]
+struct Header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t string_count;
+  uint64_t config_hash;
+  uint32_t file_count;
+  uint32_t dependency_count;
+  uint32_t reference_count;
+  uint32_t reserved;
+  uint64_t string_data_size;
+};
+
+struct StringRecord
+{
+  uint32_t offset;
+  uint32_t length;
+};
+
+struct FileRecord
+{
+  uint32_t pathname;
+  uint32_t first_dependency;
+  uint32_t dependency_count;
+  uint32_t first_reference;
+  uint32_t reference_count;
+  uint32_t reserved;
+};
+
+struct DependencyRecord
+{
+  uint32_t pathname;
+  uint32_t reserved;
+  int64_t mtime;
+  uint64_t size;
+  uint64_t hash;
+};
+
+struct RangeRecord
+{
+  uint16_t start_line;
+  uint16_t start_character;
+  uint16_t end_line;
+  uint16_t end_character;
+  uint32_t start_token;
+  uint32_t end_token;
+};
+
+struct ReferenceRecord
+{
+  uint32_t defined_at_pathname;
+  uint32_t used_at_pathname;
+  RangeRecord defined_at;
+  RangeRecord used_at;
+};
+
+template <typename T>
+const T* records_at( const char* data, size_t offset )
+{
+  static_assert( std::is_trivially_copyable_v<T> );
+  return reinterpret_cast<const T*>( data + offset );
+}
+
+const Header* header_of( const MappedFile& mapping )
+{
+  return records_at<Header>( mapping.data(), 0 );
+}
+
+std::string_view string_at( const MappedFile& mapping, uint32_t index )
+{
+  auto strings = records_at<StringRecord>( mapping.data(), sizeof( Header ) );
+  auto string_data = mapping.data() + mapping.size() - header_of( mapping )->string_data_size;
+  return { string_data + strings[index].offset, strings[index].length };
+}
+
+Range to_range( const RangeRecord& record )
+{
+  return Range( Position{ record.start_line, record.start_character, record.start_token },
+                Position{ record.end_line, record.end_character, record.end_token } );
+}
+
+RangeRecord to_record( const Range& range )
+{
+  return RangeRecord{ range.start.line_number,
+                      range.start.character_column,
+                      range.end.line_number,
+                      range.end.character_column,
+                      static_cast<uint32_t>( range.start.token_index ),
+                      static_cast<uint32_t>( range.end.token_index ) };
+}
+}  // namespace
+
+std::optional<FileStamp> FileStampCache::stat( const std::string& pathname )
+{
+  {
+    std::lock_guard<std::mutex> guard( mutex );
+    auto itr = primed.find( pathname );
+    if ( itr != primed.end() )
+      return itr->second;
+  }
+
+  std::error_code ec;
+  auto size = fs::file_size( pathname, ec );
+  if ( ec )
+    return {};
+  auto mtime = fs::last_write_time( pathname, ec );
+  if ( ec )
+    return {};
+
+  return FileStamp{ static_cast<int64_t>( mtime.time_since_epoch().count() ),
+                    static_cast<uint64_t>( size ), 0 };
+}
+
+std::optional<FileStamp> FileStampCache::get( const std::string& pathname )
+{
+  {
+    std::lock_guard<std::mutex> guard( mutex );
+    auto itr = stamps.find( pathname );
+    if ( itr != stamps.end() )
+      return itr->second;
+  }
+
+  auto stamp = stat( pathname );
+  if ( stamp )
+  {
+    MappedFile file;
+    if ( file.open( pathname ) )
+      stamp->hash = fnv1a_64( file.view() );
+    else
+      stamp.reset();
+  }
+
+  std::lock_guard<std::mutex> guard( mutex );
+  return stamps.emplace( pathname, stamp ).first->second;
+}
+
+void FileStampCache::prime( const std::string& pathname, uint64_t size, int64_t mtime )
+{
+  std::lock_guard<std::mutex> guard( mutex );
+  primed[pathname] = FileStamp{ mtime, size, 0 };
+}
+
+bool FileStampCache::matches( const std::string& pathname, const FileStamp& stamp )
+{
+  auto current = stat( pathname );
+  if ( !current )
+    return false;
+
+  if ( current->mtime == stamp.mtime && current->size == stamp.size )
+    return true;
+
+  // Touched but possibly unchanged, eg. after a checkout.
+  if ( current->size != stamp.size )
+    return false;
+
+  auto hashed = get( pathname );
+  return hashed && hashed->hash == stamp.hash;
+}
+
+ReferenceIndexFile::ReferenceIndexFile( std::string filename, uint64_t config_hash )
+    : _filename( std::move( filename ) ), _config_hash( config_hash )
+{
+}
+
+bool ReferenceIndexFile::load( FileStampCache& stamps )
+{
+  _mapped_entries.clear();
+  _updated_entries.clear();
+
+  if ( !_mapping.open( _filename ) )
+    return false;
+
+  auto invalid = [&]()
+  {
+    _mapped_entries.clear();
+    _mapping.close();
+    return false;
+  };
+
+  if ( _mapping.size() < sizeof( Header ) )
+    return invalid();
+
+  auto h = header_of( _mapping );
+  if ( std::memcmp( h->magic, INDEX_MAGIC, sizeof( INDEX_MAGIC ) ) != 0 ||
+       h->version != INDEX_VERSION || h->config_hash != _config_hash )
+    return invalid();
+
+  uint64_t expected_size = sizeof( Header ) +
+                           uint64_t( h->string_count ) * sizeof( StringRecord ) +
+                           uint64_t( h->file_count ) * sizeof( FileRecord ) +
+                           uint64_t( h->dependency_count ) * sizeof( DependencyRecord ) +
+                           uint64_t( h->reference_count ) * sizeof( ReferenceRecord ) +
+                           h->string_data_size;
+  if ( expected_size != _mapping.size() )
+    return invalid();
+
+  auto strings = records_at<StringRecord>( _mapping.data(), sizeof( Header ) );
+  for ( uint32_t i = 0; i < h->string_count; ++i )
+  {
+    if ( uint64_t( strings[i].offset ) + strings[i].length > h->string_data_size )
+      return invalid();
+  }
+
+  auto string_valid = [&]( uint32_t index ) { return index < h->string_count; };
+
+  size_t files_offset = sizeof( Header ) + h->string_count * sizeof( StringRecord );
+  size_t dependencies_offset = files_offset + h->file_count * sizeof( FileRecord );
+  size_t references_offset =
+      dependencies_offset + h->dependency_count * sizeof( DependencyRecord );
+
+  auto files = records_at<FileRecord>( _mapping.data(), files_offset );
+  auto dependencies = records_at<DependencyRecord>( _mapping.data(), dependencies_offset );
+  auto references = records_at<ReferenceRecord>( _mapping.data(), references_offset );
+
+  for ( uint32_t i = 0; i < h->file_count; ++i )
+  {
+    const auto& file = files[i];
+    if ( !string_valid( file.pathname ) ||
+         uint64_t( file.first_dependency ) + file.dependency_count > h->dependency_count ||
+         uint64_t( file.first_reference ) + file.reference_count > h->reference_count )
+      return invalid();
+
+    for ( uint32_t r = 0; r < file.reference_count; ++r )
+    {
+      const auto& reference = references[file.first_reference + r];
+      if ( !string_valid( reference.defined_at_pathname ) ||
+           !string_valid( reference.used_at_pathname ) )
+        return invalid();
+    }
+
+    std::string pathname( string_at( _mapping, file.pathname ) );
+    bool up_to_date = true;
+    for ( uint32_t d = 0; d < file.dependency_count && up_to_date; ++d )
+    {
+      const auto& dependency = dependencies[file.first_dependency + d];
+      if ( !string_valid( dependency.pathname ) )
+        return invalid();
+
+      up_to_date = stamps.matches(
+          std::string( string_at( _mapping, dependency.pathname ) ),
+          FileStamp{ dependency.mtime, dependency.size, dependency.hash } );
+    }
+
+    if ( up_to_date )
+    {
+      _mapped_entries[std::move( pathname )] = i;
+    }
+  }
+
+  return true;
+}
+
+void ReferenceIndexFile::retain( const std::set<std::string>& pathnames )
+{
+  std::erase_if( _mapped_entries,
+                 [&]( const auto& entry ) { return pathnames.count( entry.first ) == 0; } );
+  std::erase_if( _updated_entries,
+                 [&]( const auto& entry ) { return pathnames.count( entry.first ) == 0; } );
+}
+
+bool ReferenceIndexFile::contains( const std::string& pathname ) const
+{
+  return _mapped_entries.count( pathname ) || _updated_entries.count( pathname );
+}
+
+void ReferenceIndexFile::read_references( const std::string& pathname,
+                                          ReferencesByPathname& references ) const
+{
+  if ( auto updated = _updated_entries.find( pathname ); updated != _updated_entries.end() )
+  {
+    for ( const auto& [defined_at_pathname, referenced_by] : updated->second.references )
+    {
+      auto& target = references[defined_at_pathname];
+      for ( const auto& [defined_at, used_at] : referenced_by )
+      {
+        target[defined_at].insert( used_at.begin(), used_at.end() );
+      }
+    }
+    return;
+  }
+
+  auto mapped = _mapped_entries.find( pathname );
+  if ( mapped == _mapped_entries.end() )
+    return;
+
+  auto h = header_of( _mapping );
+  size_t files_offset = sizeof( Header ) + h->string_count * sizeof( StringRecord );
+  size_t references_offset = files_offset + h->file_count * sizeof( FileRecord ) +
+                             h->dependency_count * sizeof( DependencyRecord );
+  const auto& file = records_at<FileRecord>( _mapping.data(), files_offset )[mapped->second];
+  auto records = records_at<ReferenceRecord>( _mapping.data(), references_offset );
+
+  for ( uint32_t r = 0; r < file.reference_count; ++r )
+  {
+    const auto& record = records[file.first_reference + r];
+    references[std::string( string_at( _mapping, record.defined_at_pathname ) )]
+              [to_range( record.defined_at )]
+                  .emplace( ReferenceLocation{
+                      std::string( string_at( _mapping, record.used_at_pathname ) ),
+                      to_range( record.used_at ) } );
+  }
+}
+
+void ReferenceIndexFile::update( const std::string& pathname, ReferenceIndexEntry entry )
+{
+  _mapped_entries.erase( pathname );
+  _updated_entries[pathname] = std::move( entry );
+}
+
+void ReferenceIndexFile::save()
+{
+  std::vector<StringRecord> strings;
+  std::string string_data;
+  std::unordered_map<std::string, uint32_t> string_ids;
+  std::vector<FileRecord> files;
+  std::vector<DependencyRecord> dependencies;
+  std::vector<ReferenceRecord> references;
+  std::map<std::string, uint32_t> new_mapped_entries;
+
+  auto intern = [&]( std::string_view str ) -> uint32_t
+  {
+    auto [itr, inserted] =
+        string_ids.emplace( std::string( str ), static_cast<uint32_t>( strings.size() ) );
+    if ( inserted )
+    {
+      strings.push_back( StringRecord{ static_cast<uint32_t>( string_data.size() ),
+                                       static_cast<uint32_t>( str.size() ) } );
+      string_data.append( str );
+    }
+    return itr->second;
+  };
+
+  auto begin_file = [&]( const std::string& pathname )
+  {
+    new_mapped_entries[pathname] = static_cast<uint32_t>( files.size() );
+    files.push_back( FileRecord{ intern( pathname ), static_cast<uint32_t>( dependencies.size() ),
+                                 0, static_cast<uint32_t>( references.size() ), 0, 0 } );
+  };
+  auto end_file = [&]()
+  {
+    auto& file = files.back();
+    file.dependency_count = static_cast<uint32_t>( dependencies.size() ) - file.first_dependency;
+    file.reference_count = static_cast<uint32_t>( references.size() ) - file.first_reference;
+  };
+
+  if ( !_mapped_entries.empty() )
+  {
+    auto h = header_of( _mapping );
+    size_t files_offset = sizeof( Header ) + h->string_count * sizeof( StringRecord );
+    size_t dependencies_offset = files_offset + h->file_count * sizeof( FileRecord );
+    size_t references_offset =
+        dependencies_offset + h->dependency_count * sizeof( DependencyRecord );
+    auto old_files = records_at<FileRecord>( _mapping.data(), files_offset );
+    auto old_dependencies =
+        records_at<DependencyRecord>( _mapping.data(), dependencies_offset );
+    auto old_references = records_at<ReferenceRecord>( _mapping.data(), references_offset );
+
+    for ( const auto& [pathname, index] : _mapped_entries )
+    {
+      const auto& file = old_files[index];
+      begin_file( pathname );
+      for ( uint32_t d = 0; d < file.dependency_count; ++d )
+      {
+        auto dependency = old_dependencies[file.first_dependency + d];
+        dependency.pathname = intern( string_at( _mapping, dependency.pathname ) );
+        dependencies.push_back( dependency );
+      }
+      for ( uint32_t r = 0; r < file.reference_count; ++r )
+      {
+        auto reference = old_references[file.first_reference + r];
+        reference.defined_at_pathname =
+            intern( string_at( _mapping, reference.defined_at_pathname ) );
+        reference.used_at_pathname = intern( string_at( _mapping, reference.used_at_pathname ) );
+        references.push_back( reference );
+      }
+      end_file();
+    }
+  }
+
+  for ( const auto& [pathname, entry] : _updated_entries )
+  {
+    begin_file( pathname );
+    for ( const auto& [dependency_pathname, stamp] : entry.dependencies )
+    {
+      dependencies.push_back( DependencyRecord{ intern( dependency_pathname ), 0, stamp.mtime,
+                                                stamp.size, stamp.hash } );
+    }
+    for ( const auto& [defined_at_pathname, referenced_by] : entry.references )
+    {
+      auto defined_at_id = intern( defined_at_pathname );
+      for ( const auto& [defined_at, used_at] : referenced_by )
+      {
+        for ( const auto& location : used_at )
+        {
+          references.push_back( ReferenceRecord{ defined_at_id, intern( location.pathname ),
+                                                 to_record( defined_at ),
+                                                 to_record( location.range ) } );
+        }
+      }
+    }
+    end_file();
+  }
+
+  Header h{};
+  std::memcpy( h.magic, INDEX_MAGIC, sizeof( INDEX_MAGIC ) );
+  h.version = INDEX_VERSION;
+  h.string_count = static_cast<uint32_t>( strings.size() );
+  h.config_hash = _config_hash;
+  h.file_count = static_cast<uint32_t>( files.size() );
+  h.dependency_count = static_cast<uint32_t>( dependencies.size() );
+  h.reference_count = static_cast<uint32_t>( references.size() );
+  h.string_data_size = string_data.size();
+
+  auto temp_filename = _filename + ".tmp";
+  {
+    std::error_code ec;
+    fs::create_directories( fs::path( _filename ).parent_path(), ec );
+
+    std::ofstream out( temp_filename, std::ios::binary | std::ios::trunc );
+    if ( !out )
+      return;
+
+    auto write = [&]( const void* data, size_t size )
+    { out.write( static_cast<const char*>( data ), static_cast<std::streamsize>( size ) ); };
+
+    write( &h, sizeof( h ) );
+    write( strings.data(), strings.size() * sizeof( StringRecord ) );
+    write( files.data(), files.size() * sizeof( FileRecord ) );
+    write( dependencies.data(), dependencies.size() * sizeof( DependencyRecord ) );
+    write( references.data(), references.size() * sizeof( ReferenceRecord ) );
+    write( string_data.data(), string_data.size() );
+
+    if ( !out.flush() )
+    {
+      out.close();
+      fs::remove( temp_filename, ec );
+      return;
+    }
+  }
+
+  // The old file must be unmapped before it can be replaced on Windows.
+  _mapping.close();
+
+  std::error_code ec;
+  fs::rename( temp_filename, _filename, ec );
+  bool replaced = !ec;
+  if ( !replaced )
+  {
+    fs::remove( temp_filename, ec );
+  }
+
+  if ( _mapping.open( _filename ) )
+  {
+    if ( replaced )
+    {
+      _mapped_entries = std::move( new_mapped_entries );
+      _updated_entries.clear();
+    }
+  }
+  else
+  {
+    // The entries that were only on disk can no longer be read, so those
+    // scripts will be indexed again.
+    _mapped_entries.clear();
+  }
+}
+}  // namespace VSCodeEscript::CompilerExt
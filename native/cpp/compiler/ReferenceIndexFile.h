@@ -0,0 +1,96 @@
+#pragma once
+
+#include "../misc/MappedFile.h"
+#include "ReferencesBuilder.h"
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace VSCodeEscript::CompilerExt
+{
+struct FileStamp
+{
+  int64_t mtime = 0;
+  uint64_t size = 0;
+  uint64_t hash = 0;
+};
+
+// Stats and hashes files on disk, remembering the results so files shared by
+// many scripts are only read once. Thread-safe.
+class FileStampCache
+{
+public:
+  std::optional<FileStamp> get( const std::string& pathname );
+
+  // Whether `pathname` still has the contents described by `stamp`. The
+  // contents are only hashed if the modification time differs.
+  bool matches( const std::string& pathname, const FileStamp& stamp );
+
+  // Records the size and modification time of `pathname`, eg. from a
+  // directory walk, so it is not stat'ed again.
+  void prime( const std::string& pathname, uint64_t size, int64_t mtime );
+
+private:
+  std::optional<FileStamp> stat( const std::string& pathname );
+
+  std::mutex mutex;
+  std::unordered_map<std::string, std::optional<FileStamp>> stamps;
+  // Sizes and modification times given to `prime()`, without hashes.
+  std::unordered_map<std::string, FileStamp> primed;
+};
+
+// The references contributed by analyzing one script, along with every file
+// that analysis read.
+struct ReferenceIndexEntry
+{
+  std::vector<std::pair<std::string, FileStamp>> dependencies;
+  ReferencesByPathname references;
+};
+
+// A memory-mapped, on-disk cache of `ReferenceIndexEntry`s keyed by script
+// pathname. The file is tied to a configuration hash, so changing the
+// compiler settings discards it.
+class ReferenceIndexFile
+{
+public:
+  ReferenceIndexFile( std::string filename, uint64_t config_hash );
+
+  // Maps the index file and keeps the entries whose dependencies are
+  // unchanged on disk. Returns false if the file is missing, malformed or was
+  // written for another configuration.
+  bool load( FileStampCache& stamps );
+
+  // Drops the entries of scripts not in `pathnames`, eg. ones no longer below
+  // any script root, so `save()` does not keep them.
+  void retain( const std::set<std::string>& pathnames );
+
+  // Whether `pathname` has an up-to-date entry.
+  bool contains( const std::string& pathname ) const;
+
+  // Adds the references of the entry for `pathname` to `references`.
+  void read_references( const std::string& pathname, ReferencesByPathname& references ) const;
+
+  void update( const std::string& pathname, ReferenceIndexEntry entry );
+
+  // Writes all up-to-date and updated entries, replacing the file on disk.
+  void save();
+
+  // Not thread-safe on its own; hold this while using the index.
+  std::mutex& mutex() { return _mutex; }
+
+private:
+  std::string _filename;
+  uint64_t _config_hash;
+  MappedFile _mapping;
+  // Record index into the mapping for each up-to-date pathname.
+  std::map<std::string, uint32_t> _mapped_entries;
+  std::map<std::string, ReferenceIndexEntry> _updated_entries;
+  std::mutex _mutex;
+};
+}  // namespace VSCodeEscript::CompilerExt
@@ -0,0 +1,176 @@
+#include "ReferenceStore.h"
+
+#include "MemoryUsage.h"
+#include "clib/clib.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace Pol::Bscript::Compiler;
+
+namespace VSCodeEscript::CompilerExt
+{
+namespace
+{
+void hash_combine( size_t& seed, size_t value )
+{
+  seed ^= value + 0x9e3779b97f4a7c15ULL + ( seed << 6 ) + ( seed >> 2 );
+}
+
+bool operator<( const Position& x1, const Position& x2 )
+{
+  if ( x1.line_number != x2.line_number )
+    return x1.line_number < x2.line_number;
+  if ( x1.character_column != x2.character_column )
+    return x1.character_column < x2.character_column;
+  return x1.token_index < x2.token_index;
+}
+
+bool operator==( const Position& x1, const Position& x2 )
+{
+  return x1.line_number == x2.line_number && x1.character_column == x2.character_column &&
+         x1.token_index == x2.token_index;
+}
+}  // namespace
+
+ReferenceStore::ReferenceStore( PathTable& paths ) : paths( paths ), shards() {}
+
+size_t ReferenceStore::LocationHash::operator()( const Location& location ) const
+{
+  size_t seed = location.pathname;
+  for ( const auto* position : { &location.range.start, &location.range.end } )
+  {
+    hash_combine( seed, position->line_number );
+    hash_combine( seed, position->character_column );
+    hash_combine( seed, position->token_index );
+  }
+  return seed;
+}
+
+bool ReferenceStore::LocationEqual::operator()( const Location& x1, const Location& x2 ) const
+{
+  return x1.pathname == x2.pathname && x1.range.start == x2.range.start &&
+         x1.range.end == x2.range.end;
+}
+
+void ReferenceStore::add( const ReferencesByPathname& references )
+{
+  // Resolve all path ids and group the definitions by shard before taking any
+  // shard lock.
+  std::array<std::vector<std::pair<Location, std::vector<Location>>>, SHARD_COUNT> pending;
+  for ( const auto& [defined_at_pathname, referenced_by] : references )
+  {
+    auto defined_at_id = paths.intern( defined_at_pathname );
+    for ( const auto& [defined_at, used_at] : referenced_by )
+    {
+      std::vector<Location> usages;
+      usages.reserve( used_at.size() );
+      for ( const auto& location : used_at )
+      {
+        usages.push_back( Location{ paths.intern( location.pathname ), location.range } );
+      }
+
+      Location definition{ defined_at_id, defined_at };
+      auto index = LocationHash()( definition ) % SHARD_COUNT;
+      pending[index].emplace_back( definition, std::move( usages ) );
+    }
+  }
+
+  // Usages on the same range are ordered by pathname, as they were before
+  // paths were interned, rather than by id: ids follow the order paths were
+  // first seen, which differs from run to run.
+  const auto less = [this]( const Location& x1, const Location& x2 )
+  {
+    if ( RangeComparator()( x1.range, x2.range ) )
+      return true;
+    if ( RangeComparator()( x2.range, x1.range ) )
+      return false;
+    if ( x1.pathname == x2.pathname )
+      return false;
+    const auto& pathname1 = paths.pathname( x1.pathname );
+    const auto& pathname2 = paths.pathname( x2.pathname );
+    if ( auto compare = stricmp( pathname1.c_str(), pathname2.c_str() ); compare != 0 )
+      return compare < 0;
+    return std::strcmp( pathname1.c_str(), pathname2.c_str() ) < 0;
+  };
+
+  for ( size_t index = 0; index < SHARD_COUNT; ++index )
+  {
+    if ( pending[index].empty() )
+      continue;
+
+    auto& shard = shards[index];
+    std::lock_guard<std::mutex> guard( shard.mutex );
+    for ( auto& [definition, usages] : pending[index] )
+    {
+      auto& existing = shard.usages[definition];
+      auto middle = static_cast<std::ptrdiff_t>( existing.size() );
+      existing.insert( existing.end(), usages.begin(), usages.end() );
+      std::sort( existing.begin() + middle, existing.end(), less );
+      std::inplace_merge( existing.begin(), existing.begin() + middle, existing.end(), less );
+      existing.erase( std::unique( existing.begin(), existing.end(), LocationEqual() ),
+                      existing.end() );
+    }
+  }
+}
+
+std::vector<ReferenceLocation> ReferenceStore::find( const std::string& pathname,
+                                                     const Range& range ) const
+{
+  auto id = paths.find( pathname );
+  if ( !id )
+  {
+    return {};
+  }
+
+  Location definition{ *id, range };
+  std::vector<Location> usages;
+  {
+    const auto& shard = shard_of( definition );
+    std::lock_guard<std::mutex> guard( shard.mutex );
+    auto itr = shard.usages.find( definition );
+    if ( itr == shard.usages.end() )
+    {
+      return {};
+    }
+    usages = itr->second;
+  }
+
+  std::vector<ReferenceLocation> results;
+  results.reserve( usages.size() );
+  for ( const auto& usage : usages )
+  {
+    results.push_back( ReferenceLocation{ paths.pathname( usage.pathname ), usage.range } );
+  }
+  return results;
+}
+
+void ReferenceStore::clear()
+{
+  for ( auto& shard : shards )
+  {
+    std::lock_guard<std::mutex> guard( shard.mutex );
+    shard.usages.clear();
+  }
+}
+
+size_t ReferenceStore::memory_usage() const
+{
+  size_t bytes = 0;
+  for ( const auto& shard : shards )
+  {
+    std::lock_guard<std::mutex> guard( shard.mutex );
+    bytes += hash_table_memory_usage( shard.usages );
+    for ( const auto& [definition, usages] : shard.usages )
+    {
+      bytes += vector_memory_usage( usages );
+    }
+  }
+  return bytes;
+}
+
+const ReferenceStore::Shard& ReferenceStore::shard_of( const Location& definition ) const
+{
+  return shards[LocationHash()( definition ) % SHARD_COUNT];
+}
+}  // namespace VSCodeEscript::CompilerExt
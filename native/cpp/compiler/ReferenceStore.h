@@ -0,0 +1,74 @@
+#pragma once
+
+#include "../misc/PathTable.h"
+#include "ReferencesBuilder.h"
+#include "SourceLocationComparator.h"
+#include "bscript/compiler/file/SourceLocation.h"
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace VSCodeEscript::CompilerExt
+{
+// The usages of every definition in the workspace. Pathnames are interned in
+// a `PathTable`, and the usages of each definition are kept in a flat, sorted
+// vector. Definitions are spread over independently locked shards, so
+// analyses on different threads can add their references at the same time.
+// Thread-safe.
+class ReferenceStore
+{
+public:
+  explicit ReferenceStore( PathTable& paths );
+  ReferenceStore( const ReferenceStore& ) = delete;
+  ReferenceStore& operator=( const ReferenceStore& ) = delete;
+
+  // Adds `references`, taking the lock of each affected shard once. Build
+  // `references` per thread and add them in one go, rather than adding
+  // references one at a time.
+  void add( const ReferencesByPathname& references );
+
+  // The usages of the definition at `range` in `pathname`, ordered by range.
+  std::vector<ReferenceLocation> find( const std::string& pathname,
+                                       const Pol::Bscript::Compiler::Range& range ) const;
+
+  void clear();
+
+  // Estimated heap bytes of the stored usages, without the interned pathnames.
+  size_t memory_usage() const;
+
+private:
+  struct Location
+  {
+    PathId pathname;
+    Pol::Bscript::Compiler::Range range;
+  };
+
+  struct LocationHash
+  {
+    size_t operator()( const Location& location ) const;
+  };
+
+  struct LocationEqual
+  {
+    bool operator()( const Location& x1, const Location& x2 ) const;
+  };
+
+  struct Shard
+  {
+    mutable std::mutex mutex;
+    // Definition -> sorted, unique usages.
+    std::unordered_map<Location, std::vector<Location>, LocationHash, LocationEqual> usages;
+  };
+
+  static constexpr size_t SHARD_COUNT = 16;
+
+  const Shard& shard_of( const Location& definition ) const;
+
+  PathTable& paths;
+  std::array<Shard, SHARD_COUNT> shards;
+};
+}  // namespace VSCodeEscript::CompilerExt
@@ -1,7 +1,5 @@
 #include "ReferencesBuilder.h"
 
-#include "../napi/LSPDocument.h"
-#include "../napi/LSPWorkspace.h"
 #include "bscript/compiler/ast/ConstDeclaration.h"
 #include "bscript/compiler/ast/FloatValue.h"
 #include "bscript/compiler/ast/Function.h"
@@ -9,7 +7,9 @@
 #include "bscript/compiler/ast/Identifier.h"
 #include "bscript/compiler/ast/IntegerValue.h"
 #include "bscript/compiler/ast/ModuleFunctionDeclaration.h"
+#include "bscript/compiler/ast/Program.h"
 #include "bscript/compiler/ast/StringValue.h"
+#include "bscript/compiler/ast/TopLevelStatements.h"
 #include "bscript/compiler/ast/UninitializedValue.h"
 #include "bscript/compiler/ast/UserFunction.h"
 #include "bscript/compiler/file/SourceFileIdentifier.h"
@@ -17,50 +17,137 @@
 #include "bscript/compiler/model/FunctionLink.h"
 #include "bscript/compiler/model/Variable.h"
 
+#include <vector>
+
 namespace VSCodeEscript::CompilerExt
 {
 using namespace Pol::Bscript::Compiler;
 
-ReferencesBuilder::ReferencesBuilder( LSPWorkspace* lsp_workspace,
-                                      CompilerWorkspace& compiler_workspace,
-                                      const std::string& pathname )
-    : NodeVisitor(),
-      lsp_workspace( lsp_workspace ),
-      compiler_workspace( compiler_workspace ),
-      pathname( pathname )
+void merge_references( ReferencesByPathname& target, ReferencesByPathname&& source )
+{
+  for ( auto& [pathname, referenced_by] : source )
+  {
+    auto& target_referenced_by = target[pathname];
+    for ( auto& [defined_at, used_at] : referenced_by )
+    {
+      target_referenced_by[defined_at].merge( used_at );
+    }
+  }
+  source.clear();
+}
+
+ReferencesBuilder::ReferencesBuilder( CompilerWorkspace& compiler_workspace,
+                                      ReferencesByPathname& references )
+    : NodeVisitor(), compiler_workspace( compiler_workspace ), references( references )
+{
+}
+
+void ReferencesBuilder::collect( CompilerWorkspace& compiler_workspace,
+                                 ReferencesByPathname& references )
+{
+  ReferencesBuilder builder( compiler_workspace, references );
+
+  compiler_workspace.top_level_statements->accept( builder );
+
+  if ( auto& program = compiler_workspace.program )
+  {
+    program->accept( builder );
+  }
+
+  for ( auto& user_function : compiler_workspace.user_functions )
+  {
+    user_function->accept( builder );
+  }
+}
+
+void ReferencesBuilder::collect(
+    CompilerWorkspace& compiler_workspace, ReferencesByPathname& references,
+    const std::function<bool( const SourceFileIdentifier& )>& skip_file )
+{
+  ReferencesBuilder builder( compiler_workspace, references );
+
+  // Asks once per file; identifier index 0 is the analyzed file itself.
+  std::vector<int8_t> skipped;
+  auto is_skipped = [&]( const Node& node )
+  {
+    const auto* ident = node.source_location.source_file_identifier;
+    if ( !ident || ident->index == 0 )
+      return false;
+    if ( skipped.size() <= ident->index )
+      skipped.resize( ident->index + 1, -1 );
+    if ( skipped[ident->index] < 0 )
+      skipped[ident->index] = skip_file( *ident ) ? 1 : 0;
+    return skipped[ident->index] == 1;
+  };
+
+  for ( auto& child : compiler_workspace.top_level_statements->children )
+  {
+    if ( !child || is_skipped( *child ) )
+    {
+      continue;
+    }
+    builder.add_unoptimized_constant_reference( *child );
+    child->accept( builder );
+  }
+
+  if ( auto& program = compiler_workspace.program )
+  {
+    program->accept( builder );
+  }
+
+  for ( auto& user_function : compiler_workspace.user_functions )
+  {
+    if ( !is_skipped( *user_function ) )
+    {
+      user_function->accept( builder );
+    }
+  }
+}
+
+void ReferencesBuilder::add_reference_by( const SourceLocation& defined_at,
+                                          const SourceLocation& used_at )
 {
+  add_reference_by( defined_at.source_file_identifier->pathname, defined_at.range,
+                    used_at.source_file_identifier->pathname, used_at.range );
+}
+
+void ReferencesBuilder::add_reference_by( const std::string& defined_at_pathname,
+                                          const Range& defined_at,
+                                          const std::string& used_at_pathname,
+                                          const Range& used_at )
+{
+  references[defined_at_pathname][defined_at].emplace(
+      ReferenceLocation{ used_at_pathname, used_at } );
 }
 
 void ReferencesBuilder::visit_identifier( Identifier& node )
 {
   if ( node.variable )
   {
-    auto* doc = lsp_workspace->create_or_get_from_cache(
-        node.variable->source_location.source_file_identifier->pathname );
-    doc->add_reference_by( node.variable->source_location, node.source_location );
+    add_reference_by( node.variable->source_location, node.source_location );
   }
   visit_children( node );
 }
 
 
-void add_function_reference( LSPDocument* doc, Function* user_function_link, FunctionCall& node )
+void ReferencesBuilder::add_function_reference( Function* function_link, FunctionCall& node )
 {
   // We need to make a new location for only the method name, as FunctionCall source
   // location includes the arguments
-  const auto& start = user_function_link->source_location.range.start;
+  const auto& start = function_link->source_location.range.start;
   const auto& used_at_start = node.source_location.range.start;
   Range defined_at{
       { start.line_number, start.character_column },
-      { start.line_number, static_cast<unsigned short>( start.character_column +
-                                                        user_function_link->name.length() ) } };
+      { start.line_number,
+        static_cast<unsigned short>( start.character_column + function_link->name.length() ) } };
 
   Range used_at{ { used_at_start.line_number, used_at_start.character_column },
                  { used_at_start.line_number,
                    static_cast<unsigned short>( used_at_start.character_column +
-                                                user_function_link->name.length() ) } };
+                                                function_link->name.length() ) } };
 
-  doc->add_reference_by( defined_at, node.source_location.source_file_identifier->pathname,
-                         used_at );
+  add_reference_by( function_link->source_location.source_file_identifier->pathname, defined_at,
+                    node.source_location.source_file_identifier->pathname, used_at );
 }
 
 void ReferencesBuilder::visit_function_call( FunctionCall& node )
@@ -69,17 +156,11 @@ void ReferencesBuilder::visit_function_call( FunctionCall& node )
   {
     if ( auto user_function_link = link->user_function() )
     {
-      auto* doc = lsp_workspace->create_or_get_from_cache(
-          user_function_link->source_location.source_file_identifier->pathname );
-
-      add_function_reference( doc, user_function_link, node );
+      add_function_reference( user_function_link, node );
     }
     else if ( auto module_function_decl = link->module_function_declaration() )
     {
-      auto* doc = lsp_workspace->create_or_get_from_cache(
-          module_function_decl->source_location.source_file_identifier->pathname );
-
-      add_function_reference( doc, module_function_decl, node );
+      add_function_reference( module_function_decl, node );
     }
   }
   // for includes, the children of function calls are empty...?
@@ -133,9 +214,7 @@ void ReferencesBuilder::add_unoptimized_constant_reference( const Node& node )
     {
       if ( auto constant = compiler_workspace.constants.find( identifier->name() ) )
       {
-        auto* doc = lsp_workspace->create_or_get_from_cache(
-            constant->source_location.source_file_identifier->pathname );
-        doc->add_reference_by( constant->source_location, node.source_location );
+        add_reference_by( constant->source_location, node.source_location );
       }
     }
   }
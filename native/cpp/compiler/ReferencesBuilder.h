@@ -1,27 +1,53 @@
 #pragma once
 
+#include "SourceLocationComparator.h"
 #include "bscript/compiler/ast/NodeVisitor.h"
 
+#include <functional>
+#include <map>
+#include <set>
 #include <string>
 
 namespace Pol::Bscript::Compiler
 {
 class CompilerWorkspace;
-}
-
-namespace VSCodeEscript
-{
-class LSPWorkspace;
-}
+class Function;
+class FunctionCall;
+class SourceFileIdentifier;
+}  // namespace Pol::Bscript::Compiler
 
 namespace VSCodeEscript::CompilerExt
 {
+// Usages of the definitions inside a single file, keyed by definition range.
+using ReferencedBy = std::map<Pol::Bscript::Compiler::Range /*defined at*/,
+                              std::set<ReferenceLocation, ReferenceLocationComparator> /*used at*/,
+                              RangeComparator>;
+
+// References found while visiting a compiler workspace, keyed by the pathname
+// of the file containing the definition.
+using ReferencesByPathname = std::map<std::string, ReferencedBy>;
+
+// Moves all references from `source` into `target`.
+void merge_references( ReferencesByPathname& target, ReferencesByPathname&& source );
 
 class ReferencesBuilder : public Pol::Bscript::Compiler::NodeVisitor
 {
 public:
-  ReferencesBuilder( LSPWorkspace* lsp_workspace, Pol::Bscript::Compiler::CompilerWorkspace&,
-                     const std::string& pathname );
+  ReferencesBuilder( Pol::Bscript::Compiler::CompilerWorkspace&, ReferencesByPathname& references );
+
+  // Visits all statements and user functions of `compiler_workspace`, adding
+  // the references found to `references`. Does not touch any JavaScript
+  // object, so it is safe to call from worker threads.
+  static void collect( Pol::Bscript::Compiler::CompilerWorkspace& compiler_workspace,
+                       ReferencesByPathname& references );
+
+  // Like `collect()`, but skips the top-level statements and user functions
+  // of the included files for which `skip_file` returns true, eg. because
+  // their references come from analyzing those files on their own.
+  static void collect(
+      Pol::Bscript::Compiler::CompilerWorkspace& compiler_workspace,
+      ReferencesByPathname& references,
+      const std::function<bool( const Pol::Bscript::Compiler::SourceFileIdentifier& )>& skip_file );
 
   void visit_identifier( Pol::Bscript::Compiler::Identifier& ) override;
   void visit_function_call( Pol::Bscript::Compiler::FunctionCall& ) override;
@@ -34,10 +60,17 @@ public:
   void visit_children( Pol::Bscript::Compiler::Node& node ) override;
 
 private:
-  LSPWorkspace* lsp_workspace;
   Pol::Bscript::Compiler::CompilerWorkspace& compiler_workspace;
-  const std::string& pathname;
+  ReferencesByPathname& references;
 
+  void add_reference_by( const Pol::Bscript::Compiler::SourceLocation& defined_at,
+                         const Pol::Bscript::Compiler::SourceLocation& used_at );
+  void add_reference_by( const std::string& defined_at_pathname,
+                         const Pol::Bscript::Compiler::Range& defined_at,
+                         const std::string& used_at_pathname,
+                         const Pol::Bscript::Compiler::Range& used_at );
+  void add_function_reference( Pol::Bscript::Compiler::Function* function_link,
+                               Pol::Bscript::Compiler::FunctionCall& node );
   void add_unoptimized_constant_reference( const Pol::Bscript::Compiler::Node& );
 };
 }  // namespace VSCodeEscript::CompilerExt
\ No newline at end of file
@@ -1,6 +1,5 @@
 #include "ReferencesFinder.h"
 
-#include "../napi/LSPDocument.h"
 #include "../napi/LSPWorkspace.h"
 #include "bscript/compiler/ast/FunctionCall.h"
 #include "bscript/compiler/ast/Identifier.h"
@@ -15,8 +14,8 @@ using namespace Pol::Bscript::Compiler;
 namespace VSCodeEscript::CompilerExt
 {
 ReferencesFinder::ReferencesFinder( CompilerWorkspace& workspace, LSPWorkspace* lsp_workspace,
-                                    const Position& position )
-    : SemanticContextBuilder( workspace, position ), lsp_workspace( lsp_workspace )
+                                    const ScopeIndex& scopes, const Position& position )
+    : SemanticContextBuilder( workspace, scopes, position ), lsp_workspace( lsp_workspace )
 {
 }
 
@@ -75,11 +74,10 @@ std::optional<ReferencesResult> ReferencesFinder::get_user_function( UserFunctio
 std::optional<ReferencesResult> ReferencesFinder::get_references_by_definition(
     const std::string& pathname, const Pol::Bscript::Compiler::Range& range )
 {
-  auto* lsp_document = lsp_workspace->create_or_get_from_cache( pathname );
-  auto references = lsp_document->referenced_by.find( range );
-  if ( references != lsp_document->referenced_by.end() )
+  auto references = lsp_workspace->reference_store().find( pathname, range );
+  if ( !references.empty() )
   {
-    return references->second;
+    return references;
   }
   return {};
 }
@@ -4,20 +4,20 @@
 #include "SemanticContextBuilder.h"
 #include "SourceLocationComparator.h"
 
-#include <set>
+#include <vector>
 namespace VSCodeEscript
 {
 class LSPWorkspace;
 }
 namespace VSCodeEscript::CompilerExt
 {
-using ReferencesResult = std::set<ReferenceLocation, ReferenceLocationComparator>;
+using ReferencesResult = std::vector<ReferenceLocation>;
 
 class ReferencesFinder : public SemanticContextBuilder<ReferencesResult>
 {
 public:
   ReferencesFinder( Pol::Bscript::Compiler::CompilerWorkspace&, VSCodeEscript::LSPWorkspace*,
-                    const Pol::Bscript::Compiler::Position& position );
+                    const ScopeIndex& scopes, const Pol::Bscript::Compiler::Position& position );
 
   ~ReferencesFinder() override = default;
 
@@ -0,0 +1,151 @@
+#include "ScopeIndex.h"
+
+#include "MemoryUsage.h"
+#include "bscript/compiler/file/SourceFile.h"
+#include "bscript/compiler/model/CompilerWorkspace.h"
+#include <EscriptGrammar/EscriptParserBaseVisitor.h>
+
+#include <algorithm>
+
+using namespace Pol::Bscript::Compiler;
+using namespace EscriptGrammar;
+
+namespace VSCodeEscript::CompilerExt
+{
+namespace
+{
+bool starts_after( const Position& start, const Position& position )
+{
+  if ( start.line_number != position.line_number )
+    return start.line_number > position.line_number;
+  return start.character_column > position.character_column;
+}
+}  // namespace
+
+// Visits the parse tree in pre-order, so scopes are added in order of their
+// start positions and the stack holds the scopes enclosing the current node.
+class ScopeIndexBuilder : public EscriptParserBaseVisitor
+{
+public:
+  explicit ScopeIndexBuilder( std::vector<ScopeIndex::Scope>& scopes ) : scopes( scopes ) {}
+
+  antlrcpp::Any visitClassDeclaration( EscriptParser::ClassDeclarationContext* ctx ) override
+  {
+    if ( auto* identifier = ctx->IDENTIFIER() )
+      return visit_scope( ctx, ScopeIndex::Kind::Class, identifier->getText() );
+    return visitChildren( ctx );
+  }
+
+  antlrcpp::Any visitEnumStatement( EscriptParser::EnumStatementContext* ctx ) override
+  {
+    auto* identifier = ctx->IDENTIFIER();
+    return visit_scope( ctx, ScopeIndex::Kind::Enum,
+                        identifier && ctx->CLASS() ? identifier->getText() : std::string() );
+  }
+
+  antlrcpp::Any visitFunctionDeclaration(
+      EscriptParser::FunctionDeclarationContext* ctx ) override
+  {
+    if ( auto* identifier = ctx->IDENTIFIER() )
+      return visit_scope( ctx, ScopeIndex::Kind::Function, identifier->getText() );
+    return visitChildren( ctx );
+  }
+
+  antlrcpp::Any visitFunctionExpression( EscriptParser::FunctionExpressionContext* ctx ) override
+  {
+    if ( auto* at = ctx->AT() )
+    {
+      auto* symbol = at->getSymbol();
+      return visit_scope( ctx, ScopeIndex::Kind::FunctionExpression,
+                          "funcexpr@0:" + std::to_string( symbol->getLine() ) + ":" +
+                              std::to_string( symbol->getCharPositionInLine() + 1 ) );
+    }
+    return visitChildren( ctx );
+  }
+
+private:
+  antlrcpp::Any visit_scope( antlr4::ParserRuleContext* ctx, ScopeIndex::Kind kind,
+                             std::string name )
+  {
+    size_t parent = stack.empty() ? ScopeIndex::npos : stack.back();
+    stack.push_back( scopes.size() );
+    scopes.push_back( ScopeIndex::Scope{ kind, Range( *ctx ), std::move( name ), parent } );
+    auto result = visitChildren( ctx );
+    stack.pop_back();
+    return result;
+  }
+
+  std::vector<ScopeIndex::Scope>& scopes;
+  std::vector<size_t> stack;
+};
+
+ScopeIndex::ScopeIndex( CompilerWorkspace& workspace )
+{
+  if ( workspace.source )
+  {
+    ScopeIndexBuilder builder( _scopes );
+    workspace.source->accept( builder );
+  }
+}
+
+size_t ScopeIndex::innermost( const Position& position ) const
+{
+  // The last scope starting at or before `position`. Any scope containing
+  // `position` starts at or before it too, so is this scope or one of its
+  // ancestors.
+  auto itr = std::partition_point( _scopes.begin(), _scopes.end(),
+                                   [&]( const Scope& scope )
+                                   { return !starts_after( scope.range.start, position ); } );
+  if ( itr == _scopes.begin() )
+    return npos;
+
+  size_t index = static_cast<size_t>( itr - _scopes.begin() ) - 1;
+  while ( index != npos && !_scopes[index].range.contains( position ) )
+  {
+    index = _scopes[index].parent;
+  }
+  return index;
+}
+
+std::vector<const ScopeIndex::Scope*> ScopeIndex::enclosing( const Position& position ) const
+{
+  std::vector<const Scope*> result;
+  for ( size_t index = innermost( position ); index != npos; index = _scopes[index].parent )
+  {
+    result.push_back( &_scopes[index] );
+  }
+  return result;
+}
+
+std::string ScopeIndex::calling_scope( const Position& position ) const
+{
+  for ( size_t index = innermost( position ); index != npos; index = _scopes[index].parent )
+  {
+    const auto& scope = _scopes[index];
+    if ( ( scope.kind == Kind::Class || scope.kind == Kind::Enum ) && !scope.name.empty() )
+      return scope.name;
+  }
+  return {};
+}
+
+std::string ScopeIndex::current_user_function( const Position& position ) const
+{
+  for ( size_t index = innermost( position ); index != npos; index = _scopes[index].parent )
+  {
+    const auto& scope = _scopes[index];
+    if ( scope.kind == Kind::Function )
+      return scope.name;
+  }
+  return {};
+}
+
+size_t ScopeIndex::memory_usage() const
+{
+  size_t bytes = vector_memory_usage( _scopes );
+  for ( const auto& scope : _scopes )
+  {
+    bytes += string_memory_usage( scope.name );
+  }
+  return bytes;
+}
+}  // namespace VSCodeEscript::CompilerExt
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "bscript/compiler/file/SourceLocation.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Pol::Bscript::Compiler
+{
+class CompilerWorkspace;
+}  // namespace Pol::Bscript::Compiler
+
+namespace VSCodeEscript::CompilerExt
+{
+// The class, enum, user function and function expression declarations of a
+// compiler workspace's parse tree, built once per analysis. Declarations nest
+// but never partially overlap, so each scope records its innermost enclosing
+// scope and the scopes around a position are found by a binary search over
+// start positions followed by a walk up the parents.
+class ScopeIndex
+{
+public:
+  enum class Kind
+  {
+    Class,
+    Enum,
+    Function,
+    FunctionExpression,
+  };
+
+  struct Scope
+  {
+    Kind kind;
+    Pol::Bscript::Compiler::Range range;
+    // The declared name; `funcexpr@0:<line>:<column>` for function expressions,
+    // matching the names given by the compiler. Empty for enums that are not
+    // enum classes, as only those introduce a scope.
+    std::string name;
+    // Index of the innermost scope containing this one, or `npos`.
+    size_t parent;
+  };
+
+  static constexpr size_t npos = static_cast<size_t>( -1 );
+
+  explicit ScopeIndex( Pol::Bscript::Compiler::CompilerWorkspace& workspace );
+
+  // The scopes containing `position`, innermost first.
+  std::vector<const Scope*> enclosing( const Pol::Bscript::Compiler::Position& position ) const;
+
+  // The name of the class (or enum class) containing `position`, or an empty string.
+  std::string calling_scope( const Pol::Bscript::Compiler::Position& position ) const;
+
+  // The name of the user function containing `position`, or an empty string.
+  // Function expressions are skipped, as they are not scopes for name lookup.
+  std::string current_user_function( const Pol::Bscript::Compiler::Position& position ) const;
+
+  const std::vector<Scope>& scopes() const { return _scopes; }
+
+  // Estimated heap bytes of the index.
+  size_t memory_usage() const;
+
+private:
+  friend class ScopeIndexBuilder;
+
+  // Innermost scope containing `position`, or `npos`.
+  size_t innermost( const Pol::Bscript::Compiler::Position& position ) const;
+
+  // In order of their start positions.
+  std::vector<Scope> _scopes;
+};
+}  // namespace VSCodeEscript::CompilerExt
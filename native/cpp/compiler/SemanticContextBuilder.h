@@ -17,6 +17,7 @@
 #include "bscript/compiler/file/SourceLocation.h"
 #include "bscript/compiler/model/CompilerWorkspace.h"
 #include "bscript/compiler/model/Variable.h"
+#include "ScopeIndex.h"
 #include <EscriptGrammar/EscriptParserBaseVisitor.h>
 #include <optional>
 #include <vector>
@@ -27,7 +28,7 @@ template <typename T>
 class SemanticContextBuilder : public EscriptGrammar::EscriptParserBaseVisitor
 {
 public:
-  SemanticContextBuilder( Pol::Bscript::Compiler::CompilerWorkspace&,
+  SemanticContextBuilder( Pol::Bscript::Compiler::CompilerWorkspace&, const ScopeIndex& scopes,
                           const Pol::Bscript::Compiler::Position& position );
 
   // ~SemanticContextBuilder() override = default;
@@ -61,12 +62,6 @@ public:
   virtual std::optional<T> get_class( const std::string& name );
 
 
-  virtual antlrcpp::Any visitClassDeclaration(
-      EscriptGrammar::EscriptParser::ClassDeclarationContext* ctx ) override;
-  virtual antlrcpp::Any visitEnumStatement(
-      EscriptGrammar::EscriptParser::EnumStatementContext* ctx ) override;
-  virtual antlrcpp::Any visitFunctionDeclaration(
-      EscriptGrammar::EscriptParser::FunctionDeclarationContext* ctx ) override;
   virtual antlrcpp::Any visitChildren( antlr4::tree::ParseTree* node ) override;
 
   bool contains( antlr4::tree::TerminalNode* terminal );
@@ -83,6 +78,7 @@ public:
 
 protected:
   Pol::Bscript::Compiler::CompilerWorkspace& workspace;
+  const ScopeIndex& scopes;
   Pol::Bscript::Compiler::Position position;
   std::vector<antlr4::ParserRuleContext*> nodes;
   std::string calling_scope;
@@ -91,9 +87,9 @@ protected:
 
 template <typename T>
 SemanticContextBuilder<T>::SemanticContextBuilder(
-    Pol::Bscript::Compiler::CompilerWorkspace& workspace,
+    Pol::Bscript::Compiler::CompilerWorkspace& workspace, const ScopeIndex& scopes,
     const Pol::Bscript::Compiler::Position& position )
-    : workspace( workspace ), position( position )
+    : workspace( workspace ), scopes( scopes ), position( position )
 {
 }
 
@@ -314,6 +310,9 @@ std::optional<T> SemanticContextBuilder<T>::try_function(
 template <typename T>
 std::optional<T> SemanticContextBuilder<T>::context()
 {
+  calling_scope = scopes.calling_scope( position );
+  current_user_function = scopes.current_user_function( position );
+
   if ( workspace.source )
   {
     workspace.source->accept( *this );
@@ -845,60 +844,6 @@ bool SemanticContextBuilder<T>::contains( antlr4::tree::TerminalNode* terminal )
   return false;
 }
 
-template <typename T>
-inline std::any SemanticContextBuilder<T>::visitClassDeclaration(
-    EscriptGrammar::EscriptParser::ClassDeclarationContext* ctx )
-{
-  if ( ctx->IDENTIFIER() )
-  {
-    Pol::Bscript::Compiler::Range range( *ctx );
-
-    // Set the calling scope if we are visiting a class declaration inside our range.
-    if ( range.contains( position ) )
-    {
-      calling_scope = ctx->IDENTIFIER()->getText();
-    }
-  }
-
-  return visitChildren( ctx );
-}
-template <typename T>
-inline std::any SemanticContextBuilder<T>::visitEnumStatement(
-    EscriptGrammar::EscriptParser::EnumStatementContext* ctx )
-{
-  if ( auto identifier = ctx->IDENTIFIER(); identifier && ctx->CLASS() )
-  {
-    Pol::Bscript::Compiler::Range range( *ctx );
-
-    // Set the calling scope if we are visiting a class declaration inside our range.
-    if ( range.contains( position ) )
-    {
-      calling_scope = identifier->getText();
-    }
-  }
-
-  return visitChildren( ctx );
-}
-
-template <typename T>
-inline antlrcpp::Any SemanticContextBuilder<T>::visitFunctionDeclaration(
-    EscriptGrammar::EscriptParser::FunctionDeclarationContext* ctx )
-{
-  if ( ctx->IDENTIFIER() )
-  {
-    Pol::Bscript::Compiler::Range range( *ctx );
-
-    // Set the calling scope if we are visiting a class declaration inside our range.
-    if ( range.contains( position ) )
-    {
-      current_user_function = ctx->IDENTIFIER()->getText();
-    }
-  }
-
-  return visitChildren( ctx );
-}
-
-
 template <typename T>
 antlrcpp::Any SemanticContextBuilder<T>::visitChildren( antlr4::tree::ParseTree* node )
 {
@@ -906,13 +851,15 @@ antlrcpp::Any SemanticContextBuilder<T>::visitChildren( antlr4::tree::ParseTree*
   {
     if ( auto* ctx = dynamic_cast<antlr4::ParserRuleContext*>( child ) )
     {
+      // A rule's descendants lie within its range, so only the rules
+      // containing the position need to be visited.
       Pol::Bscript::Compiler::Range range( *ctx );
       if ( range.contains( position ) )
       {
         nodes.push_back( ctx );
+        child->accept( this );
       }
     }
-    child->accept( this );
   }
 
   return antlrcpp::Any();
@@ -0,0 +1,121 @@
+#include "SemanticTokensEncoder.h"
+
+#include "MemoryUsage.h"
+#include "bscript/compiler/model/CompilerWorkspace.h"
+
+#include <algorithm>
+#include <numeric>
+
+using namespace Pol::Bscript::Compiler;
+
+namespace VSCodeEscript::CompilerExt
+{
+SemanticTokensEncoder::SemanticTokensEncoder( const CompilerWorkspace& compiler_workspace )
+    : compiler_workspace( compiler_workspace ), order( compiler_workspace.tokens.size() )
+{
+  const auto& tokens = compiler_workspace.tokens;
+  std::iota( order.begin(), order.end(), 0 );
+  std::stable_sort( order.begin(), order.end(),
+                    [&]( uint32_t x1, uint32_t x2 )
+                    {
+                      const auto& token1 = tokens[x1];
+                      const auto& token2 = tokens[x2];
+                      if ( token1.line_number != token2.line_number )
+                        return token1.line_number < token2.line_number;
+                      return token1.character_column < token2.character_column;
+                    } );
+
+  lines.reserve( order.size() );
+  for ( auto index : order )
+  {
+    lines.push_back( tokens[index].line_number - 1 );
+  }
+}
+
+size_t SemanticTokensEncoder::size() const
+{
+  return order.size() * 5;
+}
+
+void SemanticTokensEncoder::encode( uint32_t* data ) const
+{
+  encode( data, 0, order.size() );
+}
+
+void SemanticTokensEncoder::encode( uint32_t* data, size_t begin, size_t end ) const
+{
+  const auto& tokens = compiler_workspace.tokens;
+  uint32_t previous_line = 0;
+  uint32_t previous_character = 0;
+
+  for ( size_t i = begin; i < end; ++i )
+  {
+    const auto& token = tokens[order[i]];
+    uint32_t line = lines[i];
+    uint32_t character = token.character_column - 1;
+
+    uint32_t modifiers = 0;
+    for ( auto const& modifier : token.modifiers )
+    {
+      modifiers |= ( 1u << static_cast<unsigned int>( modifier ) );
+    }
+
+    *data++ = line - previous_line;
+    *data++ = line == previous_line ? character - previous_character : character;
+    *data++ = token.length;
+    *data++ = static_cast<uint32_t>( token.type );
+    *data++ = modifiers;
+
+    previous_line = line;
+    previous_character = character;
+  }
+}
+
+std::pair<size_t, size_t> SemanticTokensEncoder::find_lines( uint32_t first_line,
+                                                            uint32_t last_line ) const
+{
+  auto begin = std::lower_bound( lines.begin(), lines.end(), first_line );
+  auto end = std::upper_bound( begin, lines.end(), last_line );
+  return { static_cast<size_t>( begin - lines.begin() ),
+           static_cast<size_t>( end - lines.begin() ) };
+}
+
+size_t SemanticTokensEncoder::size_lines( uint32_t first_line, uint32_t last_line ) const
+{
+  auto [begin, end] = find_lines( first_line, last_line );
+  return ( end - begin ) * 5;
+}
+
+void SemanticTokensEncoder::encode_lines( uint32_t first_line, uint32_t last_line,
+                                          uint32_t* data ) const
+{
+  auto [begin, end] = find_lines( first_line, last_line );
+  encode( data, begin, end );
+}
+
+size_t SemanticTokensEncoder::memory_usage() const
+{
+  return vector_memory_usage( order ) + vector_memory_usage( lines );
+}
+
+std::optional<SemanticTokensEdit> diff_semantic_tokens( std::span<const uint32_t> previous,
+                                                        std::span<const uint32_t> current )
+{
+  const size_t common = std::min( previous.size(), current.size() );
+
+  size_t prefix = 0;
+  while ( prefix < common && previous[prefix] == current[prefix] )
+    ++prefix;
+
+  if ( prefix == previous.size() && prefix == current.size() )
+    return {};
+
+  size_t suffix = 0;
+  while ( suffix < common - prefix &&
+          previous[previous.size() - 1 - suffix] == current[current.size() - 1 - suffix] )
+    ++suffix;
+
+  return SemanticTokensEdit{ prefix, previous.size() - prefix - suffix,
+                             current.size() - prefix - suffix };
+}
+}  // namespace VSCodeEscript::CompilerExt
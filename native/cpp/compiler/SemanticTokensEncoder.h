@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace Pol::Bscript::Compiler
+{
+class CompilerWorkspace;
+}  // namespace Pol::Bscript::Compiler
+
+namespace VSCodeEscript::CompilerExt
+{
+// Encodes the semantic tokens of a compiler workspace in the LSP relative
+// format: five integers per token (line delta, start character delta,
+// length, type, modifiers), ordered by position. The tokens are sorted once
+// on construction, so the encoder can be kept alongside the workspace to
+// serve repeated requests, including ones for a range of lines.
+class SemanticTokensEncoder
+{
+public:
+  explicit SemanticTokensEncoder(
+      const Pol::Bscript::Compiler::CompilerWorkspace& compiler_workspace );
+
+  // Number of integers written by `encode()`.
+  size_t size() const;
+
+  void encode( uint32_t* data ) const;
+
+  // Number of integers written by `encode_lines()`.
+  size_t size_lines( uint32_t first_line, uint32_t last_line ) const;
+
+  // The tokens starting on lines `[first_line, last_line]` (zero-based),
+  // encoded relative to the start of the document. Found by binary search.
+  void encode_lines( uint32_t first_line, uint32_t last_line, uint32_t* data ) const;
+
+  // Estimated heap bytes of the encoder, without the tokens it encodes.
+  size_t memory_usage() const;
+
+private:
+  void encode( uint32_t* data, size_t begin, size_t end ) const;
+  // The range of `order` holding the tokens on lines `[first_line, last_line]`.
+  std::pair<size_t, size_t> find_lines( uint32_t first_line, uint32_t last_line ) const;
+
+  const Pol::Bscript::Compiler::CompilerWorkspace& compiler_workspace;
+  // Token indices, sorted by position.
+  std::vector<uint32_t> order;
+  // The zero-based line of each token in `order`.
+  std::vector<uint32_t> lines;
+};
+
+// A single edit turning one encoding into another: replace `delete_count`
+// integers at `start` with `current[start, start + insert_count)`.
+struct SemanticTokensEdit
+{
+  size_t start;
+  size_t delete_count;
+  size_t insert_count;
+};
+
+// The edit between two encodings, covering everything between their common
+// prefix and suffix. Returns nothing if they are equal.
+std::optional<SemanticTokensEdit> diff_semantic_tokens( std::span<const uint32_t> previous,
+                                                        std::span<const uint32_t> current );
+}  // namespace VSCodeEscript::CompilerExt
@@ -3,6 +3,7 @@
 #include "../misc/XmlDocParser.h"
 #include "../napi/LSPWorkspace.h"
 #include "HoverBuilder.h"
+#include "TokenIndex.h"
 
 #include "bscript/compiler/ast/Expression.h"
 #include "bscript/compiler/ast/FunctionParameterDeclaration.h"
@@ -18,8 +19,12 @@ using namespace EscriptGrammar;
 namespace VSCodeEscript::CompilerExt
 {
 SignatureHelpBuilder::SignatureHelpBuilder( LSPWorkspace* lsp_workspace,
-                                            CompilerWorkspace& workspace, const Position& position )
-    : _lsp_workspace( lsp_workspace ), workspace( workspace ), position( position )
+                                            CompilerWorkspace& workspace,
+                                            const TokenIndex& token_index, const Position& position )
+    : _lsp_workspace( lsp_workspace ),
+      workspace( workspace ),
+      token_index( token_index ),
+      position( position )
 {
 }
 
@@ -30,7 +35,7 @@ SignatureHelp make_signature_help(
 {
   bool added = false;
   std::string result = function_name + "(";
-  std::unique_ptr<XmlDocParser> parsed;
+  std::shared_ptr<const XmlDocParser> parsed;
   std::vector<SignatureHelpParameter> parameters;
   parameters.reserve( params.size() );
 
@@ -39,9 +44,7 @@ SignatureHelp make_signature_help(
   if ( function_def != nullptr )
   {
     auto pathname = function_def->scope + ".em";
-    auto xmlDoc = lsp_workspace->get_xml_doc_path( pathname );
-    if ( xmlDoc.has_value() )
-      parsed = XmlDocParser::parse_function( xmlDoc.value(), function_name );
+    parsed = lsp_workspace->get_xml_doc( pathname, function_name );
   }
   for ( const auto& param_ref : params | std::views::drop( skip_first_param ? 1 : 0 ) )
   {
@@ -100,227 +103,145 @@ std::optional<SignatureHelp> SignatureHelpBuilder::context()
 {
   if ( workspace.source )
   {
-    auto tokens = workspace.source->get_all_tokens();
-    bool in_class = false;
-    bool in_function = false;
+    const auto& tokens = token_index.tokens();
 
     ScopeTreeQuery query;
     bool is_object_access_query = false;
 
-    antlr4::Token* token;
-    // Loop the source from the end to find the token containing our position
-    for ( auto rit = tokens.rbegin(); rit != tokens.rend(); ++rit )
+    // Find the token containing our position: the last one starting at or
+    // before it, or else the one ending there.
+    auto index = token_index.find( position );
+    if ( index && *index > 0 && !Range( tokens[*index] ).contains( position ) )
     {
-      token = *rit;
-      Pol::Bscript::Compiler::Range range( token );
+      --*index;
+    }
+    if ( !index || !Range( tokens[*index] ).contains( position ) )
+    {
+      return {};
+    }
 
-      // Since we are going in reverse, finding an ENDCLASS token means we are _in_ a class.
-      if ( token->getType() == EscriptLexer::ENDCLASS )
-      {
-        in_class = true;
-      }
-      // Similarly, finding a CLASS token means we are _outside_ a class.
-      else if ( token->getType() == EscriptLexer::CLASS )
-      {
-        in_class = false;
-      }
+    antlr4::Token* token = tokens[*index];
+    auto rit = tokens.rbegin() + ( tokens.size() - 1 - *index );
+
+    // Holds parameter counts for nested function calls
+    std::stack<size_t> param_counts;
+    // Current parameter
+    size_t current_param = 0;
 
-      else if ( token->getType() == EscriptLexer::ENDFUNCTION )
+    do
+    {
+      // A comma: increase parameter count
+      if ( token->getType() == EscriptLexer::COMMA )
       {
-        in_function = true;
+        ++current_param;
       }
-      else if ( token->getType() == EscriptLexer::FUNCTION )
+      // An open parenthesis: either...
+      else if ( token->getType() == EscriptLexer::LPAREN )
       {
-        in_function = false;
-      }
-
-      // We found the token
-      if ( range.contains( position ) )
-      {
-        // Holds parameter counts for nested function calls
-        std::stack<size_t> param_counts;
-        // Current parameter
-        size_t current_param = 0;
-
-        do
+        // We have no inner function calls
+        if ( param_counts.empty() )
         {
-          // A comma: increase parameter count
-          if ( token->getType() == EscriptLexer::COMMA )
+          // Get the identifier before this last open parenthesis
+          if ( ++rit != tokens.rend() )
           {
-            ++current_param;
-          }
-          // An open parenthesis: either...
-          else if ( token->getType() == EscriptLexer::LPAREN )
-          {
-            // We have no inner function calls
-            if ( param_counts.empty() )
+            token = *rit;
+            if ( token->getType() == EscriptLexer::IDENTIFIER )
             {
-              // Get the identifier before this last open parenthesis
-              if ( ++rit != tokens.rend() )
+              auto function_name = token->getText();
+
+              query.prefix = function_name;
+
+              // Check for a scoped call
+              if ( token->getTokenIndex() > 0 &&
+                   tokens[token->getTokenIndex() - 1]->getType() == EscriptLexer::COLONCOLON )
               {
-                token = *rit;
-                if ( token->getType() == EscriptLexer::IDENTIFIER )
+                if ( token->getTokenIndex() > 1 &&
+                     tokens[token->getTokenIndex() - 2]->getType() == EscriptLexer::IDENTIFIER )
                 {
-                  auto function_name = token->getText();
-
-                  query.prefix = function_name;
+                  query.prefix_scope = tokens[token->getTokenIndex() - 2]->getText();
+                }
+                else
+                {
+                  query.prefix_scope = ScopeName::Global;
+                }
+              }
 
-                  // Check for a scoped call
-                  if ( token->getTokenIndex() > 0 &&
-                       tokens[token->getTokenIndex() - 1]->getType() == EscriptLexer::COLONCOLON )
+              // Check for a method call
+              if ( token->getTokenIndex() > 0 &&
+                   tokens[token->getTokenIndex() - 1]->getType() == EscriptLexer::DOT )
+              {
+                if ( token->getTokenIndex() > 1 &&
+                     tokens[token->getTokenIndex() - 2]->getType() == EscriptLexer::IDENTIFIER )
+                {
+                  if ( Pol::Clib::caseInsensitiveEqual(
+                           "this", tokens[token->getTokenIndex() - 2]->getText() ) )
                   {
-                    if ( token->getTokenIndex() > 1 &&
-                         tokens[token->getTokenIndex() - 2]->getType() == EscriptLexer::IDENTIFIER )
-                    {
-                      query.prefix_scope = tokens[token->getTokenIndex() - 2]->getText();
-                    }
-                    else
-                    {
-                      query.prefix_scope = ScopeName::Global;
-                    }
+                    is_object_access_query = true;
                   }
-
-                  // Check for a method call
-                  if ( token->getTokenIndex() > 0 &&
-                       tokens[token->getTokenIndex() - 1]->getType() == EscriptLexer::DOT )
+                  else
                   {
-                    if ( token->getTokenIndex() > 1 &&
-                         tokens[token->getTokenIndex() - 2]->getType() == EscriptLexer::IDENTIFIER )
-                    {
-                      if ( Pol::Clib::caseInsensitiveEqual(
-                               "this", tokens[token->getTokenIndex() - 2]->getText() ) )
-                      {
-                        is_object_access_query = true;
-                      }
-                      else
-                      {
-                        return {};
-                      }
-                    }
-                    else
-                    {
-                      query.prefix_scope = ScopeName::Global;
-                    }
+                    return {};
                   }
-
-                  break;
+                }
+                else
+                {
+                  query.prefix_scope = ScopeName::Global;
                 }
               }
 
-              // No need to continue trying anything else, as the best-effort above failed.
-              return {};
-            }
-            else
-            {
-              current_param = param_counts.top();
-              param_counts.pop();
+              break;
             }
           }
-          else if ( token->getType() == EscriptLexer::RPAREN )
-          {
-            param_counts.push( current_param );
-            current_param = 0;
-          }
-          // FIXME improvement add other checks to bail-out fast, eg `if` cannot occur here.
-          ++rit;
-        } while ( rit != tokens.rend() && ( token = *rit ) );
 
-        if ( query.prefix.empty() )
-        {
+          // No need to continue trying anything else, as the best-effort above failed.
           return {};
         }
-
-        if ( ( in_class || in_function ) && rit != tokens.rend() )
+        else
         {
-          // If in a class, we need to find the class name to get the calling
-          // scope. We do this by continuing to move the reverse iterator `rit`
-          // toward the beginning of the source, looking for the CLASS token.
-          antlr4::Token* class_token = nullptr;
-          antlr4::Token* function_token = nullptr;
-          for ( ; rit != tokens.rend(); ++rit )
-          {
-            token = *rit;
-            if ( token->getType() == EscriptLexer::CLASS )
-            {
-              class_token = token;
-              if ( function_token || !in_function )
-                break;
-            }
-            else if ( token->getType() == EscriptLexer::FUNCTION )
-            {
-              function_token = token;
-              if ( class_token || !in_class )
-                break;
-            }
-          }
-
-          // Then, we find the next non-whitespace token after the CLASS token,
-          // which is the class name if an IDENTIFIER.
-          if ( class_token && class_token->getTokenIndex() < tokens.size() - 1 )
-          {
-            for ( auto it = tokens.begin() + class_token->getTokenIndex() + 1; it < tokens.end();
-                  ++it )
-            {
-              auto forward_token = *it;
-              if ( forward_token->getType() == EscriptLexer::WS )
-              {
-                continue;
-              }
-
-              if ( forward_token->getType() == EscriptLexer::IDENTIFIER )
-              {
-                query.calling_scope = forward_token->getText();
-              }
-
-              break;
-            }
-          }
-
-          if ( function_token && function_token->getTokenIndex() < tokens.size() - 1 )
-          {
-            for ( auto it = tokens.begin() + function_token->getTokenIndex() + 1; it < tokens.end();
-                  ++it )
-            {
-              auto forward_token = *it;
-              if ( forward_token->getType() == EscriptLexer::WS )
-              {
-                continue;
-              }
-
-              if ( forward_token->getType() == EscriptLexer::IDENTIFIER )
-              {
-                query.current_user_function = forward_token->getText();
-              }
-
-              break;
-            }
-          }
+          current_param = param_counts.top();
+          param_counts.pop();
         }
+      }
+      else if ( token->getType() == EscriptLexer::RPAREN )
+      {
+        param_counts.push( current_param );
+        current_param = 0;
+      }
+      // FIXME improvement add other checks to bail-out fast, eg `if` cannot occur here.
+      ++rit;
+    } while ( rit != tokens.rend() && ( token = *rit ) );
 
-        if ( auto* module_function = workspace.scope_tree.find_module_function( query ) )
-        {
-          return make_signature_help( _lsp_workspace, module_function->name,
-                                      module_function->parameters(), current_param, module_function,
-                                      false );
-        }
-        else if ( auto* user_function = ( is_object_access_query
-                                              ? workspace.scope_tree.find_class_method( query )
-                                              : workspace.scope_tree.find_user_function( query ) ) )
-        {
-          bool skip_first_param =
-              user_function->type == UserFunctionType::Constructor ||
-              user_function->type == UserFunctionType::Super ||
-              ( user_function->type == UserFunctionType::Method && is_object_access_query );
+    if ( query.prefix.empty() )
+    {
+      return {};
+    }
 
-          return make_signature_help( _lsp_workspace, user_function->name,
-                                      user_function->parameters(), current_param, nullptr,
-                                      skip_first_param );
-        }
+    // `token` is the identifier of the called function.
+    query.calling_scope = token_index.enclosing_class( token->getTokenIndex() );
+    query.current_user_function = token_index.enclosing_function( token->getTokenIndex() );
 
-        // No need to continue trying anything else, as the best-effort above failed.
-        return {};
-      }
+    if ( auto* module_function = workspace.scope_tree.find_module_function( query ) )
+    {
+      return make_signature_help( _lsp_workspace, module_function->name,
+                                  module_function->parameters(), current_param, module_function,
+                                  false );
     }
+    else if ( auto* user_function = ( is_object_access_query
+                                          ? workspace.scope_tree.find_class_method( query )
+                                          : workspace.scope_tree.find_user_function( query ) ) )
+    {
+      bool skip_first_param =
+          user_function->type == UserFunctionType::Constructor ||
+          user_function->type == UserFunctionType::Super ||
+          ( user_function->type == UserFunctionType::Method && is_object_access_query );
+
+      return make_signature_help( _lsp_workspace, user_function->name,
+                                  user_function->parameters(), current_param, nullptr,
+                                  skip_first_param );
+    }
+
+    // No need to continue trying anything else, as the best-effort above failed.
+    return {};
   }
   return {};
 }
@@ -15,6 +15,8 @@ class LSPWorkspace;
 }
 namespace VSCodeEscript::CompilerExt
 {
+class TokenIndex;
+
 struct SignatureHelpParameter
 {
   size_t start;
@@ -32,12 +34,13 @@ class SignatureHelpBuilder
 {
 public:
   SignatureHelpBuilder( LSPWorkspace* lsp_workspace, Pol::Bscript::Compiler::CompilerWorkspace&,
-                        const Pol::Bscript::Compiler::Position& position );
+                        const TokenIndex&, const Pol::Bscript::Compiler::Position& position );
 
   std::optional<SignatureHelp> context();
 
 protected:
   Pol::Bscript::Compiler::CompilerWorkspace& workspace;
+  const TokenIndex& token_index;
   Pol::Bscript::Compiler::Position position;
   LSPWorkspace* _lsp_workspace;
   std::string calling_scope = "";
@@ -0,0 +1,207 @@
+#include "TokenIndex.h"
+
+#include "MemoryUsage.h"
+#include "bscript/compiler/file/SourceFile.h"
+#include "bscript/compiler/file/SourceLocation.h"
+#include "bscript/compiler/model/CompilerWorkspace.h"
+#include <EscriptGrammar/EscriptLexer.h>
+
+#include <algorithm>
+
+using namespace Pol::Bscript::Compiler;
+using namespace EscriptGrammar;
+
+namespace VSCodeEscript::CompilerExt
+{
+namespace
+{
+const std::string empty_name;
+}
+
+TokenIndex::TokenIndex( const CompilerWorkspace& workspace )
+{
+  if ( workspace.source )
+  {
+    _tokens = workspace.source->get_all_tokens();
+  }
+
+  // Lexer tokens are in source order, so one pass fills the line starts.
+  size_t last_line = _tokens.empty() ? 0 : _tokens.back()->getLine();
+  line_starts.assign( last_line + 2, _tokens.size() );
+  for ( size_t index = _tokens.size(); index-- > 0; )
+  {
+    line_starts[_tokens[index]->getLine()] = index;
+  }
+  for ( size_t line = last_line; line-- > 0; )
+  {
+    line_starts[line] = std::min( line_starts[line], line_starts[line + 1] );
+  }
+
+  build_spans();
+}
+
+void TokenIndex::build_spans()
+{
+  // Mirrors the forward scan completion used to do on every request: a class
+  // or function is entered at the identifier following its keyword, and left
+  // at its end keyword.
+  bool waiting_for_function = false;
+  bool waiting_for_class = false;
+  std::optional<size_t> open_class;
+  std::optional<size_t> open_function;
+  std::optional<size_t> open_enum;
+
+  for ( size_t index = 0; index < _tokens.size(); ++index )
+  {
+    auto* token = _tokens[index];
+    auto type = token->getType();
+    if ( type == EscriptLexer::CLASS )
+    {
+      waiting_for_class = true;
+    }
+    else if ( type == EscriptLexer::ENUM )
+    {
+      enums.push_back( Span{ index, _tokens.size(), "" } );
+      open_enum = enums.size() - 1;
+    }
+    else if ( type == EscriptLexer::ENDENUM )
+    {
+      if ( open_enum )
+        enums[*open_enum].end = index;
+      open_enum.reset();
+    }
+    else if ( type == EscriptLexer::FUNCTION )
+    {
+      waiting_for_function = true;
+    }
+    else if ( type == EscriptLexer::ENDCLASS )
+    {
+      if ( open_class )
+        classes[*open_class].end = index;
+      open_class.reset();
+    }
+    else if ( type == EscriptLexer::ENDFUNCTION )
+    {
+      if ( open_function )
+        functions[*open_function].end = index;
+      open_function.reset();
+    }
+    else if ( waiting_for_class )
+    {
+      if ( type == EscriptLexer::IDENTIFIER )
+      {
+        if ( open_class )
+          classes[*open_class].end = index;
+        classes.push_back( Span{ index, _tokens.size(), token->getText() } );
+        open_class = classes.size() - 1;
+      }
+      if ( type != EscriptLexer::WS )
+        waiting_for_class = false;
+    }
+    else if ( waiting_for_function )
+    {
+      if ( type == EscriptLexer::IDENTIFIER )
+      {
+        if ( open_function )
+          functions[*open_function].end = index;
+        functions.push_back( Span{ index, _tokens.size(), token->getText() } );
+        open_function = functions.size() - 1;
+      }
+      if ( type != EscriptLexer::WS )
+        waiting_for_function = false;
+    }
+  }
+}
+
+std::optional<size_t> TokenIndex::find( const Position& position ) const
+{
+  if ( _tokens.empty() || position.line_number == 0 )
+  {
+    return {};
+  }
+
+  size_t line = std::min<size_t>( position.line_number, line_starts.size() - 2 );
+  auto line_begin = _tokens.begin() + line_starts[line];
+  auto line_end = _tokens.begin() + line_starts[line + 1];
+  if ( line < position.line_number )
+  {
+    // Past the last line: the last token is the closest one.
+    line_begin = line_end;
+  }
+
+  auto itr = std::upper_bound( line_begin, line_end, position.character_column,
+                               []( size_t column, const antlr4::Token* token )
+                               { return column < token->getCharPositionInLine() + 1; } );
+  if ( itr == _tokens.begin() )
+  {
+    return {};
+  }
+  return static_cast<size_t>( itr - _tokens.begin() ) - 1;
+}
+
+std::optional<size_t> TokenIndex::find_at_cursor( const Position& position ) const
+{
+  const auto touches = [&]( const antlr4::Token* token )
+  {
+    return token->getLine() == position.line_number &&
+           token->getCharPositionInLine() + 1 <= position.character_column &&
+           token->getCharPositionInLine() + 1 + token->getText().length() >=
+               position.character_column;
+  };
+
+  auto index = find( position );
+  if ( !index || !touches( _tokens[*index] ) )
+  {
+    return {};
+  }
+  // A cursor between two tokens touches both; prefer the earlier one.
+  while ( *index > 0 && touches( _tokens[*index - 1] ) )
+  {
+    --*index;
+  }
+  return index;
+}
+
+const TokenIndex::Span* TokenIndex::find_span( const std::vector<Span>& spans, size_t index )
+{
+  const auto begins_after = []( size_t value, const Span& span ) { return value < span.begin; };
+  auto itr = std::upper_bound( spans.begin(), spans.end(), index, begins_after );
+  if ( itr == spans.begin() )
+  {
+    return nullptr;
+  }
+  --itr;
+  return index < itr->end ? &*itr : nullptr;
+}
+
+const std::string& TokenIndex::enclosing_class( size_t index ) const
+{
+  auto* span = find_span( classes, index );
+  return span ? span->name : empty_name;
+}
+
+const std::string& TokenIndex::enclosing_function( size_t index ) const
+{
+  auto* span = find_span( functions, index );
+  return span ? span->name : empty_name;
+}
+
+bool TokenIndex::in_enum( size_t index ) const
+{
+  return find_span( enums, index ) != nullptr;
+}
+
+size_t TokenIndex::memory_usage() const
+{
+  size_t bytes = vector_memory_usage( _tokens ) + vector_memory_usage( line_starts );
+  for ( const auto* spans : { &classes, &functions, &enums } )
+  {
+    bytes += vector_memory_usage( *spans );
+    for ( const auto& span : *spans )
+    {
+      bytes += string_memory_usage( span.name );
+    }
+  }
+  return bytes;
+}
+}  // namespace VSCodeEscript::CompilerExt
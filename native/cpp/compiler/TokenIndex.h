@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace antlr4
+{
+class Token;
+}  // namespace antlr4
+
+namespace Pol::Bscript::Compiler
+{
+class CompilerWorkspace;
+struct Position;
+}  // namespace Pol::Bscript::Compiler
+
+namespace VSCodeEscript::CompilerExt
+{
+// Position lookups over all lexer tokens of a compiler workspace's source,
+// built once per analysis so requests near the end of a large file cost the
+// same as at the top. Also records the class, user function and enum each
+// token is in, as found by scanning the tokens from the start of the file.
+class TokenIndex
+{
+public:
+  explicit TokenIndex( const Pol::Bscript::Compiler::CompilerWorkspace& workspace );
+
+  // All tokens, including hidden ones, in source order. A token's position in
+  // this vector is its token index.
+  const std::vector<antlr4::Token*>& tokens() const { return _tokens; }
+
+  // The last token starting at or before `position`.
+  std::optional<size_t> find( const Pol::Bscript::Compiler::Position& position ) const;
+
+  // The first token on the line of `position` whose text touches its column,
+  // ie. the token being typed at a cursor placed at `position`.
+  std::optional<size_t> find_at_cursor( const Pol::Bscript::Compiler::Position& position ) const;
+
+  // The name of the class or user function containing the token at `index`,
+  // or an empty string.
+  const std::string& enclosing_class( size_t index ) const;
+  const std::string& enclosing_function( size_t index ) const;
+  bool in_enum( size_t index ) const;
+
+  // Estimated heap bytes of the index, without the tokens it points to.
+  size_t memory_usage() const;
+
+private:
+  struct Span
+  {
+    size_t begin;
+    // One past the last token, or the end of the file if never closed.
+    size_t end;
+    std::string name;
+  };
+
+  static const Span* find_span( const std::vector<Span>& spans, size_t index );
+  void build_spans();
+
+  std::vector<antlr4::Token*> _tokens;
+  // Index of the first token starting on each (one-based) line, plus one
+  // past the end, so the tokens of line `l` are `[line_starts[l], line_starts[l + 1])`.
+  std::vector<size_t> line_starts;
+  std::vector<Span> classes;
+  std::vector<Span> functions;
+  std::vector<Span> enums;
+};
+}  // namespace VSCodeEscript::CompilerExt
@@ -0,0 +1,63 @@
+#include "TrackedSourceFileCache.h"
+
+#include "../misc/Hash.h"
+
+#include <filesystem>
+
+namespace VSCodeEscript::CompilerExt
+{
+TrackedSourceFileCache::TrackedSourceFileCache(
+    const Pol::Bscript::Compiler::SourceFileLoader& loader )
+    : SourceFileLoader(), profile(), cache( *this, profile ), loader( loader )
+{
+}
+
+std::string TrackedSourceFileCache::get_contents( const std::string& pathname ) const
+{
+  {
+    std::lock_guard<std::mutex> guard( mutex );
+    loaded.emplace( normalize( pathname ), LoadedText{} );
+  }
+  auto contents = loader.get_contents( pathname );
+  auto hash = fnv1a_64( contents );
+  {
+    std::lock_guard<std::mutex> guard( mutex );
+    loaded[normalize( pathname )] = LoadedText{ contents.size(), hash };
+  }
+  return contents;
+}
+
+bool TrackedSourceFileCache::has_loaded( const std::string& pathname ) const
+{
+  auto normalized = normalize( pathname );
+  std::lock_guard<std::mutex> guard( mutex );
+  return loaded.count( normalized ) > 0;
+}
+
+std::vector<TrackedSourceFileCache::LoadedFile> TrackedSourceFileCache::loaded_files() const
+{
+  std::lock_guard<std::mutex> guard( mutex );
+  std::vector<LoadedFile> files;
+  files.reserve( loaded.size() );
+  for ( const auto& [pathname, text] : loaded )
+  {
+    files.push_back( LoadedFile{ pathname, text.characters } );
+  }
+  return files;
+}
+
+std::optional<uint64_t> TrackedSourceFileCache::contents_hash( const std::string& pathname ) const
+{
+  auto normalized = normalize( pathname );
+  std::lock_guard<std::mutex> guard( mutex );
+  auto itr = loaded.find( normalized );
+  if ( itr == loaded.end() )
+    return {};
+  return itr->second.hash;
+}
+
+std::string TrackedSourceFileCache::normalize( const std::string& pathname )
+{
+  return std::filesystem::path( pathname ).lexically_normal().string();
+}
+}  // namespace VSCodeEscript::CompilerExt
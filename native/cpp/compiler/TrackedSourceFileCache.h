@@ -0,0 +1,66 @@
+#pragma once
+
+#include "../misc/PathTable.h"
+#include "bscript/compiler/Profile.h"
+#include "bscript/compiler/file/SourceFileCache.h"
+#include "bscript/compiler/file/SourceFileLoader.h"
+
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace VSCodeEscript::CompilerExt
+{
+// A parse tree cache that remembers which files it loaded. `SourceFileCache`
+// cannot evict single entries, so a cache holding a changed file has to be
+// replaced as a whole; this tells which one (if any) that is. Each cache has
+// its own profile, counting its hits, misses and parse times.
+//
+// The cached `SourceFile`s cannot be listed, and loading them to look at
+// them would count as hits and parse files that failed before, so the
+// length and hash of the text read for each file are recorded instead.
+//
+// The compiler spells pathnames as it builds them from the include and
+// module directories, which may differ from how callers spell the same file.
+// Pathnames are therefore looked up lexically normalized, and compared like
+// `PathTable` does.
+class TrackedSourceFileCache : public Pol::Bscript::Compiler::SourceFileLoader
+{
+public:
+  explicit TrackedSourceFileCache( const Pol::Bscript::Compiler::SourceFileLoader& loader );
+
+  std::string get_contents( const std::string& pathname ) const override;
+
+  struct LoadedFile
+  {
+    std::string pathname;
+    // Of the text last read for the file.
+    size_t characters;
+  };
+
+  bool has_loaded( const std::string& pathname ) const;
+  std::vector<LoadedFile> loaded_files() const;
+  // The `fnv1a_64` hash of the text read for `pathname`, if it was read.
+  std::optional<uint64_t> contents_hash( const std::string& pathname ) const;
+
+  // Declared before `cache`, which records into it.
+  Pol::Bscript::Compiler::Profile profile;
+  Pol::Bscript::Compiler::SourceFileCache cache;
+
+private:
+  const Pol::Bscript::Compiler::SourceFileLoader& loader;
+  mutable std::mutex mutex;
+  struct LoadedText
+  {
+    size_t characters = 0;
+    // Unset while the text is being read.
+    std::optional<uint64_t> hash;
+  };
+  static std::string normalize( const std::string& pathname );
+
+  mutable std::unordered_map<std::string, LoadedText, PathnameHash, PathnameEqual> loaded;
+};
+}  // namespace VSCodeEscript::CompilerExt
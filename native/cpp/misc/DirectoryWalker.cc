@@ -0,0 +1,154 @@
+#include "DirectoryWalker.h"
+
+#include "Parallel.h"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace VSCodeEscript::CompilerExt
+{
+namespace
+{
+bool is_hidden( const fs::path& path )
+{
+  auto filename = path.filename().string();
+  return !filename.empty() && filename.front() == '.';
+}
+}  // namespace
+
+DirectoryWalker::DirectoryWalker( unsigned concurrency ) : concurrency( concurrency ) {}
+
+std::optional<fs::path> DirectoryWalker::canonical_directory( const fs::path& path )
+{
+  auto key = path.string();
+  {
+    std::lock_guard<std::mutex> guard( mutex );
+    auto existing = canonical_directories.find( key );
+    if ( existing != canonical_directories.end() )
+      return existing->second;
+  }
+
+  std::optional<fs::path> result;
+  std::error_code ec;
+  if ( fs::is_directory( path, ec ) )
+  {
+    auto canonical = fs::canonical( path, ec );
+    if ( !ec )
+      result = std::move( canonical );
+  }
+
+  std::lock_guard<std::mutex> guard( mutex );
+  canonical_directories.emplace( std::move( key ), result );
+  return result;
+}
+
+void DirectoryWalker::clear()
+{
+  std::lock_guard<std::mutex> guard( mutex );
+  canonical_directories.clear();
+}
+
+void DirectoryWalker::walk( const std::vector<fs::path>& roots,
+                            const std::function<void( const fs::path& )>& visit )
+{
+  std::mutex queue_mutex;
+  std::condition_variable queue_changed;
+  std::deque<fs::path> pending;
+  // Workers currently listing a directory, which may add more to `pending`.
+  unsigned busy = 0;
+  bool stopped = false;
+  std::exception_ptr first_exception;
+
+  for ( const auto& root : roots )
+  {
+    if ( auto canonical = canonical_directory( root ) )
+      pending.push_back( std::move( *canonical ) );
+  }
+
+  auto list_directory = [&]( const fs::path& directory, std::vector<fs::path>& subdirectories )
+  {
+    std::error_code ec;
+    for ( auto itr = fs::directory_iterator( directory, ec );
+          !ec && itr != fs::directory_iterator(); itr.increment( ec ) )
+    {
+      const auto& entry = *itr;
+      if ( is_hidden( entry.path() ) )
+        continue;
+
+      // The directory is canonical, so only symlinks can resolve elsewhere.
+      std::error_code entry_ec;
+      bool is_symlink = entry.is_symlink( entry_ec );
+      if ( !is_symlink && entry.is_directory( entry_ec ) )
+      {
+        subdirectories.push_back( entry.path() );
+        continue;
+      }
+      if ( !entry.is_regular_file( entry_ec ) )
+        continue;
+
+      auto pathname = is_symlink ? fs::canonical( entry.path(), entry_ec ) : entry.path();
+      if ( entry_ec )
+        continue;
+
+      visit( pathname );
+    }
+  };
+
+  auto run = [&]()
+  {
+    std::unique_lock<std::mutex> lock( queue_mutex );
+    while ( true )
+    {
+      queue_changed.wait( lock, [&] { return stopped || !pending.empty() || busy == 0; } );
+      if ( stopped || pending.empty() )
+        break;
+
+      auto directory = std::move( pending.front() );
+      pending.pop_front();
+      ++busy;
+      lock.unlock();
+
+      std::vector<fs::path> subdirectories;
+      try
+      {
+        list_directory( directory, subdirectories );
+      }
+      catch ( ... )
+      {
+        lock.lock();
+        if ( !first_exception )
+          first_exception = std::current_exception();
+        stopped = true;
+        --busy;
+        queue_changed.notify_all();
+        break;
+      }
+
+      lock.lock();
+      for ( auto& subdirectory : subdirectories )
+        pending.push_back( std::move( subdirectory ) );
+      --busy;
+      queue_changed.notify_all();
+    }
+  };
+
+  unsigned thread_count = concurrency ? concurrency : default_concurrency();
+  std::vector<std::thread> threads;
+  threads.reserve( thread_count - 1 );
+  for ( unsigned worker = 1; worker < thread_count; ++worker )
+    threads.emplace_back( run );
+
+  // The calling thread takes part as well.
+  run();
+
+  for ( auto& thread : threads )
+    thread.join();
+
+  if ( first_exception )
+    std::rethrow_exception( first_exception );
+}
+}  // namespace VSCodeEscript::CompilerExt
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace VSCodeEscript::CompilerExt
+{
+// Enumerates the files below several directory trees on a pool of threads.
+// Only the roots, and files that are symlinks, are canonicalized; every other
+// path is built from its canonical parent directory, saving a realpath per
+// file. Canonical roots are remembered until `clear()`. Hidden files and
+// directories (starting with a dot) are skipped, and symlinked directories
+// are not followed. Thread-safe.
+class DirectoryWalker
+{
+public:
+  explicit DirectoryWalker( unsigned concurrency = 0 );
+
+  // Calls `visit` with the canonical path of every regular file below `roots`
+  // as soon as it is found. Calls come concurrently from the worker threads,
+  // in no particular order. Roots that are not directories are ignored. The
+  // first exception thrown by `visit` stops the walk and is rethrown.
+  void walk( const std::vector<std::filesystem::path>& roots,
+             const std::function<void( const std::filesystem::path& )>& visit );
+
+  void clear();
+
+private:
+  std::optional<std::filesystem::path> canonical_directory( const std::filesystem::path& path );
+
+  unsigned concurrency;
+  std::mutex mutex;
+  std::unordered_map<std::string, std::optional<std::filesystem::path>> canonical_directories;
+};
+}  // namespace VSCodeEscript::CompilerExt
@@ -0,0 +1,104 @@
+#include "FileInventory.h"
+
+#include "DirectoryWalker.h"
+
+#include <algorithm>
+#include <mutex>
+#include <optional>
+
+namespace fs = std::filesystem;
+
+namespace VSCodeEscript::CompilerExt
+{
+namespace
+{
+std::optional<FileInventory::File> stat_file( const fs::path& path )
+{
+  std::error_code ec;
+  auto size = fs::file_size( path, ec );
+  if ( ec )
+    return {};
+  auto mtime = fs::last_write_time( path, ec );
+  if ( ec )
+    return {};
+
+  return FileInventory::File{ path.string(), static_cast<uint64_t>( size ),
+                              static_cast<int64_t>( mtime.time_since_epoch().count() ) };
+}
+
+void sort_by_pathname( std::vector<FileInventory::File>& files )
+{
+  std::sort( files.begin(), files.end(),
+             []( const auto& x1, const auto& x2 ) { return x1.pathname < x2.pathname; } );
+  // Symlinks may lead to the same file twice.
+  files.erase( std::unique( files.begin(), files.end(),
+                            []( const auto& x1, const auto& x2 )
+                            { return x1.pathname == x2.pathname; } ),
+               files.end() );
+}
+}  // namespace
+
+FileInventory::FileInventory( DirectoryWalker& walker, const std::vector<fs::path>& script_roots,
+                              const fs::path& module_directory, bool compile_asp_pages,
+                              const Visitor& found )
+{
+  std::mutex mutex;
+
+  walker.walk( script_roots,
+               [&]( const fs::path& path )
+               {
+                 const auto ext = path.extension();
+                 bool is_inc = !ext.compare( ".inc" );
+                 if ( !is_inc && ext.compare( ".src" ) && ext.compare( ".hsr" ) &&
+                      ( !compile_asp_pages || ext.compare( ".asp" ) ) )
+                   return;
+
+                 // Stat outside the lock; the walker calls this from all its threads.
+                 auto file = stat_file( path );
+                 if ( !file )
+                   return;
+                 if ( found )
+                   found( is_inc ? Kind::INC : Kind::SRC, *file );
+
+                 std::lock_guard<std::mutex> guard( mutex );
+                 ( is_inc ? _inc : _src ).push_back( std::move( *file ) );
+               } );
+
+  walker.walk( { module_directory },
+               [&]( const fs::path& path )
+               {
+                 if ( path.extension().compare( ".em" ) )
+                   return;
+
+                 auto file = stat_file( path );
+                 if ( !file )
+                   return;
+                 if ( found )
+                   found( Kind::EM, *file );
+
+                 std::lock_guard<std::mutex> guard( mutex );
+                 _em.push_back( std::move( *file ) );
+               } );
+
+  sort_by_pathname( _src );
+  sort_by_pathname( _inc );
+  sort_by_pathname( _em );
+}
+
+std::vector<std::string> FileInventory::auto_compiled_scripts() const
+{
+  std::vector<std::string> result;
+  result.reserve( _src.size() + _inc.size() );
+
+  auto src = _src.begin();
+  auto inc = _inc.begin();
+  while ( src != _src.end() || inc != _inc.end() )
+  {
+    if ( inc == _inc.end() || ( src != _src.end() && src->pathname < inc->pathname ) )
+      result.push_back( ( src++ )->pathname );
+    else
+      result.push_back( ( inc++ )->pathname );
+  }
+  return result;
+}
+}  // namespace VSCodeEscript::CompilerExt
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace VSCodeEscript::CompilerExt
+{
+class DirectoryWalker;
+
+// The scripts, includes and modules of a workspace with their sizes and
+// modification times, as found by one walk of its directories. Each list is
+// sorted by pathname.
+class FileInventory
+{
+public:
+  struct File
+  {
+    std::string pathname;
+    uint64_t size;
+    // `file_time_type` ticks, as in `FileStamp`.
+    int64_t mtime;
+  };
+
+  enum class Kind
+  {
+    SRC,
+    INC,
+    EM
+  };
+
+  // Called with every file as soon as the walk finds it, concurrently from the
+  // walker's threads. An exception thrown from it stops the walk.
+  using Visitor = std::function<void( Kind kind, const File& file )>;
+
+  // Collects .src, .hsr (and .asp if `compile_asp_pages`) and .inc files below
+  // `script_roots`, and .em files below `module_directory`.
+  FileInventory( DirectoryWalker& walker, const std::vector<std::filesystem::path>& script_roots,
+                 const std::filesystem::path& module_directory, bool compile_asp_pages,
+                 const Visitor& found = {} );
+
+  const std::vector<File>& src() const { return _src; }
+  const std::vector<File>& inc() const { return _inc; }
+  const std::vector<File>& em() const { return _em; }
+
+  // The pathnames of all sources and includes, sorted.
+  std::vector<std::string> auto_compiled_scripts() const;
+
+private:
+  std::vector<File> _src;
+  std::vector<File> _inc;
+  std::vector<File> _em;
+};
+}  // namespace VSCodeEscript::CompilerExt
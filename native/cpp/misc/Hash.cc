@@ -0,0 +1,16 @@
+#include "Hash.h"
+
+namespace VSCodeEscript::CompilerExt
+{
+uint64_t fnv1a_64( std::string_view data, uint64_t hash )
+{
+  constexpr uint64_t prime = 0x100000001b3ULL;
+
+  for ( unsigned char c : data )
+  {
+    hash ^= c;
+    hash *= prime;
+  }
+  return hash;
+}
+}  // namespace VSCodeEscript::CompilerExt
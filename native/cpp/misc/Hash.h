@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace VSCodeEscript::CompilerExt
+{
+constexpr uint64_t FNV1A_64_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+
+// 64-bit FNV-1a. Not cryptographic; used to detect changed file contents and
+// settings. Pass a previous result as `hash` to hash several values in sequence.
+uint64_t fnv1a_64( std::string_view data, uint64_t hash = FNV1A_64_OFFSET_BASIS );
+}  // namespace VSCodeEscript::CompilerExt
@@ -0,0 +1,83 @@
+#include "LruBudget.h"
+
+namespace VSCodeEscript::CompilerExt
+{
+void LruBudget::set_limits( size_t new_max_count, size_t new_max_bytes )
+{
+  max_count = new_max_count;
+  max_bytes = new_max_bytes;
+}
+
+void LruBudget::touch( PathId id, std::optional<size_t> bytes )
+{
+  auto existing = entries_by_id.find( id );
+  if ( existing == entries_by_id.end() )
+  {
+    entries.push_front( Entry{ id, bytes.value_or( 0 ) } );
+    entries_by_id.emplace( id, entries.begin() );
+    return;
+  }
+
+  entries.splice( entries.begin(), entries, existing->second );
+  if ( bytes )
+  {
+    existing->second->bytes = *bytes;
+  }
+}
+
+void LruBudget::erase( PathId id )
+{
+  auto existing = entries_by_id.find( id );
+  if ( existing != entries_by_id.end() )
+  {
+    entries.erase( existing->second );
+    entries_by_id.erase( existing );
+  }
+}
+
+void LruBudget::clear()
+{
+  entries.clear();
+  entries_by_id.clear();
+}
+
+std::vector<PathId> LruBudget::evict( const std::function<bool( PathId )>& pinned )
+{
+  std::vector<PathId> evicted;
+  if ( !limited() )
+  {
+    return evicted;
+  }
+
+  size_t count = 0;
+  size_t bytes = 0;
+  bool over_budget = false;
+  for ( auto itr = entries.begin(); itr != entries.end(); )
+  {
+    if ( pinned( itr->id ) )
+    {
+      ++itr;
+      continue;
+    }
+
+    // Once a path does not fit, all less recently used ones go too.
+    if ( !over_budget && count > 0 )
+    {
+      over_budget = ( max_count > 0 && count + 1 > max_count ) ||
+                    ( max_bytes > 0 && bytes + itr->bytes > max_bytes );
+    }
+    if ( over_budget )
+    {
+      evicted.push_back( itr->id );
+      entries_by_id.erase( itr->id );
+      itr = entries.erase( itr );
+      continue;
+    }
+
+    ++count;
+    bytes += itr->bytes;
+    ++itr;
+  }
+  return evicted;
+}
+}  // namespace VSCodeEscript::CompilerExt
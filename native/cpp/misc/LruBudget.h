@@ -0,0 +1,50 @@
+#pragma once
+
+#include "PathTable.h"
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace VSCodeEscript::CompilerExt
+{
+// Paths ordered by last use, each with a size in bytes, telling which of the
+// least recently used ones to drop once there are more than a maximum count
+// or total size of them. Not thread-safe.
+class LruBudget
+{
+public:
+  // Zero means no limit.
+  void set_limits( size_t max_count, size_t max_bytes );
+  bool limited() const { return max_count > 0 || max_bytes > 0; }
+  bool byte_limited() const { return max_bytes > 0; }
+
+  // Marks `id` as most recently used, adding it if needed, and replaces its
+  // size if `bytes` is given.
+  void touch( PathId id, std::optional<size_t> bytes = {} );
+  void erase( PathId id );
+  void clear();
+
+  // Removes and returns the least recently used paths that do not fit the
+  // limits. Paths `pinned` returns true for are kept, and do not count towards
+  // the limits. The most recently used path that is not pinned is always kept,
+  // however large it is.
+  std::vector<PathId> evict( const std::function<bool( PathId )>& pinned );
+
+private:
+  struct Entry
+  {
+    PathId id;
+    size_t bytes;
+  };
+
+  size_t max_count = 0;
+  size_t max_bytes = 0;
+  // Most recently used first.
+  std::list<Entry> entries;
+  std::unordered_map<PathId, std::list<Entry>::iterator> entries_by_id;
+};
+}  // namespace VSCodeEscript::CompilerExt
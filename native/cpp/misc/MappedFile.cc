@@ -0,0 +1,133 @@
+#include "MappedFile.h"
+
+#include <filesystem>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace VSCodeEscript::CompilerExt
+{
+MappedFile::~MappedFile()
+{
+  close();
+}
+
+#ifdef _WIN32
+bool MappedFile::open( const std::string& pathname )
+{
+  close();
+
+  auto wide_pathname = std::filesystem::path( pathname ).wstring();
+  HANDLE file = CreateFileW( wide_pathname.c_str(), GENERIC_READ,
+                             FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                             OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+  if ( file == INVALID_HANDLE_VALUE )
+    return false;
+
+  LARGE_INTEGER file_size;
+  if ( !GetFileSizeEx( file, &file_size ) )
+  {
+    CloseHandle( file );
+    return false;
+  }
+
+  _file = file;
+  _open = true;
+  _size = static_cast<size_t>( file_size.QuadPart );
+
+  // Zero-length files cannot be mapped, but are valid (empty) contents.
+  if ( _size == 0 )
+    return true;
+
+  HANDLE mapping = CreateFileMappingW( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+  if ( mapping == nullptr )
+  {
+    close();
+    return false;
+  }
+  _mapping = mapping;
+
+  _data = static_cast<const char*>( MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ) );
+  if ( _data == nullptr )
+  {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void MappedFile::close()
+{
+  if ( _data != nullptr )
+    UnmapViewOfFile( _data );
+  if ( _mapping != nullptr )
+    CloseHandle( static_cast<HANDLE>( _mapping ) );
+  if ( _file != nullptr )
+    CloseHandle( static_cast<HANDLE>( _file ) );
+
+  _data = nullptr;
+  _mapping = nullptr;
+  _file = nullptr;
+  _size = 0;
+  _open = false;
+}
+#else
+bool MappedFile::open( const std::string& pathname )
+{
+  close();
+
+  int fd = ::open( pathname.c_str(), O_RDONLY );
+  if ( fd == -1 )
+    return false;
+
+  struct stat st;
+  if ( fstat( fd, &st ) != 0 )
+  {
+    ::close( fd );
+    return false;
+  }
+
+  _size = static_cast<size_t>( st.st_size );
+
+  // Zero-length files cannot be mapped, but are valid (empty) contents.
+  if ( _size > 0 )
+  {
+    void* data = mmap( nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    if ( data == MAP_FAILED )
+    {
+      ::close( fd );
+      _size = 0;
+      return false;
+    }
+    _data = static_cast<const char*>( data );
+  }
+
+  // The mapping stays valid after the descriptor is closed.
+  ::close( fd );
+  _open = true;
+  return true;
+}
+
+void MappedFile::close()
+{
+  if ( _data != nullptr )
+    munmap( const_cast<char*>( _data ), _size );
+
+  _data = nullptr;
+  _size = 0;
+  _open = false;
+}
+#endif
+}  // namespace VSCodeEscript::CompilerExt
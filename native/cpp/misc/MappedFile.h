@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace VSCodeEscript::CompilerExt
+{
+// A read-only memory mapping of a whole file.
+class MappedFile
+{
+public:
+  MappedFile() = default;
+  ~MappedFile();
+
+  MappedFile( const MappedFile& ) = delete;
+  MappedFile& operator=( const MappedFile& ) = delete;
+
+  // Maps `pathname`, closing any previous mapping. Returns false if the file
+  // could not be opened or mapped.
+  bool open( const std::string& pathname );
+  void close();
+
+  bool is_open() const { return _open; }
+  const char* data() const { return _data; }
+  size_t size() const { return _size; }
+  std::string_view view() const { return { _data, _size }; }
+
+private:
+  bool _open = false;
+  const char* _data = nullptr;
+  size_t _size = 0;
+#ifdef _WIN32
+  void* _file = nullptr;
+  void* _mapping = nullptr;
+#endif
+};
+}  // namespace VSCodeEscript::CompilerExt
@@ -0,0 +1,66 @@
+#include "Parallel.h"
+
+#include <algorithm>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace VSCodeEscript::CompilerExt
+{
+unsigned default_concurrency()
+{
+  return std::max( 1u, std::thread::hardware_concurrency() );
+}
+
+void parallel_for( size_t count, unsigned concurrency,
+                   const std::function<void( size_t index, unsigned worker )>& task,
+                   const std::atomic<bool>* canceled )
+{
+  if ( count == 0 )
+    return;
+
+  concurrency = static_cast<unsigned>(
+      std::clamp<size_t>( concurrency == 0 ? default_concurrency() : concurrency, 1, count ) );
+
+  std::atomic<size_t> next = 0;
+  std::exception_ptr first_exception;
+  std::mutex exception_mutex;
+
+  auto run = [&]( unsigned worker )
+  {
+    for ( size_t index = next++; index < count; index = next++ )
+    {
+      if ( canceled && canceled->load() )
+        break;
+
+      try
+      {
+        task( index, worker );
+      }
+      catch ( ... )
+      {
+        std::lock_guard<std::mutex> guard( exception_mutex );
+        if ( !first_exception )
+          first_exception = std::current_exception();
+        // Drain the remaining indices so the other workers stop early.
+        next = count;
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve( concurrency - 1 );
+  for ( unsigned worker = 1; worker < concurrency; ++worker )
+    threads.emplace_back( run, worker );
+
+  // The calling thread takes part as worker 0.
+  run( 0 );
+
+  for ( auto& thread : threads )
+    thread.join();
+
+  if ( first_exception )
+    std::rethrow_exception( first_exception );
+}
+}  // namespace VSCodeEscript::CompilerExt
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+
+namespace VSCodeEscript::CompilerExt
+{
+// Number of worker threads to use when the caller does not ask for a specific amount.
+unsigned default_concurrency();
+
+// Runs `task( index, worker )` for every index in `[0, count)` on up to
+// `concurrency` threads, where `worker` is in `[0, concurrency)` and can be
+// used to address per-thread state. Idle workers take the next unprocessed
+// index from a shared counter, so a few slow items do not stall the rest.
+// Stops handing out indices once `canceled` is set. The first exception thrown
+// by a task is rethrown after all workers have finished.
+void parallel_for( size_t count, unsigned concurrency,
+                   const std::function<void( size_t index, unsigned worker )>& task,
+                   const std::atomic<bool>* canceled = nullptr );
+}  // namespace VSCodeEscript::CompilerExt
@@ -0,0 +1,107 @@
+#include "PathTable.h"
+
+#include "../compiler/MemoryUsage.h"
+#include "Hash.h"
+
+#include <mutex>
+
+namespace VSCodeEscript::CompilerExt
+{
+namespace
+{
+#ifdef _WIN32
+char fold( char c )
+{
+  return ( c >= 'A' && c <= 'Z' ) ? static_cast<char>( c - 'A' + 'a' ) : c;
+}
+#else
+char fold( char c )
+{
+  return c;
+}
+#endif
+}  // namespace
+
+size_t PathnameHash::operator()( std::string_view pathname ) const
+{
+#ifdef _WIN32
+  std::string folded( pathname );
+  for ( auto& c : folded )
+    c = fold( c );
+  return static_cast<size_t>( fnv1a_64( folded ) );
+#else
+  return static_cast<size_t>( fnv1a_64( pathname ) );
+#endif
+}
+
+bool PathnameEqual::operator()( std::string_view x1, std::string_view x2 ) const
+{
+  if ( x1.size() != x2.size() )
+  {
+    return false;
+  }
+  for ( size_t i = 0; i < x1.size(); ++i )
+  {
+    if ( fold( x1[i] ) != fold( x2[i] ) )
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+PathId PathTable::intern( std::string_view pathname )
+{
+  if ( auto id = find( pathname ) )
+  {
+    return *id;
+  }
+
+  std::unique_lock<std::shared_mutex> guard( mutex );
+  auto itr = ids.find( pathname );
+  if ( itr != ids.end() )
+  {
+    return itr->second;
+  }
+  auto id = static_cast<PathId>( pathnames.size() );
+  const auto& stored = pathnames.emplace_back( pathname );
+  ids.emplace( stored, id );
+  return id;
+}
+
+std::optional<PathId> PathTable::find( std::string_view pathname ) const
+{
+  std::shared_lock<std::shared_mutex> guard( mutex );
+  auto itr = ids.find( pathname );
+  if ( itr != ids.end() )
+  {
+    return itr->second;
+  }
+  return {};
+}
+
+const std::string& PathTable::pathname( PathId id ) const
+{
+  // Elements of a deque do not move when others are added, so the reference
+  // outlives the lock.
+  std::shared_lock<std::shared_mutex> guard( mutex );
+  return pathnames.at( id );
+}
+
+size_t PathTable::size() const
+{
+  std::shared_lock<std::shared_mutex> guard( mutex );
+  return pathnames.size();
+}
+
+size_t PathTable::memory_usage() const
+{
+  std::shared_lock<std::shared_mutex> guard( mutex );
+  size_t bytes = pathnames.size() * sizeof( std::string ) + hash_table_memory_usage( ids );
+  for ( const auto& pathname : pathnames )
+  {
+    bytes += string_memory_usage( pathname );
+  }
+  return bytes;
+}
+}  // namespace VSCodeEscript::CompilerExt
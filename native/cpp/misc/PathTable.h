@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace VSCodeEscript::CompilerExt
+{
+using PathId = uint32_t;
+
+// Hashes and compares pathnames the way `PathTable` does: case-insensitively
+// on Windows, exactly elsewhere. For containers keyed by pathname strings.
+struct PathnameHash
+{
+  size_t operator()( std::string_view pathname ) const;
+};
+
+struct PathnameEqual
+{
+  bool operator()( std::string_view x1, std::string_view x2 ) const;
+};
+
+// Interns pathnames as 32-bit ids, so containers keyed by path hold and
+// compare integers instead of copies of the same strings. Ids stay valid for
+// the lifetime of the table. Pathnames are compared case-insensitively on
+// Windows, where the first spelling seen is kept. Thread-safe.
+class PathTable
+{
+public:
+  PathTable() = default;
+  PathTable( const PathTable& ) = delete;
+  PathTable& operator=( const PathTable& ) = delete;
+
+  PathId intern( std::string_view pathname );
+  std::optional<PathId> find( std::string_view pathname ) const;
+  const std::string& pathname( PathId id ) const;
+  size_t size() const;
+
+  // Estimated heap bytes of the interned pathnames and their lookup table.
+  size_t memory_usage() const;
+
+private:
+  mutable std::shared_mutex mutex;
+  // A deque, so the views in `ids` stay valid as pathnames are added.
+  std::deque<std::string> pathnames;
+  std::unordered_map<std::string_view, PathId, PathnameHash, PathnameEqual> ids;
+};
+}  // namespace VSCodeEscript::CompilerExt
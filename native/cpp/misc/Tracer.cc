@@ -0,0 +1,177 @@
+#include "Tracer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace VSCodeEscript::CompilerExt
+{
+namespace
+{
+int64_t steady_micros()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch() )
+      .count();
+}
+
+// Small, stable numbers for threads, in the order they first record a span.
+uint32_t current_thread()
+{
+  static std::atomic<uint32_t> next_thread{ 1 };
+  thread_local uint32_t thread = next_thread.fetch_add( 1, std::memory_order_relaxed );
+  return thread;
+}
+
+void write_json_string( std::ostream& out, std::string_view value )
+{
+  static const char* hex = "0123456789abcdef";
+  out << '"';
+  for ( char c : value )
+  {
+    switch ( c )
+    {
+    case '"':
+      out << "\\\"";
+      break;
+    case '\\':
+      out << "\\\\";
+      break;
+    default:
+      if ( static_cast<unsigned char>( c ) < 0x20 )
+        out << "\\u00" << hex[( c >> 4 ) & 0xf] << hex[c & 0xf];
+      else
+        out << c;
+    }
+  }
+  out << '"';
+}
+}  // namespace
+
+Tracer::Tracer() : epoch( steady_micros() ) {}
+
+Tracer& Tracer::instance()
+{
+  static Tracer tracer;
+  return tracer;
+}
+
+void Tracer::start( size_t new_capacity )
+{
+  if ( !slots )
+  {
+    capacity = std::max<size_t>( new_capacity, 1 );
+    slots = std::make_unique<Slot[]>( capacity );
+  }
+  first = next.load( std::memory_order_relaxed );
+  _enabled.store( true, std::memory_order_release );
+}
+
+void Tracer::stop()
+{
+  _enabled.store( false, std::memory_order_release );
+}
+
+int64_t Tracer::now_micros() const
+{
+  return steady_micros() - epoch;
+}
+
+void Tracer::record( const char* name, std::string_view path, int64_t begin_micros,
+                     int64_t end_micros )
+{
+  if ( !enabled() )
+    return;
+
+  auto index = next.fetch_add( 1, std::memory_order_relaxed );
+  auto& slot = slots[index % capacity];
+  // Once the buffer wrapped around, a span a full buffer ahead may still be
+  // writing this slot; drop this one rather than wait.
+  auto sequence = slot.sequence.load( std::memory_order_relaxed );
+  if ( ( sequence & 1 ) != 0 ||
+       !slot.sequence.compare_exchange_strong( sequence, 2 * index + 1,
+                                               std::memory_order_acquire ) )
+    return;
+  std::atomic_thread_fence( std::memory_order_release );
+
+  if ( path.size() > sizeof( slot.path ) )
+    path = path.substr( path.size() - sizeof( slot.path ) );
+  slot.name = name;
+  slot.begin_micros = begin_micros;
+  slot.end_micros = end_micros;
+  slot.thread = current_thread();
+  slot.path_length = static_cast<uint32_t>( path.size() );
+  std::memcpy( slot.path, path.data(), path.size() );
+
+  slot.sequence.store( 2 * index + 2, std::memory_order_release );
+}
+
+size_t Tracer::write_json( const std::string& filename ) const
+{
+  std::ofstream out( filename, std::ios::binary | std::ios::trunc );
+  if ( !out )
+    throw std::runtime_error( "Could not open " + filename );
+
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  size_t written = 0;
+  if ( slots )
+  {
+    auto end = next.load( std::memory_order_acquire );
+    auto begin = std::max( first, end > capacity ? end - capacity : 0 );
+    for ( auto index = begin; index < end; ++index )
+    {
+      const auto& slot = slots[index % capacity];
+      if ( slot.sequence.load( std::memory_order_acquire ) != 2 * index + 2 )
+        continue;
+
+      // Copy the slot, then check it was not overwritten while copying.
+      auto name = slot.name;
+      auto begin_micros = slot.begin_micros;
+      auto end_micros = slot.end_micros;
+      auto thread = slot.thread;
+      std::string path( slot.path, std::min<size_t>( slot.path_length, sizeof( slot.path ) ) );
+      std::atomic_thread_fence( std::memory_order_acquire );
+      if ( slot.sequence.load( std::memory_order_relaxed ) != 2 * index + 2 )
+        continue;
+
+      out << ( written++ ? ",\n" : "\n" ) << "{\"name\":";
+      write_json_string( out, name );
+      out << ",\"cat\":\"escript\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread
+          << ",\"ts\":" << begin_micros << ",\"dur\":" << end_micros - begin_micros;
+      if ( !path.empty() )
+      {
+        out << ",\"args\":{\"path\":";
+        write_json_string( out, path );
+        out << "}";
+      }
+      out << "}";
+    }
+  }
+  out << "\n]}\n";
+
+  if ( !out )
+    throw std::runtime_error( "Could not write " + filename );
+  return written;
+}
+
+TraceSpan::TraceSpan( const char* name, std::string_view path ) : name( name )
+{
+  auto& tracer = Tracer::instance();
+  if ( tracer.enabled() )
+  {
+    this->path = path;
+    begin_micros = tracer.now_micros();
+  }
+}
+
+TraceSpan::~TraceSpan()
+{
+  if ( begin_micros >= 0 )
+  {
+    auto& tracer = Tracer::instance();
+    tracer.record( name, path, begin_micros, tracer.now_micros() );
+  }
+}
+}  // namespace VSCodeEscript::CompilerExt
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace VSCodeEscript::CompilerExt
+{
+// Records spans of native operations into a fixed-size ring buffer while
+// enabled, and writes them as Chrome trace events, which chrome://tracing and
+// Perfetto can open. Recording is lock-free: a span claims a slot from an
+// atomic counter and publishes it through the slot's sequence number, so
+// writing the trace while spans are recorded skips the slots being written.
+// Once the buffer is full, the oldest spans are overwritten.
+class Tracer
+{
+public:
+  static constexpr size_t default_capacity = 1 << 16;
+
+  static Tracer& instance();
+
+  // Starts recording. The buffer is allocated by the first call, so later
+  // calls keep its capacity. Spans recorded before are not written.
+  void start( size_t capacity = default_capacity );
+  void stop();
+
+  bool enabled() const { return _enabled.load( std::memory_order_acquire ); }
+
+  // Writes the spans recorded since `start()` to `filename` in the Chrome
+  // trace event format, and returns their number. Throws if the file cannot
+  // be written.
+  size_t write_json( const std::string& filename ) const;
+
+  void record( const char* name, std::string_view path, int64_t begin_micros,
+               int64_t end_micros );
+
+  // Microseconds since the tracer was created.
+  int64_t now_micros() const;
+
+private:
+  Tracer();
+
+  struct Slot
+  {
+    // 2 * index + 1 while being written, 2 * index + 2 once written.
+    std::atomic<uint64_t> sequence{ 0 };
+    const char* name = nullptr;
+    int64_t begin_micros = 0;
+    int64_t end_micros = 0;
+    uint32_t thread = 0;
+    uint32_t path_length = 0;
+    // The end of longer paths is kept, as it tells files apart.
+    char path[160];
+  };
+
+  std::atomic<bool> _enabled{ false };
+  std::unique_ptr<Slot[]> slots;
+  size_t capacity = 0;
+  std::atomic<uint64_t> next{ 0 };
+  uint64_t first = 0;
+  const int64_t epoch;
+};
+
+// Records a span from construction to destruction, if tracing is enabled
+// when constructed.
+class TraceSpan
+{
+public:
+  explicit TraceSpan( const char* name, std::string_view path = {} );
+  ~TraceSpan();
+
+  TraceSpan( const TraceSpan& ) = delete;
+  TraceSpan& operator=( const TraceSpan& ) = delete;
+
+private:
+  const char* name;
+  std::string path;
+  int64_t begin_micros = -1;
+};
+
+// Returns `fn()`, recording a span around it.
+template <typename Fn>
+auto traced( const char* name, std::string_view path, Fn&& fn )
+{
+  TraceSpan span( name, path );
+  return fn();
+}
+}  // namespace VSCodeEscript::CompilerExt
@@ -0,0 +1,94 @@
+#include "XmlDocCache.h"
+
+#include "../compiler/MemoryUsage.h"
+
+namespace VSCodeEscript::CompilerExt
+{
+std::shared_ptr<const XmlDocCache::Functions> XmlDocCache::functions(
+    const std::string& filename )
+{
+  std::error_code ec;
+  auto mtime = std::filesystem::last_write_time( filename, ec );
+
+  {
+    std::lock_guard<std::mutex> lock( mutex );
+    if ( ec )
+    {
+      entries.erase( filename );
+      return {};
+    }
+    auto itr = entries.find( filename );
+    if ( itr != entries.end() && itr->second.mtime == mtime )
+      return itr->second.functions;
+  }
+
+  // Parse without holding the lock; a concurrent lookup of the same file may
+  // parse it too, and the last result is kept.
+  std::shared_ptr<const Functions> parsed_functions;
+  if ( auto parsed = XmlDocParser::parse_functions( filename ) )
+  {
+    parsed_functions = std::make_shared<const Functions>( std::move( *parsed ) );
+  }
+
+  std::lock_guard<std::mutex> lock( mutex );
+  entries[filename] = Entry{ mtime, parsed_functions };
+  return parsed_functions;
+}
+
+std::shared_ptr<const XmlDocParser> XmlDocCache::get( const std::string& filename,
+                                                      const std::string& function_name )
+{
+  auto parsed_functions = functions( filename );
+  if ( !parsed_functions )
+    return {};
+
+  auto itr = parsed_functions->find( function_name );
+  if ( itr == parsed_functions->end() )
+    return std::make_shared<const XmlDocParser>();
+
+  // Shares ownership of the parsed file, so the result stays valid if the
+  // entry is replaced.
+  return std::shared_ptr<const XmlDocParser>( parsed_functions, &itr->second );
+}
+
+void XmlDocCache::load( const std::string& filename )
+{
+  functions( filename );
+}
+
+void XmlDocCache::clear()
+{
+  std::lock_guard<std::mutex> lock( mutex );
+  entries.clear();
+}
+
+size_t XmlDocCache::memory_usage()
+{
+  std::lock_guard<std::mutex> lock( mutex );
+  size_t bytes = hash_table_memory_usage( entries );
+  for ( const auto& [filename, entry] : entries )
+  {
+    bytes += string_memory_usage( filename );
+    if ( !entry.functions )
+    {
+      continue;
+    }
+    bytes += sizeof( Functions ) + hash_table_memory_usage( *entry.functions );
+    for ( const auto& [name, doc] : *entry.functions )
+    {
+      bytes += string_memory_usage( name ) + string_memory_usage( doc.prototype ) +
+               string_memory_usage( doc.explain ) + string_memory_usage( doc.returns ) +
+               vector_memory_usage( doc.parameters ) + vector_memory_usage( doc.errors );
+      for ( const auto& parameter : doc.parameters )
+      {
+        bytes += string_memory_usage( parameter.name ) + string_memory_usage( parameter.value );
+      }
+      for ( const auto& error : doc.errors )
+      {
+        bytes += string_memory_usage( error );
+      }
+    }
+  }
+  return bytes;
+}
+}  // namespace VSCodeEscript::CompilerExt
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "XmlDocParser.h"
+
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace VSCodeEscript::CompilerExt
+{
+// Parsed module XML documentation, keyed by filename. Each file is parsed
+// once and reparsed only when its modification time changes, so looking up a
+// function's documentation is a hash lookup. Thread-safe.
+class XmlDocCache
+{
+public:
+  // The documentation of `function_name` in `filename`. Returns nullptr if the
+  // file cannot be loaded, and empty documentation if it has no such function.
+  std::shared_ptr<const XmlDocParser> get( const std::string& filename,
+                                           const std::string& function_name );
+
+  // Parses `filename` into the cache, if not cached yet.
+  void load( const std::string& filename );
+
+  void clear();
+
+  // Estimated heap bytes of the parsed documentation.
+  size_t memory_usage();
+
+private:
+  using Functions = std::unordered_map<std::string, XmlDocParser>;
+
+  // Null if the file cannot be loaded.
+  std::shared_ptr<const Functions> functions( const std::string& filename );
+
+  struct Entry
+  {
+    std::filesystem::file_time_type mtime;
+    // Null if the file could not be parsed.
+    std::shared_ptr<const Functions> functions;
+  };
+
+  std::mutex mutex;
+  std::unordered_map<std::string, Entry> entries;
+};
+}  // namespace VSCodeEscript::CompilerExt
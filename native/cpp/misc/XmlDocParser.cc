@@ -1,7 +1,6 @@
 #include "XmlDocParser.h"
 
 #include <clib/strutil.h>
-#include <memory>
 #include <tinyxml/tinyxml.h>
 
 namespace VSCodeEscript::CompilerExt
@@ -29,56 +28,57 @@ std::string get_node_string( TiXmlNode* node )
   return result;
 }
 
-std::unique_ptr<XmlDocParser> XmlDocParser::parse_function( const std::string& filename,
-                                                            const std::string& functionName )
+std::optional<std::unordered_map<std::string, XmlDocParser>> XmlDocParser::parse_functions(
+    const std::string& filename )
 {
   TiXmlDocument file;
   file.SetCondenseWhiteSpace( false );
   if ( !file.LoadFile( filename ) )
-    return {};
+    return std::nullopt;
 
 
   auto* node = file.FirstChild( "ESCRIPT" );
   if ( !node )
-    return {};
+    return std::nullopt;
 
-  auto parsed = std::make_unique<XmlDocParser>();
+  std::unordered_map<std::string, XmlDocParser> functions;
 
   for ( TiXmlElement* functionNode = node->FirstChildElement( "function" ); functionNode != nullptr;
         functionNode = functionNode->NextSiblingElement( "function" ) )
   {
     auto* functName = functionNode->Attribute( "name" );
+    if ( functName == nullptr )
+      continue;
 
-    if ( functName == functionName )
+    // Repeated declarations of a function add to the same documentation.
+    auto& parsed = functions[functName];
+    for ( auto* child = functionNode->FirstChildElement(); child != nullptr;
+          child = child->NextSiblingElement() )
     {
-      for ( auto* child = functionNode->FirstChildElement(); child != nullptr;
-            child = child->NextSiblingElement() )
+      if ( child->ValueStr() == "explain" )
       {
-        if ( child->ValueStr() == "explain" )
-        {
-          parsed->explain += get_node_string( child );
-        }
-        else if ( child->ValueStr() == "return" )
-        {
-          parsed->returns = get_node_string( child );
-        }
-        else if ( child->ValueStr() == "error" )
-        {
-          parsed->errors.push_back( get_node_string( child ) );
-        }
-        else if ( child->ValueStr() == "parameter" )
+        parsed.explain += get_node_string( child );
+      }
+      else if ( child->ValueStr() == "return" )
+      {
+        parsed.returns = get_node_string( child );
+      }
+      else if ( child->ValueStr() == "error" )
+      {
+        parsed.errors.push_back( get_node_string( child ) );
+      }
+      else if ( child->ValueStr() == "parameter" )
+      {
+        auto* paramName = child->Attribute( "name" );
+        auto* paramValue = child->Attribute( "value" );
+        if ( paramName != nullptr && paramValue != nullptr )
         {
-          auto* paramName = child->Attribute( "name" );
-          auto* paramValue = child->Attribute( "value" );
-          if ( paramValue != nullptr && paramValue != nullptr )
-          {
-            parsed->parameters.push_back( XmlDocFunctionParameter{ paramName, paramValue } );
-          }
+          parsed.parameters.push_back( XmlDocFunctionParameter{ paramName, paramValue } );
         }
       }
     }
   }
 
-  return parsed;
+  return functions;
 }
 }  // namespace VSCodeEscript::CompilerExt
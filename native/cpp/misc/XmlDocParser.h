@@ -1,7 +1,8 @@
 #pragma once
 
-#include <memory>
+#include <optional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace VSCodeEscript::CompilerExt
@@ -21,8 +22,9 @@ public:
   std::string returns;
   std::vector<std::string> errors;
 
-  // TODO cache?
-  static std::unique_ptr<XmlDocParser> parse_function( const std::string& filename,
-                                                       const std::string& functionName );
+  // Parses the documentation of every function in a module's XML file, keyed
+  // by function name. Returns nullopt if the file cannot be loaded.
+  static std::optional<std::unordered_map<std::string, XmlDocParser>> parse_functions(
+      const std::string& filename );
 };
 }  // namespace VSCodeEscript::CompilerExt
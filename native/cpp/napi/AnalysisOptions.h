@@ -0,0 +1,13 @@
+#pragma once
+
+namespace VSCodeEscript
+{
+// How to analyze a document. Built on the main thread, where the extension
+// configuration is read, and handed to the thread running the analysis.
+struct AnalysisOptions
+{
+  bool include_compile_mode = false;
+  bool is_module = false;
+  bool continue_on_error = true;
+};
+}  // namespace VSCodeEscript
@@ -0,0 +1,316 @@
+#include "AnalysisScheduler.h"
+
+#include "../misc/Tracer.h"
+#include "LSPDocument.h"
+#include "LSPWorkspace.h"
+
+#include "bscript/compiler/Compiler.h"
+#include "bscript/compiler/Report.h"
+#include "bscript/compiler/model/CompilerWorkspace.h"
+
+#include <algorithm>
+
+using namespace Pol::Bscript;
+
+namespace VSCodeEscript
+{
+AnalysisScheduler::AnalysisScheduler( LSPWorkspace& lsp_workspace )
+    : lsp_workspace( lsp_workspace ), debounce( 0 )
+{
+}
+
+AnalysisScheduler::~AnalysisScheduler()
+{
+  {
+    std::lock_guard<std::mutex> guard( mutex );
+    stopping = true;
+  }
+  condition.notify_all();
+
+  if ( thread.joinable() )
+  {
+    thread.join();
+  }
+  // Requests that never ran, or whose results were not delivered.
+  while ( !waiters.empty() )
+  {
+    try
+    {
+      reject( waiters.begin()->first, "Workspace was destroyed" );
+    }
+    catch ( ... )
+    {
+      // The environment may be shutting down.
+    }
+  }
+  if ( started )
+  {
+    completion_tsfn.Release();
+  }
+}
+
+void AnalysisScheduler::start_thread( Napi::Env env )
+{
+  // Results are delivered through the native callback; the JS function is
+  // never called.
+  completion_tsfn = Napi::ThreadSafeFunction::New(
+      env, Napi::Function::New( env, []( const Napi::CallbackInfo& ) {} ),
+      "LSPWorkspace::scheduleAnalysis", 0, 1 );
+
+  // Only keep the event loop alive while requests are outstanding.
+  completion_tsfn.Unref( env );
+
+  thread = std::thread( [this]() { run(); } );
+  started = true;
+}
+
+void AnalysisScheduler::set_debounce( std::chrono::milliseconds value )
+{
+  std::lock_guard<std::mutex> guard( mutex );
+  debounce = value;
+}
+
+AnalysisMetrics AnalysisScheduler::metrics() const
+{
+  std::lock_guard<std::mutex> guard( mutex );
+  return AnalysisMetrics{ pending.size(), running, scheduled_count, dropped_count,
+                          completed_count };
+}
+
+Napi::Promise AnalysisScheduler::schedule( Napi::Env env, LSPDocument* document,
+                                           AnalysisPriority priority, bool continue_on_error )
+{
+  if ( !started )
+  {
+    start_thread( env );
+  }
+
+  auto deferred = Napi::Promise::Deferred::New( env );
+
+  Request request{ 0,
+                   document->pathname(),
+                   LSPWorkspace::analysis_options( document->pathname(), continue_on_error ),
+                   document->begin_analysis(),
+                   document->latest_analysis(),
+                   priority,
+                   {} };
+
+  uint64_t id;
+  std::optional<uint64_t> dropped_id;
+  {
+    std::lock_guard<std::mutex> guard( mutex );
+    id = request.id = ++next_id;
+    request.due = std::chrono::steady_clock::now() + debounce;
+    ++scheduled_count;
+
+    auto existing = pending.find( request.pathname );
+    if ( existing != pending.end() )
+    {
+      // Coalesce with the earlier request, keeping the more urgent priority.
+      dropped_id = existing->second.id;
+      ++dropped_count;
+      if ( existing->second.priority == AnalysisPriority::Foreground )
+        request.priority = AnalysisPriority::Foreground;
+      existing->second = std::move( request );
+    }
+    else
+    {
+      pending.emplace( request.pathname, std::move( request ) );
+    }
+  }
+  condition.notify_all();
+
+  if ( waiters.empty() )
+  {
+    completion_tsfn.Ref( env );
+  }
+  waiters.emplace( id, Waiter{ Napi::Persistent( document->Value() ), deferred } );
+  lsp_workspace.acquire_contents_tsfn( env );
+
+  if ( dropped_id )
+  {
+    auto itr = waiters.find( *dropped_id );
+    if ( itr != waiters.end() )
+    {
+      itr->second.deferred.Resolve( Napi::Boolean::New( env, false ) );
+      waiters.erase( itr );
+      lsp_workspace.release_contents_tsfn();
+    }
+  }
+
+  return deferred.Promise();
+}
+
+void AnalysisScheduler::run()
+{
+  std::unique_lock<std::mutex> lock( mutex );
+  while ( !stopping )
+  {
+    if ( pending.empty() )
+    {
+      condition.wait( lock );
+      continue;
+    }
+
+    // Pick the due request with the highest priority, oldest first.
+    auto now = std::chrono::steady_clock::now();
+    auto next = pending.end();
+    auto earliest_due = std::chrono::steady_clock::time_point::max();
+    for ( auto itr = pending.begin(); itr != pending.end(); ++itr )
+    {
+      const auto& candidate = itr->second;
+      if ( candidate.due > now )
+      {
+        earliest_due = std::min( earliest_due, candidate.due );
+      }
+      else if ( next == pending.end() || candidate.priority < next->second.priority ||
+                ( candidate.priority == next->second.priority &&
+                  candidate.due < next->second.due ) )
+      {
+        next = itr;
+      }
+    }
+
+    if ( next == pending.end() )
+    {
+      condition.wait_until( lock, earliest_due );
+      continue;
+    }
+
+    auto request = std::move( next->second );
+    pending.erase( next );
+    running = true;
+    lock.unlock();
+
+    auto result = std::make_unique<Result>();
+    result->id = request.id;
+    result->generation = request.generation;
+
+    // Skip documents that were analyzed again since this was scheduled.
+    if ( request.latest_generation->load() == request.generation )
+    {
+      try
+      {
+        analyze( request, *result );
+      }
+      catch ( const std::exception& ex )
+      {
+        result->error = ex.what();
+      }
+      catch ( ... )
+      {
+        result->error = "Unknown Error";
+      }
+    }
+
+    auto* raw_result = result.release();
+    auto status = completion_tsfn.NonBlockingCall(
+        [this, raw_result]( Napi::Env env, Napi::Function )
+        {
+          std::unique_ptr<Result> result( raw_result );
+          // No environment when the function is finalized with calls pending.
+          if ( napi_env( env ) != nullptr )
+            complete( std::move( result ) );
+        } );
+    lock.lock();
+    if ( status != napi_ok )
+    {
+      undelivered.push_back( raw_result->id );
+      delete raw_result;
+    }
+    running = false;
+  }
+}
+
+void AnalysisScheduler::analyze( const Request& request, Result& result )
+{
+  CompilerExt::TraceSpan span( "AnalysisScheduler::analyze", request.pathname );
+  result.reporter = std::make_unique<Compiler::DiagnosticReporter>();
+  result.report = std::make_unique<Compiler::Report>( *result.reporter );
+
+  auto superseded = [&]() { return request.latest_generation->load() != request.generation; };
+  CompilerExt::AnalysisProfiler profiler;
+  auto analysis = lsp_workspace.run_analysis( request.pathname, request.options, lsp_workspace,
+                                              *result.report, profiler, result.references,
+                                              superseded );
+  result.compiler_workspace = std::move( analysis.compiler_workspace );
+}
+
+void AnalysisScheduler::reject( uint64_t id, const std::string& message )
+{
+  auto itr = waiters.find( id );
+  if ( itr == waiters.end() )
+  {
+    return;
+  }
+
+  auto waiter = std::move( itr->second );
+  waiters.erase( itr );
+  lsp_workspace.release_contents_tsfn();
+  auto env = waiter.document.Env();
+  waiter.deferred.Reject( Napi::Error::New( env, message ).Value() );
+  if ( waiters.empty() && !stopping )
+  {
+    completion_tsfn.Unref( env );
+  }
+}
+
+void AnalysisScheduler::complete( std::unique_ptr<Result> result )
+{
+  std::vector<uint64_t> undelivered_ids;
+  {
+    std::lock_guard<std::mutex> guard( mutex );
+    undelivered_ids.swap( undelivered );
+  }
+  for ( auto id : undelivered_ids )
+  {
+    reject( id, "Analysis results could not be delivered" );
+  }
+
+  auto itr = waiters.find( result->id );
+  if ( itr == waiters.end() )
+  {
+    return;
+  }
+
+  auto waiter = std::move( itr->second );
+  waiters.erase( itr );
+  lsp_workspace.release_contents_tsfn();
+
+  auto env = waiter.document.Env();
+  auto* document = LSPDocument::Unwrap( waiter.document.Value() );
+
+  if ( document->latest_analysis()->load() != result->generation )
+  {
+    {
+      std::lock_guard<std::mutex> guard( mutex );
+      ++dropped_count;
+    }
+    waiter.deferred.Resolve( Napi::Boolean::New( env, false ) );
+  }
+  else if ( result->error )
+  {
+    // Like `analyze()`, a failed analysis leaves no stale compilation data.
+    auto reporter = std::make_unique<Compiler::DiagnosticReporter>();
+    auto report = std::make_unique<Compiler::Report>( *reporter );
+    document->apply_analysis( std::move( reporter ), std::move( report ), nullptr );
+    waiter.deferred.Reject( Napi::Error::New( env, *result->error ).Value() );
+  }
+  else
+  {
+    document->apply_analysis( std::move( result->reporter ), std::move( result->report ),
+                              std::move( result->compiler_workspace ) );
+    lsp_workspace.add_references( result->references );
+    {
+      std::lock_guard<std::mutex> guard( mutex );
+      ++completed_count;
+    }
+    waiter.deferred.Resolve( Napi::Boolean::New( env, true ) );
+  }
+
+  if ( waiters.empty() )
+  {
+    completion_tsfn.Unref( env );
+  }
+}
+}  // namespace VSCodeEscript
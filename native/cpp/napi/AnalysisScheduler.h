@@ -0,0 +1,127 @@
+#pragma once
+
+#include "../compiler/ReferencesBuilder.h"
+#include "AnalysisOptions.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <napi.h>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace Pol::Bscript::Compiler
+{
+class CompilerWorkspace;
+class DiagnosticReporter;
+class Report;
+}  // namespace Pol::Bscript::Compiler
+
+namespace VSCodeEscript
+{
+class LSPDocument;
+class LSPWorkspace;
+
+enum class AnalysisPriority
+{
+  Foreground,
+  Background
+};
+
+struct AnalysisMetrics
+{
+  size_t queue_depth;
+  bool running;
+  uint64_t scheduled;
+  uint64_t dropped;
+  uint64_t completed;
+};
+
+// Runs document analyses on a dedicated thread. Requests for the same
+// document coalesce: scheduling a document again before its analysis started
+// drops the earlier request. Requests wait out a debounce window, and due
+// foreground requests run before background ones. Requests whose document
+// was analyzed again in the meantime are dropped before compiling.
+class AnalysisScheduler
+{
+public:
+  AnalysisScheduler( LSPWorkspace& lsp_workspace );
+  ~AnalysisScheduler();
+
+  // Must be called on the main thread. The promise resolves `true` once the
+  // results are applied to `document`, or `false` if the request was dropped
+  // or superseded.
+  Napi::Promise schedule( Napi::Env env, LSPDocument* document, AnalysisPriority priority,
+                          bool continue_on_error );
+
+  void set_debounce( std::chrono::milliseconds debounce );
+  AnalysisMetrics metrics() const;
+
+private:
+  struct Request
+  {
+    uint64_t id;
+    std::string pathname;
+    AnalysisOptions options;
+    uint64_t generation;
+    std::shared_ptr<const std::atomic<uint64_t>> latest_generation;
+    AnalysisPriority priority;
+    std::chrono::steady_clock::time_point due;
+  };
+
+  struct Result
+  {
+    uint64_t id;
+    uint64_t generation;
+    std::unique_ptr<Pol::Bscript::Compiler::DiagnosticReporter> reporter;
+    std::unique_ptr<Pol::Bscript::Compiler::Report> report;
+    std::unique_ptr<Pol::Bscript::Compiler::CompilerWorkspace> compiler_workspace;
+    CompilerExt::ReferencesByPathname references;
+    std::optional<std::string> error;
+  };
+
+  // Main-thread state of a request, keyed by request id.
+  struct Waiter
+  {
+    Napi::ObjectReference document;
+    Napi::Promise::Deferred deferred;
+  };
+
+  void run();
+  void analyze( const Request& request, Result& result );
+  void complete( std::unique_ptr<Result> result );
+  // Rejects the waiter of request `id`, releasing what it holds. Main thread
+  // only.
+  void reject( uint64_t id, const std::string& message );
+  void start_thread( Napi::Env env );
+
+  LSPWorkspace& lsp_workspace;
+
+  mutable std::mutex mutex;
+  std::condition_variable condition;
+  // Pending (not yet started) requests, keyed by pathname.
+  std::map<std::string, Request> pending;
+  bool running = false;
+  bool stopping = false;
+  bool started = false;
+  std::chrono::milliseconds debounce;
+  uint64_t next_id = 0;
+  uint64_t scheduled_count = 0;
+  uint64_t dropped_count = 0;
+  uint64_t completed_count = 0;
+  // Requests whose results could not be queued to the main thread, rejected
+  // by the next `complete()` or on destruction.
+  std::vector<uint64_t> undelivered;
+
+  std::unordered_map<uint64_t, Waiter> waiters;
+  Napi::ThreadSafeFunction completion_tsfn;
+  std::thread thread;
+};
+}  // namespace VSCodeEscript
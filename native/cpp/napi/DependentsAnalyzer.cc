@@ -0,0 +1,141 @@
+#include "DependentsAnalyzer.h"
+
+#include "../misc/Parallel.h"
+#include "../misc/Tracer.h"
+#include "LSPDocument.h"
+#include "LSPWorkspace.h"
+
+#include "bscript/compiler/Compiler.h"
+#include "bscript/compiler/Report.h"
+#include "bscript/compiler/model/CompilerWorkspace.h"
+
+using namespace Pol::Bscript;
+
+namespace VSCodeEscript
+{
+DependentsAnalyzer::DependentsAnalyzer( Napi::Env env, LSPWorkspace* lsp_workspace,
+                                        std::string changed_pathname,
+                                        std::vector<LSPDocument*> documents,
+                                        bool continue_on_error, unsigned concurrency )
+    : AsyncWorker( env ),
+      lsp_workspace( lsp_workspace ),
+      workspace( Napi::Persistent( lsp_workspace->Value() ) ),
+      deferred( Napi::Promise::Deferred::New( env ) ),
+      changed_pathname( std::move( changed_pathname ) ),
+      concurrency( concurrency ? concurrency : CompilerExt::default_concurrency() ),
+      jobs()
+{
+  jobs.reserve( documents.size() );
+  for ( auto* document : documents )
+  {
+    jobs.push_back( Job{ Napi::Persistent( document->Value() ),
+                         document->pathname(),
+                         LSPWorkspace::analysis_options( document->pathname(), continue_on_error ),
+                         document->begin_analysis(),
+                         document->latest_analysis(),
+                         nullptr,
+                         nullptr,
+                         nullptr,
+                         {},
+                         std::nullopt } );
+  }
+
+  lsp_workspace->acquire_contents_tsfn( env );
+}
+
+DependentsAnalyzer::~DependentsAnalyzer() = default;
+
+Napi::Promise DependentsAnalyzer::GetPromise() const
+{
+  return deferred.Promise();
+}
+
+void DependentsAnalyzer::analyze( Job& job )
+{
+  if ( job.latest_generation->load() != job.generation )
+  {
+    return;
+  }
+
+  CompilerExt::TraceSpan span( "DependentsAnalyzer::analyze", job.pathname );
+  job.reporter = std::make_unique<Compiler::DiagnosticReporter>();
+  job.report = std::make_unique<Compiler::Report>( *job.reporter );
+
+  auto superseded = [&]() { return job.latest_generation->load() != job.generation; };
+  CompilerExt::AnalysisProfiler profiler;
+  auto analysis = lsp_workspace->run_analysis( job.pathname, job.options, *lsp_workspace,
+                                               *job.report, profiler, job.references, superseded );
+  job.compiler_workspace = std::move( analysis.compiler_workspace );
+}
+
+void DependentsAnalyzer::Execute()
+{
+  // Parse the changed file once, instead of every thread missing the cache
+  // for it at the same time.
+  try
+  {
+    lsp_workspace->preload( changed_pathname );
+  }
+  catch ( ... )
+  {
+    // Each analysis reports the problem with the file itself.
+  }
+
+  CompilerExt::parallel_for(
+      jobs.size(), concurrency,
+      [&]( size_t index, unsigned )
+      {
+        auto& job = jobs[index];
+        try
+        {
+          analyze( job );
+        }
+        catch ( const std::exception& ex )
+        {
+          job.error = ex.what();
+        }
+        catch ( ... )
+        {
+          job.error = "Unknown Error";
+        }
+      } );
+}
+
+void DependentsAnalyzer::OnOK()
+{
+  auto env = Env();
+
+  lsp_workspace->release_contents_tsfn();
+
+  auto results = Napi::Object::New( env );
+  for ( auto& job : jobs )
+  {
+    auto* document = LSPDocument::Unwrap( job.document.Value() );
+    if ( document->latest_analysis()->load() != job.generation )
+    {
+      continue;
+    }
+
+    if ( job.error || !job.reporter )
+    {
+      // Like `analyze()`, a failed analysis leaves no stale compilation data.
+      job.reporter = std::make_unique<Compiler::DiagnosticReporter>();
+      job.report = std::make_unique<Compiler::Report>( *job.reporter );
+      job.compiler_workspace.reset();
+    }
+
+    document->apply_analysis( std::move( job.reporter ), std::move( job.report ),
+                              std::move( job.compiler_workspace ) );
+    lsp_workspace->add_references( job.references );
+    results.Set( job.pathname, document->diagnostics( env ) );
+  }
+
+  deferred.Resolve( results );
+}
+
+void DependentsAnalyzer::OnError( const Napi::Error& error )
+{
+  lsp_workspace->release_contents_tsfn();
+  deferred.Reject( error.Value() );
+}
+}  // namespace VSCodeEscript
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "../compiler/ReferencesBuilder.h"
+#include "AnalysisOptions.h"
+
+#include <atomic>
+#include <memory>
+#include <napi.h>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace Pol::Bscript::Compiler
+{
+class CompilerWorkspace;
+class DiagnosticReporter;
+class Report;
+}  // namespace Pol::Bscript::Compiler
+
+namespace VSCodeEscript
+{
+class LSPDocument;
+class LSPWorkspace;
+
+// Re-analyzes every document depending on a changed file on a pool of
+// threads. The changed file is parsed once up front, so all documents share
+// its parse tree through the workspace's cache. Results are applied on the
+// main thread, skipping documents analyzed again in the meantime, and the
+// diagnostics of all applied documents are returned in one batch.
+class DependentsAnalyzer : public Napi::AsyncWorker
+{
+public:
+  DependentsAnalyzer( Napi::Env env, LSPWorkspace* lsp_workspace, std::string changed_pathname,
+                      std::vector<LSPDocument*> documents, bool continue_on_error,
+                      unsigned concurrency );
+  ~DependentsAnalyzer() override;
+
+  Napi::Promise GetPromise() const;
+
+protected:
+  void Execute() override;
+  void OnOK() override;
+  void OnError( const Napi::Error& error ) override;
+
+private:
+  struct Job
+  {
+    Napi::ObjectReference document;
+    std::string pathname;
+    AnalysisOptions options;
+    uint64_t generation;
+    std::shared_ptr<const std::atomic<uint64_t>> latest_generation;
+
+    std::unique_ptr<Pol::Bscript::Compiler::DiagnosticReporter> reporter;
+    std::unique_ptr<Pol::Bscript::Compiler::Report> report;
+    std::unique_ptr<Pol::Bscript::Compiler::CompilerWorkspace> compiler_workspace;
+    CompilerExt::ReferencesByPathname references;
+    std::optional<std::string> error;
+  };
+
+  void analyze( Job& job );
+
+  LSPWorkspace* lsp_workspace;
+  Napi::ObjectReference workspace;
+  Napi::Promise::Deferred deferred;
+
+  std::string changed_pathname;
+  unsigned concurrency;
+  std::vector<Job> jobs;
+};
+}  // namespace VSCodeEscript
@@ -0,0 +1,136 @@
+#include "DocumentAnalyzer.h"
+
+#include "../misc/Tracer.h"
+#include "LSPDocument.h"
+#include "LSPWorkspace.h"
+
+#include "bscript/compiler/Compiler.h"
+#include "bscript/compiler/Report.h"
+#include "bscript/compiler/model/CompilerWorkspace.h"
+
+using namespace Pol::Bscript;
+
+namespace VSCodeEscript
+{
+namespace
+{
+// Serves the snapshot of the analyzed document, and everything else through
+// the workspace.
+class SnapshotSourceFileLoader : public Compiler::SourceFileLoader
+{
+public:
+  SnapshotSourceFileLoader( const LSPWorkspace& lsp_workspace, const std::string& pathname,
+                            const std::string& contents )
+      : lsp_workspace( lsp_workspace ), pathname( pathname ), contents( contents )
+  {
+  }
+
+  std::string get_contents( const std::string& requested ) const override
+  {
+    if ( requested == pathname )
+    {
+      return contents;
+    }
+    return lsp_workspace.get_contents( requested );
+  }
+
+private:
+  const LSPWorkspace& lsp_workspace;
+  const std::string& pathname;
+  const std::string& contents;
+};
+}  // namespace
+
+DocumentAnalyzer::DocumentAnalyzer( Napi::Env env, LSPDocument* document,
+                                    LSPWorkspace* lsp_workspace, bool continue_on_error )
+    : AsyncWorker( env ),
+      document( document ),
+      lsp_workspace( lsp_workspace ),
+      document_ref( Napi::Persistent( document->Value() ) ),
+      workspace_ref( Napi::Persistent( lsp_workspace->Value() ) ),
+      deferred( Napi::Promise::Deferred::New( env ) ),
+      pathname( document->pathname() ),
+      options( LSPWorkspace::analysis_options( document->pathname(), continue_on_error ) ),
+      generation( document->begin_analysis() ),
+      latest_generation( document->latest_analysis() )
+{
+  try
+  {
+    contents = lsp_workspace->get_contents( pathname );
+  }
+  catch ( ... )
+  {
+    // Let the compiler report the failure from the worker thread.
+  }
+
+  lsp_workspace->acquire_contents_tsfn( env );
+}
+
+DocumentAnalyzer::~DocumentAnalyzer() = default;
+
+Napi::Promise DocumentAnalyzer::GetPromise() const
+{
+  return deferred.Promise();
+}
+
+bool DocumentAnalyzer::is_superseded() const
+{
+  return latest_generation->load() != generation;
+}
+
+void DocumentAnalyzer::Execute()
+{
+  if ( is_superseded() )
+  {
+    return;
+  }
+
+  CompilerExt::TraceSpan span( "DocumentAnalyzer::Execute", pathname );
+  reporter = std::make_unique<Compiler::DiagnosticReporter>();
+  report = std::make_unique<Compiler::Report>( *reporter );
+
+  // The snapshot refers to `contents`, so only make one when there are any.
+  std::optional<SnapshotSourceFileLoader> snapshot;
+  if ( contents )
+    snapshot.emplace( *lsp_workspace, pathname, *contents );
+  Compiler::SourceFileLoader& loader =
+      snapshot ? static_cast<Compiler::SourceFileLoader&>( *snapshot ) : *lsp_workspace;
+  CompilerExt::AnalysisProfiler profiler;
+  auto analysis = lsp_workspace->run_analysis( pathname, options, loader, *report, profiler,
+                                               references, [&]() { return is_superseded(); } );
+  compiler_workspace = std::move( analysis.compiler_workspace );
+}
+
+void DocumentAnalyzer::OnOK()
+{
+  auto env = Env();
+
+  lsp_workspace->release_contents_tsfn();
+
+  if ( is_superseded() )
+  {
+    deferred.Resolve( Napi::Boolean::New( env, false ) );
+    return;
+  }
+
+  document->apply_analysis( std::move( reporter ), std::move( report ),
+                            std::move( compiler_workspace ) );
+  lsp_workspace->add_references( references );
+
+  deferred.Resolve( Napi::Boolean::New( env, true ) );
+}
+
+void DocumentAnalyzer::OnError( const Napi::Error& error )
+{
+  lsp_workspace->release_contents_tsfn();
+
+  // Like `analyze()`, a failed analysis leaves no stale compilation data.
+  if ( !is_superseded() )
+  {
+    reporter = std::make_unique<Compiler::DiagnosticReporter>();
+    report = std::make_unique<Compiler::Report>( *reporter );
+    document->apply_analysis( std::move( reporter ), std::move( report ), nullptr );
+  }
+  deferred.Reject( error.Value() );
+}
+}  // namespace VSCodeEscript
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "../compiler/ReferencesBuilder.h"
+#include "AnalysisOptions.h"
+
+#include <atomic>
+#include <memory>
+#include <napi.h>
+#include <optional>
+#include <string>
+
+namespace Pol::Bscript::Compiler
+{
+class CompilerWorkspace;
+class DiagnosticReporter;
+class Report;
+}  // namespace Pol::Bscript::Compiler
+
+namespace VSCodeEscript
+{
+class LSPDocument;
+class LSPWorkspace;
+
+// Analyzes a single document on a worker thread. The document's own contents
+// are read on the main thread when the analysis is queued; included files are
+// read through the workspace's thread-safe `getContents`. The results replace
+// the document's state on the main thread, unless another analysis of the
+// same document was started in the meantime.
+class DocumentAnalyzer : public Napi::AsyncWorker
+{
+public:
+  DocumentAnalyzer( Napi::Env env, LSPDocument* document, LSPWorkspace* lsp_workspace,
+                    bool continue_on_error );
+  ~DocumentAnalyzer() override;
+
+  Napi::Promise GetPromise() const;
+
+protected:
+  void Execute() override;
+  void OnOK() override;
+  void OnError( const Napi::Error& error ) override;
+
+private:
+  bool is_superseded() const;
+
+  LSPDocument* document;
+  LSPWorkspace* lsp_workspace;
+  Napi::ObjectReference document_ref;
+  Napi::ObjectReference workspace_ref;
+  Napi::Promise::Deferred deferred;
+
+  std::string pathname;
+  std::optional<std::string> contents;
+  AnalysisOptions options;
+  uint64_t generation;
+  std::shared_ptr<const std::atomic<uint64_t>> latest_generation;
+
+  std::unique_ptr<Pol::Bscript::Compiler::DiagnosticReporter> reporter;
+  std::unique_ptr<Pol::Bscript::Compiler::Report> report;
+  std::unique_ptr<Pol::Bscript::Compiler::CompilerWorkspace> compiler_workspace;
+  CompilerExt::ReferencesByPathname references;
+};
+}  // namespace VSCodeEscript
@@ -10,7 +10,8 @@ ExtensionConfiguration::ExtensionConfiguration()
       showModuleFunctionComments( false ),
       continueAnalysisOnError( true ),
       disableWorkspaceReferences( false ),
-      referenceAllFunctions( false )
+      referenceAllFunctions( false ),
+      indexIncludesOnce( false )
 {
 }
 
@@ -47,6 +48,10 @@ Napi::Value ExtensionConfiguration::Get( const Napi::CallbackInfo& info )
   {
     return Napi::Boolean::New( env, gExtensionConfiguration.referenceAllFunctions );
   }
+  else if ( property == "indexIncludesOnce" )
+  {
+    return Napi::Boolean::New( env, gExtensionConfiguration.indexIncludesOnce );
+  }
   Napi::TypeError::New( env, Napi::String::New( env, "Invalid arguments" ) )
       .ThrowAsJavaScriptException();
   return Napi::Value();
@@ -130,6 +135,19 @@ Napi::Value ExtensionConfiguration::SetFromObject( const Napi::CallbackInfo& inf
     }
   }
 
+  if ( config.Has( "indexIncludesOnce" ) )
+  {
+    auto value = config.Get( "indexIncludesOnce" );
+    if ( value.IsBoolean() )
+    {
+      gExtensionConfiguration.indexIncludesOnce = value.As<Napi::Boolean>().Value();
+    }
+    else
+    {
+      gExtensionConfiguration.indexIncludesOnce = false;
+    }
+  }
+
   return env.Undefined();
 }
 }  // namespace VSCodeEscript
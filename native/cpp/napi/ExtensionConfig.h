@@ -19,6 +19,7 @@ public:
   bool continueAnalysisOnError;
   bool disableWorkspaceReferences;
   bool referenceAllFunctions;
+  bool indexIncludesOnce;
 };
 
 extern ExtensionConfiguration gExtensionConfiguration;
@@ -6,7 +6,8 @@
 #include "../compiler/ReferencesBuilder.h"
 #include "../compiler/ReferencesFinder.h"
 #include "../compiler/SignatureHelpBuilder.h"
-#include "ExtensionConfig.h"
+#include "../misc/Tracer.h"
+#include "DocumentAnalyzer.h"
 #include "LSPWorkspace.h"
 #include "bscript/compiler/Compiler.h"
 #include "bscript/compiler/Report.h"
@@ -16,7 +17,9 @@
 #include "bscript/compiler/model/CompilerWorkspace.h"
 #include "bscript/compilercfg.h"
 #include "clib/strutil.h"
+#include <algorithm>
 #include <filesystem>
+#include <span>
 
 using namespace Pol::Bscript;
 
@@ -24,9 +27,9 @@ namespace VSCodeEscript
 {
 LSPDocument::LSPDocument( const Napi::CallbackInfo& info )
     : ObjectWrap( info ),
-      referenced_by(),
       reporter( std::make_unique<Compiler::DiagnosticReporter>() ),
-      report( std::make_unique<Compiler::Report>( *reporter ) )
+      report( std::make_unique<Compiler::Report>( *reporter ) ),
+      analysis_generation( std::make_shared<std::atomic<uint64_t>>( 0 ) )
 {
   auto env = info.Env();
 
@@ -40,20 +43,22 @@ LSPDocument::LSPDocument( const Napi::CallbackInfo& info )
 
   pathname_ = info[1].As<Napi::String>().Utf8Value();
 
-  auto extension = std::filesystem::path( pathname_ ).extension().string();
+  type = type_from_pathname( pathname_ );
+}
+
+LSPDocumentType LSPDocument::type_from_pathname( const std::string& pathname )
+{
+  auto extension = std::filesystem::path( pathname ).extension().string();
   Pol::Clib::mklowerASCII( extension );
   if ( extension.compare( ".em" ) == 0 )
   {
-    type = LSPDocumentType::EM;
+    return LSPDocumentType::EM;
   }
   else if ( extension.compare( ".inc" ) == 0 )
   {
-    type = LSPDocumentType::INC;
-  }
-  else
-  {
-    type = LSPDocumentType::SRC;
+    return LSPDocumentType::INC;
   }
+  return LSPDocumentType::SRC;
 }
 
 const std::string& LSPDocument::pathname()
@@ -61,52 +66,166 @@ const std::string& LSPDocument::pathname()
   return pathname_;
 }
 
-void LSPDocument::add_reference_by( const Compiler::SourceLocation& defined_at,
-                                    const Compiler::SourceLocation& used_at )
+LSPDocumentType LSPDocument::document_type() const
+{
+  return type;
+}
+
+uint64_t LSPDocument::begin_analysis()
+{
+  return ++*analysis_generation;
+}
+
+std::shared_ptr<const std::atomic<uint64_t>> LSPDocument::latest_analysis() const
+{
+  return analysis_generation;
+}
+
+void LSPDocument::apply_analysis(
+    std::unique_ptr<Compiler::DiagnosticReporter> new_reporter,
+    std::unique_ptr<Compiler::Report> new_report,
+    std::unique_ptr<Compiler::CompilerWorkspace> new_compiler_workspace )
 {
-  add_reference_by( defined_at.range, used_at.source_file_identifier->pathname, used_at.range );
+  // `report` refers to `reporter`, so release it first.
+  report = std::move( new_report );
+  reporter = std::move( new_reporter );
+  set_compiler_workspace( std::move( new_compiler_workspace ) );
+  finish_analysis();
 }
 
-void LSPDocument::add_reference_by( const Compiler::Range& defined_at,
-                                    const std::string& used_at_pathname,
-                                    const Compiler::Range& used_at_range )
+void LSPDocument::finish_analysis()
 {
-  auto itr = referenced_by.find( defined_at );
-  if ( itr != referenced_by.end() )
+  update_dependencies();
+  LSPWorkspace::Unwrap( workspace.Value() )->document_analyzed( *this );
+}
+
+void LSPDocument::evict_compiler_workspace()
+{
+  set_compiler_workspace( nullptr );
+  semantic_tokens.Reset();
+  semantic_tokens_id.clear();
+  evicted = true;
+}
+
+void LSPDocument::ensure_analyzed()
+{
+  auto* lsp_workspace = LSPWorkspace::Unwrap( workspace.Value() );
+  if ( !evicted )
   {
-    itr->second.emplace( CompilerExt::ReferenceLocation{ used_at_pathname, used_at_range } );
+    if ( compiler_workspace )
+      lsp_workspace->document_used( *this );
+    return;
   }
-  else
+
+  CompilerExt::TraceSpan span( "LSPDocument::ensure_analyzed", pathname_ );
+  try
   {
-    referenced_by.emplace(
-        defined_at,
-        std::set<CompilerExt::ReferenceLocation, CompilerExt::ReferenceLocationComparator>{
-            CompilerExt::ReferenceLocation{ used_at_pathname, used_at_range } } );
+    run_analysis( last_continue_on_error );
+  }
+  catch ( ... )
+  {
+    // The query finds no workspace, as if the analysis had failed before.
+    finish_analysis();
   }
 }
 
-void LSPDocument::build_references( Pol::Bscript::Compiler::CompilerWorkspace& compiler_workspace )
+void LSPDocument::set_compiler_workspace(
+    std::unique_ptr<Compiler::CompilerWorkspace> new_compiler_workspace )
 {
-  auto* lsp_workspace = LSPWorkspace::Unwrap( workspace.Value() );
-  CompilerExt::ReferencesBuilder builder( lsp_workspace, compiler_workspace, pathname_ );
+  evicted = false;
+  // The indices refer to `compiler_workspace`, so release them first.
+  semantic_tokens_encoder.reset();
+  token_index.reset();
+  scope_index.reset();
+  compiler_workspace = std::move( new_compiler_workspace );
+  if ( compiler_workspace )
+  {
+    semantic_tokens_encoder =
+        std::make_unique<CompilerExt::SemanticTokensEncoder>( *compiler_workspace );
+    token_index = std::make_unique<CompilerExt::TokenIndex>( *compiler_workspace );
+    scope_index = std::make_unique<CompilerExt::ScopeIndex>( *compiler_workspace );
+  }
+}
 
-  compiler_workspace.top_level_statements->accept( builder );
+Napi::Uint32Array LSPDocument::encoded_tokens( Napi::Env env ) const
+{
+  if ( !semantic_tokens_encoder )
+  {
+    return Napi::Uint32Array::New( env, 0 );
+  }
 
-  if ( auto& program = compiler_workspace.program )
+  auto results = Napi::Uint32Array::New( env, semantic_tokens_encoder->size() );
+  semantic_tokens_encoder->encode( results.Data() );
+  return results;
+}
+
+void LSPDocument::update_dependencies()
+{
+  std::vector<std::string> dependencies;
+  if ( compiler_workspace )
   {
-    program->accept( builder );
+    for ( const auto& sourceId : compiler_workspace->referenced_source_file_identifiers )
+    {
+      if ( sourceId->pathname != pathname_ )
+        dependencies.push_back( sourceId->pathname );
+    }
   }
 
-  for ( auto& user_function : compiler_workspace.user_functions )
+  auto* lsp_workspace = LSPWorkspace::Unwrap( workspace.Value() );
+  lsp_workspace->update_dependencies( pathname_, dependencies );
+}
+
+void LSPDocument::build_references( Pol::Bscript::Compiler::CompilerWorkspace& compiler_workspace )
+{
+  CompilerExt::ReferencesByPathname references;
+  CompilerExt::ReferencesBuilder::collect( compiler_workspace, references );
+
+  auto* lsp_workspace = LSPWorkspace::Unwrap( workspace.Value() );
+  lsp_workspace->add_references( references );
+}
+
+CompilerExt::DocumentMemoryUsage LSPDocument::memory_usage() const
+{
+  CompilerExt::DocumentMemoryUsage usage;
+  if ( compiler_workspace )
   {
-    user_function->accept( builder );
+    if ( compiler_workspace->source )
+    {
+      auto source_usage = CompilerExt::estimate_memory_usage( *compiler_workspace->source );
+      usage.parse_tree = source_usage.parse_tree;
+      usage.tokens = source_usage.tokens;
+    }
+    usage.ast = CompilerExt::estimate_ast_memory_usage( *compiler_workspace );
+    usage.indices = CompilerExt::estimate_semantic_tokens_memory_usage( *compiler_workspace );
   }
+  if ( semantic_tokens_encoder )
+    usage.indices += semantic_tokens_encoder->memory_usage();
+  if ( token_index )
+    usage.indices += token_index->memory_usage();
+  if ( scope_index )
+    usage.indices += scope_index->memory_usage();
+  return usage;
 }
 
-void LSPDocument::add_reference_by( const Compiler::Range& defined_at,
-                                    const Compiler::SourceLocation& used_at )
+Napi::Object LSPDocument::memory_usage_to_object( Napi::Env env,
+                                                  const CompilerExt::DocumentMemoryUsage& usage )
 {
-  add_reference_by( defined_at, used_at.source_file_identifier->pathname, used_at.range );
+  auto bytes = [&]( size_t value )
+  { return Napi::Number::New( env, static_cast<double>( value ) ); };
+
+  auto result = Napi::Object::New( env );
+  result["totalBytes"] = bytes( usage.total() );
+  result["parseTree"] = bytes( usage.parse_tree );
+  result["tokens"] = bytes( usage.tokens );
+  result["ast"] = bytes( usage.ast );
+  result["indices"] = bytes( usage.indices );
+  return result;
+}
+
+Napi::Value LSPDocument::MemoryUsage( const Napi::CallbackInfo& info )
+{
+  CompilerExt::TraceSpan span( "LSPDocument::MemoryUsage", pathname_ );
+  return memory_usage_to_object( info.Env(), memory_usage() );
 }
 
 Napi::Value LSPDocument::throwError( const std::string& what = "Invalid arguments" )
@@ -120,8 +239,13 @@ Napi::Function LSPDocument::GetClass( Napi::Env env )
 {
   return DefineClass( env, "LSPDocument",
                       { LSPDocument::InstanceMethod( "analyze", &LSPDocument::Analyze ),
+                        LSPDocument::InstanceMethod( "analyzeAsync", &LSPDocument::AnalyzeAsync ),
                         LSPDocument::InstanceMethod( "diagnostics", &LSPDocument::Diagnostics ),
                         LSPDocument::InstanceMethod( "tokens", &LSPDocument::Tokens ),
+                        LSPDocument::InstanceMethod( "tokensEncoded", &LSPDocument::TokensEncoded ),
+                        LSPDocument::InstanceMethod( "tokensInRange", &LSPDocument::TokensInRange ),
+                        LSPDocument::InstanceMethod( "semanticTokens", &LSPDocument::SemanticTokens ),
+                        LSPDocument::InstanceMethod( "semanticTokensDelta", &LSPDocument::SemanticTokensDelta ),
                         LSPDocument::InstanceMethod( "hover", &LSPDocument::Hover ),
                         LSPDocument::InstanceMethod( "completion", &LSPDocument::Completion ),
                         LSPDocument::InstanceMethod( "definition", &LSPDocument::Definition ),
@@ -131,6 +255,7 @@ Napi::Function LSPDocument::GetClass( Napi::Env env )
                         LSPDocument::InstanceMethod( "buildReferences", &LSPDocument::BuildReferences ),
                         LSPDocument::InstanceMethod( "toFormattedString", &LSPDocument::ToFormattedString ),
                         LSPDocument::InstanceMethod( "symbols", &LSPDocument::Symbols ),
+                        LSPDocument::InstanceMethod( "memoryUsage", &LSPDocument::MemoryUsage ),
                         LSPDocument::InstanceMethod( "dependents", &LSPDocument::Dependents ) } );
 }
 
@@ -138,50 +263,104 @@ Napi::Function LSPDocument::GetClass( Napi::Env env )
 Napi::Value LSPDocument::Analyze( const Napi::CallbackInfo& info )
 {
   auto env = info.Env();
+  CompilerExt::TraceSpan span( "LSPDocument::Analyze", pathname_ );
 
   try
   {
-    report->clear();
-    // Explicitly reset the pointer, in case `compiler->analyze()` throws and
-    // does not give a new value to populate. We do not want stale compilation
-    // data cached, as the tokens <-> line,col will no longer match.
-    compiler_workspace.reset();
-
-    auto* lsp_workspace = LSPWorkspace::Unwrap( workspace.Value() );
-    auto compiler = lsp_workspace->make_compiler();
-    if ( type == LSPDocumentType::INC || gExtensionConfiguration.referenceAllFunctions )
+    // `analyze( continueOnError )` or `analyze( { continueOnError, stats } )`
+    bool continue_on_error = true;
+    bool return_stats = false;
+    if ( info.Length() > 0 && info[0].IsBoolean() )
     {
-      compiler->set_include_compile_mode();
+      continue_on_error = info[0].As<Napi::Boolean>().Value();
     }
-
-    bool continue_on_error =
-        info.Length() > 0 && info[0].IsBoolean() ? info[0].As<Napi::Boolean>().Value() : true;
-
-    compiler_workspace =
-        compiler->analyze( pathname_, *report, type == LSPDocumentType::EM, continue_on_error );
-
-    if ( compiler_workspace )
+    else if ( info.Length() > 0 && info[0].IsObject() )
     {
-      build_references( *compiler_workspace );
+      auto options = info[0].As<Napi::Object>();
+      auto continue_on_error_value = options.Get( "continueOnError" );
+      if ( continue_on_error_value.IsBoolean() )
+        continue_on_error = continue_on_error_value.As<Napi::Boolean>().Value();
+      return_stats = options.Get( "stats" ).ToBoolean().Value();
     }
 
+    auto stats = run_analysis( continue_on_error );
+    if ( return_stats )
+      return LSPWorkspace::stats_to_object( env, stats );
+
     return env.Undefined();
   }
   catch ( const std::exception& ex )
   {
+    finish_analysis();
     Napi::Error::New( env, ex.what() ).ThrowAsJavaScriptException();
   }
   catch ( ... )
   {
+    finish_analysis();
     Napi::Error::New( env, "Unknown Error" ).ThrowAsJavaScriptException();
   }
   return Napi::Value();
 }
 
-Napi::Value LSPDocument::Diagnostics( const Napi::CallbackInfo& info )
+CompilerExt::AnalysisStats LSPDocument::run_analysis( bool continue_on_error )
+{
+  begin_analysis();
+  report->clear();
+  // Explicitly reset the pointer, in case `compiler->analyze()` throws and
+  // does not give a new value to populate. We do not want stale compilation
+  // data cached, as the tokens <-> line,col will no longer match.
+  set_compiler_workspace( nullptr );
+  last_continue_on_error = continue_on_error;
+
+  auto* lsp_workspace = LSPWorkspace::Unwrap( workspace.Value() );
+  CompilerExt::AnalysisProfiler profiler;
+  CompilerExt::ReferencesByPathname references;
+  auto analysis = lsp_workspace->run_analysis(
+      pathname_, LSPWorkspace::analysis_options( pathname_, continue_on_error ), *lsp_workspace,
+      *report, profiler, references );
+
+  set_compiler_workspace( std::move( analysis.compiler_workspace ) );
+  lsp_workspace->add_references( references );
+  finish_analysis();
+  return analysis.stats;
+}
+
+Napi::Value LSPDocument::AnalyzeAsync( const Napi::CallbackInfo& info )
 {
   auto env = info.Env();
 
+  if ( info.Length() > 0 && !info[0].IsUndefined() && !info[0].IsBoolean() )
+  {
+    Napi::TypeError::New( env, Napi::String::New( env, "Invalid arguments" ) )
+        .ThrowAsJavaScriptException();
+    return Napi::Value();
+  }
+
+  bool continue_on_error =
+      info.Length() > 0 && info[0].IsBoolean() ? info[0].As<Napi::Boolean>().Value() : true;
+
+  try
+  {
+    auto* lsp_workspace = LSPWorkspace::Unwrap( workspace.Value() );
+    auto* analyzer = new DocumentAnalyzer( env, this, lsp_workspace, continue_on_error );
+    auto promise = analyzer->GetPromise();
+    analyzer->Queue();
+    return promise;
+  }
+  catch ( const std::exception& ex )
+  {
+    Napi::Error::New( env, ex.what() ).ThrowAsJavaScriptException();
+  }
+  return Napi::Value();
+}
+
+Napi::Value LSPDocument::Diagnostics( const Napi::CallbackInfo& info )
+{
+  return diagnostics( info.Env() );
+}
+
+Napi::Array LSPDocument::diagnostics( Napi::Env env )
+{
   auto results = Napi::Array::New( env );
   auto push = results.Get( "push" ).As<Napi::Function>();
 
@@ -236,6 +415,8 @@ Napi::Value LSPDocument::Tokens( const Napi::CallbackInfo& info )
   auto results = Napi::Array::New( env );
   auto push = results.Get( "push" ).As<Napi::Function>();
 
+  ensure_analyzed();
+
   if ( compiler_workspace )
   {
     for ( const auto& token : compiler_workspace->tokens )
@@ -260,10 +441,132 @@ Napi::Value LSPDocument::Tokens( const Napi::CallbackInfo& info )
   return results;
 }
 
+Napi::Value LSPDocument::TokensEncoded( const Napi::CallbackInfo& info )
+{
+  ensure_analyzed();
+
+  // Encode straight into the typed array's storage, so the payload is built
+  // without any per-token JavaScript values.
+  return encoded_tokens( info.Env() );
+}
+
+Napi::Value LSPDocument::TokensInRange( const Napi::CallbackInfo& info )
+{
+  auto env = info.Env();
+
+  if ( info.Length() < 1 || !info[0].IsObject() )
+  {
+    Napi::TypeError::New( env, Napi::String::New( env, "Invalid arguments" ) )
+        .ThrowAsJavaScriptException();
+    return Napi::Value();
+  }
+
+  auto range = info[0].As<Napi::Object>();
+  auto start = range.Get( "start" );
+  auto end = range.Get( "end" );
+  if ( !start.IsObject() || !end.IsObject() )
+  {
+    Napi::TypeError::New( env, Napi::String::New( env, "Invalid arguments" ) )
+        .ThrowAsJavaScriptException();
+    return Napi::Value();
+  }
+  auto start_line = start.As<Napi::Object>().Get( "line" );
+  auto end_line = end.As<Napi::Object>().Get( "line" );
+  if ( !start_line.IsNumber() || !end_line.IsNumber() )
+  {
+    Napi::TypeError::New( env, Napi::String::New( env, "Invalid arguments" ) )
+        .ThrowAsJavaScriptException();
+    return Napi::Value();
+  }
+
+  ensure_analyzed();
+
+  if ( !semantic_tokens_encoder )
+  {
+    return Napi::Uint32Array::New( env, 0 );
+  }
+
+  auto first_line = start_line.As<Napi::Number>().Uint32Value();
+  auto last_line = end_line.As<Napi::Number>().Uint32Value();
+  auto results =
+      Napi::Uint32Array::New( env, semantic_tokens_encoder->size_lines( first_line, last_line ) );
+  semantic_tokens_encoder->encode_lines( first_line, last_line, results.Data() );
+  return results;
+}
+
+// Result ids are unique across documents, so an id held by the client can
+// never match the tokens of a document recreated by `reopen()`.
+static std::atomic<uint64_t> next_semantic_tokens_id = 0;
+
+Napi::Value LSPDocument::SemanticTokens( const Napi::CallbackInfo& info )
+{
+  auto env = info.Env();
+
+  ensure_analyzed();
+
+  auto data = encoded_tokens( env );
+  semantic_tokens = Napi::Persistent( data );
+  semantic_tokens_id = std::to_string( ++next_semantic_tokens_id );
+
+  auto results = Napi::Object::New( env );
+  results["resultId"] = semantic_tokens_id;
+  results["data"] = data;
+  return results;
+}
+
+Napi::Value LSPDocument::SemanticTokensDelta( const Napi::CallbackInfo& info )
+{
+  auto env = info.Env();
+
+  if ( info.Length() < 1 || !info[0].IsString() )
+  {
+    Napi::TypeError::New( env, Napi::String::New( env, "Invalid arguments" ) )
+        .ThrowAsJavaScriptException();
+    return Napi::Value();
+  }
+
+  ensure_analyzed();
+
+  // Without the tokens the client has, all we can send is the full set.
+  if ( semantic_tokens_id.empty() ||
+       info[0].As<Napi::String>().Utf8Value() != semantic_tokens_id )
+  {
+    return SemanticTokens( info );
+  }
+
+  auto previous = semantic_tokens.Value();
+  auto current = encoded_tokens( env );
+  auto edit = CompilerExt::diff_semantic_tokens(
+      std::span<const uint32_t>( previous.Data(), previous.ElementLength() ),
+      std::span<const uint32_t>( current.Data(), current.ElementLength() ) );
+
+  semantic_tokens = Napi::Persistent( current );
+  semantic_tokens_id = std::to_string( ++next_semantic_tokens_id );
+
+  auto edits = Napi::Array::New( env );
+  if ( edit )
+  {
+    auto result = Napi::Object::New( env );
+    result["start"] = Napi::Number::New( env, static_cast<double>( edit->start ) );
+    result["deleteCount"] = Napi::Number::New( env, static_cast<double>( edit->delete_count ) );
+    // A view of the inserted tokens in the new encoding, rather than a copy.
+    result["data"] = Napi::Uint32Array::New( env, edit->insert_count, current.ArrayBuffer(),
+                                             edit->start * sizeof( uint32_t ) );
+    edits.Set( 0u, result );
+  }
+
+  auto results = Napi::Object::New( env );
+  results["resultId"] = semantic_tokens_id;
+  results["edits"] = edits;
+  return results;
+}
+
 Napi::Value LSPDocument::Dependents( const Napi::CallbackInfo& info )
 {
   auto env = info.Env();
 
+  ensure_analyzed();
+
   auto results = Napi::Array::New( env );
   auto push = results.Get( "push" ).As<Napi::Function>();
 
@@ -289,6 +592,8 @@ Napi::Value LSPDocument::Hover( const Napi::CallbackInfo& info )
         .ThrowAsJavaScriptException();
   }
 
+  ensure_analyzed();
+
   if ( compiler_workspace )
   {
     auto position = info[0].As<Napi::Object>();
@@ -304,8 +609,9 @@ Napi::Value LSPDocument::Hover( const Napi::CallbackInfo& info )
         static_cast<unsigned short>( character.As<Napi::Number>().Int32Value() ) };
 
     auto* lsp_workspace = LSPWorkspace::Unwrap( workspace.Value() );
-    CompilerExt::HoverBuilder finder( lsp_workspace, *compiler_workspace, pos );
-    auto result = finder.context();
+    CompilerExt::HoverBuilder finder( lsp_workspace, *compiler_workspace, *scope_index, pos );
+    auto result = CompilerExt::traced( "HoverBuilder::context", pathname_,
+                                       [&] { return finder.context(); } );
     if ( result.has_value() )
     {
       return Napi::String::New( env, result.value().hover );
@@ -324,6 +630,8 @@ Napi::Value LSPDocument::Definition( const Napi::CallbackInfo& info )
         .ThrowAsJavaScriptException();
   }
 
+  ensure_analyzed();
+
   if ( compiler_workspace )
   {
     auto position = info[0].As<Napi::Object>();
@@ -338,8 +646,9 @@ Napi::Value LSPDocument::Definition( const Napi::CallbackInfo& info )
         static_cast<unsigned short>( line.As<Napi::Number>().Int32Value() ),
         static_cast<unsigned short>( character.As<Napi::Number>().Int32Value() ) };
 
-    CompilerExt::DefinitionBuilder finder( *compiler_workspace, pos );
-    auto definition = finder.context();
+    CompilerExt::DefinitionBuilder finder( *compiler_workspace, *scope_index, pos );
+    auto definition = CompilerExt::traced( "DefinitionBuilder::context", pathname_,
+                                           [&] { return finder.context(); } );
     if ( definition.has_value() )
     {
       const auto& location = definition.value();
@@ -368,6 +677,8 @@ Napi::Value LSPDocument::ToStringTree( const Napi::CallbackInfo& info )
 {
   auto env = info.Env();
 
+  ensure_analyzed();
+
   if ( compiler_workspace )
   {
     std::stringstream ss;
@@ -413,6 +724,8 @@ Napi::Value LSPDocument::References( const Napi::CallbackInfo& info )
         .ThrowAsJavaScriptException();
   }
 
+  ensure_analyzed();
+
   if ( compiler_workspace )
   {
     auto position = info[0].As<Napi::Object>();
@@ -427,9 +740,10 @@ Napi::Value LSPDocument::References( const Napi::CallbackInfo& info )
         static_cast<unsigned short>( line.As<Napi::Number>().Int32Value() ),
         static_cast<unsigned short>( character.As<Napi::Number>().Int32Value() ) };
 
-    CompilerExt::ReferencesFinder finder( *compiler_workspace,
-                                           LSPWorkspace::Unwrap( workspace.Value() ), pos );
-    auto references = finder.context();
+    CompilerExt::ReferencesFinder finder(
+        *compiler_workspace, LSPWorkspace::Unwrap( workspace.Value() ), *scope_index, pos );
+    auto references = CompilerExt::traced( "ReferencesFinder::context", pathname_,
+                                           [&] { return finder.context(); } );
     if ( references.has_value() )
     {
       auto results = Napi::Array::New( env );
@@ -471,6 +785,8 @@ Napi::Value LSPDocument::Completion( const Napi::CallbackInfo& info )
         .ThrowAsJavaScriptException();
   }
 
+  ensure_analyzed();
+
   auto results = Napi::Array::New( env );
   auto push = results.Get( "push" ).As<Napi::Function>();
 
@@ -488,8 +804,9 @@ Napi::Value LSPDocument::Completion( const Napi::CallbackInfo& info )
         static_cast<unsigned short>( line.As<Napi::Number>().Int32Value() ),
         static_cast<unsigned short>( character.As<Napi::Number>().Int32Value() ) };
 
-    CompilerExt::CompletionBuilder finder( *compiler_workspace, pos );
-    auto definition = finder.context();
+    CompilerExt::CompletionBuilder finder( *compiler_workspace, *token_index, pos );
+    auto definition = CompilerExt::traced( "CompletionBuilder::context", pathname_,
+                                           [&] { return finder.context(); } );
     for ( const auto& completionItem : definition )
     {
       auto result = Napi::Object::New( env );
@@ -515,6 +832,8 @@ Napi::Value LSPDocument::SignatureHelp( const Napi::CallbackInfo& info )
         .ThrowAsJavaScriptException();
   }
 
+  ensure_analyzed();
+
   if ( compiler_workspace )
   {
     auto position = info[0].As<Napi::Object>();
@@ -530,8 +849,10 @@ Napi::Value LSPDocument::SignatureHelp( const Napi::CallbackInfo& info )
         static_cast<unsigned short>( character.As<Napi::Number>().Int32Value() - 1 ) };
 
     auto* lsp_workspace = LSPWorkspace::Unwrap( workspace.Value() );
-    CompilerExt::SignatureHelpBuilder finder( lsp_workspace, *compiler_workspace, pos );
-    auto signatureHelp = finder.context();
+    CompilerExt::SignatureHelpBuilder finder( lsp_workspace, *compiler_workspace, *token_index,
+                                              pos );
+    auto signatureHelp = CompilerExt::traced( "SignatureHelpBuilder::context", pathname_,
+                                              [&] { return finder.context(); } );
     if ( signatureHelp.has_value() )
     {
       auto results = Napi::Object::New( env );
@@ -580,6 +901,8 @@ Napi::Value LSPDocument::SignatureHelp( const Napi::CallbackInfo& info )
 
 void LSPDocument::accept_visitor( Pol::Bscript::Compiler::NodeVisitor& visitor )
 {
+  ensure_analyzed();
+
   if ( compiler_workspace )
   {
     compiler_workspace->accept( visitor );
@@ -589,6 +912,7 @@ void LSPDocument::accept_visitor( Pol::Bscript::Compiler::NodeVisitor& visitor )
 Napi::Value LSPDocument::BuildReferences( const Napi::CallbackInfo& info )
 {
   auto env = info.Env();
+  CompilerExt::TraceSpan span( "LSPDocument::BuildReferences", pathname_ );
 
   if ( compiler_workspace )
   {
@@ -597,23 +921,18 @@ Napi::Value LSPDocument::BuildReferences( const Napi::CallbackInfo& info )
   else
   {
     auto local_reporter = std::make_unique<Compiler::DiagnosticReporter>();
-    auto local_report = std::make_unique<Compiler::Report>( *reporter );
-
-    auto* lsp_workspace = LSPWorkspace::Unwrap( workspace.Value() );
-    auto compiler = lsp_workspace->make_compiler();
-    if ( type == LSPDocumentType::INC )
-    {
-      compiler->set_include_compile_mode();
-    }
+    auto local_report = std::make_unique<Compiler::Report>( *local_reporter );
 
     bool continue_on_error =
         info.Length() > 0 && info[0].IsBoolean() ? info[0].As<Napi::Boolean>().Value() : true;
 
-    if ( auto local_compiler_workspace = compiler->analyze(
-             pathname_, *local_report, type == LSPDocumentType::EM, continue_on_error ) )
-    {
-      build_references( *local_compiler_workspace );
-    }
+    auto* lsp_workspace = LSPWorkspace::Unwrap( workspace.Value() );
+    CompilerExt::AnalysisProfiler profiler;
+    CompilerExt::ReferencesByPathname references;
+    lsp_workspace->run_analysis( pathname_,
+                                 LSPWorkspace::analysis_options( pathname_, continue_on_error ),
+                                 *lsp_workspace, *local_report, profiler, references );
+    lsp_workspace->add_references( references );
   }
 
   return env.Undefined();
@@ -622,6 +941,7 @@ Napi::Value LSPDocument::BuildReferences( const Napi::CallbackInfo& info )
 Napi::Value LSPDocument::ToFormattedString( const Napi::CallbackInfo& info )
 {
   auto env = info.Env();
+  CompilerExt::TraceSpan span( "LSPDocument::ToFormattedString", pathname_ );
 
   std::optional<Compiler::Range> format_range;
 
@@ -732,6 +1052,9 @@ Napi::Value LSPDocument::ToFormattedString( const Napi::CallbackInfo& info )
 Napi::Value LSPDocument::Symbols( const Napi::CallbackInfo& info )
 {
   auto env = info.Env();
+  CompilerExt::TraceSpan span( "LSPDocument::Symbols", pathname_ );
+
+  ensure_analyzed();
 
   if ( !compiler_workspace )
   {
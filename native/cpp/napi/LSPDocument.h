@@ -1,11 +1,20 @@
 #pragma once
 
+#include "../compiler/AnalysisProfiler.h"
+#include "../compiler/MemoryUsage.h"
+#include "../compiler/ReferencesBuilder.h"
+#include "../compiler/ScopeIndex.h"
+#include "../compiler/SemanticTokensEncoder.h"
+#include "../compiler/TokenIndex.h"
 #include "../compiler/SourceLocationComparator.h"
 #include "bscript/compiler/file/SourceLocation.h"
 
+#include <atomic>
 #include <map>
+#include <memory>
 #include <napi.h>
 #include <set>
+#include <string>
 #include <vector>
 namespace Pol::Bscript::Compiler
 {
@@ -31,9 +40,16 @@ public:
   LSPDocument( const Napi::CallbackInfo& info );
   static Napi::Function GetClass( Napi::Env );
 
+  static LSPDocumentType type_from_pathname( const std::string& pathname );
+
   Napi::Value Analyze( const Napi::CallbackInfo& );
+  Napi::Value AnalyzeAsync( const Napi::CallbackInfo& );
   Napi::Value Diagnostics( const Napi::CallbackInfo& );
   Napi::Value Tokens( const Napi::CallbackInfo& );
+  Napi::Value TokensEncoded( const Napi::CallbackInfo& );
+  Napi::Value TokensInRange( const Napi::CallbackInfo& );
+  Napi::Value SemanticTokens( const Napi::CallbackInfo& );
+  Napi::Value SemanticTokensDelta( const Napi::CallbackInfo& );
   Napi::Value Dependents( const Napi::CallbackInfo& );
   Napi::Value Hover( const Napi::CallbackInfo& );
   Napi::Value Definition( const Napi::CallbackInfo& );
@@ -44,36 +60,79 @@ public:
   Napi::Value BuildReferences( const Napi::CallbackInfo& );
   Napi::Value ToFormattedString( const Napi::CallbackInfo& );
   Napi::Value Symbols( const Napi::CallbackInfo& );
+  Napi::Value MemoryUsage( const Napi::CallbackInfo& );
 
   std::unique_ptr<Pol::Bscript::Compiler::DiagnosticReporter> reporter;
 
+  Napi::Array diagnostics( Napi::Env env );
+
   void accept_visitor(Pol::Bscript::Compiler::NodeVisitor& visitor);
 
   const std::string& pathname();
+  LSPDocumentType document_type() const;
+
+  // Starts a new analysis generation, superseding any analysis in flight.
+  uint64_t begin_analysis();
+  std::shared_ptr<const std::atomic<uint64_t>> latest_analysis() const;
 
-  void add_reference_by( const Pol::Bscript::Compiler::SourceLocation& defined_at,
-                         const Pol::Bscript::Compiler::SourceLocation& used_at );
-  void add_reference_by( const Pol::Bscript::Compiler::Range& defined_at,
-                         const Pol::Bscript::Compiler::SourceLocation& used_at );
-  void add_reference_by( const Pol::Bscript::Compiler::Range& defined_at,
-                         const std::string& used_at_pathname,
-                         const Pol::Bscript::Compiler::Range& used_at_range );
+  // Replaces the results of the previous analysis. Called on the main thread.
+  void apply_analysis(
+      std::unique_ptr<Pol::Bscript::Compiler::DiagnosticReporter> new_reporter,
+      std::unique_ptr<Pol::Bscript::Compiler::Report> new_report,
+      std::unique_ptr<Pol::Bscript::Compiler::CompilerWorkspace> new_compiler_workspace );
 
   void build_references( Pol::Bscript::Compiler::CompilerWorkspace& compiler_workspace );
 
-  std::map<Pol::Bscript::Compiler::Range /*defined at*/,
-           std::set<CompilerExt::ReferenceLocation,
-                    CompilerExt::ReferenceLocationComparator> /*used at*/,
-           CompilerExt::RangeComparator>
-      referenced_by;
+  bool has_compiler_workspace() const { return compiler_workspace != nullptr; }
+  // Drops the compiler workspace and the indices built from it to save
+  // memory. Diagnostics, references and dependencies are kept, and the next
+  // query needing the workspace analyzes the document again.
+  void evict_compiler_workspace();
+
+  // Estimated memory held by the last analysis. Walks its parse tree and AST,
+  // so costs about as much as a semantic tokens request. Main thread only.
+  CompilerExt::DocumentMemoryUsage memory_usage() const;
+  static Napi::Object memory_usage_to_object( Napi::Env env,
+                                              const CompilerExt::DocumentMemoryUsage& usage );
 
 private:
   Napi::Value throwError( const std::string& what );
+  // Analyzes the document on the calling thread. Throws if the compiler does.
+  CompilerExt::AnalysisStats run_analysis( bool continue_on_error );
+  // Re-analyzes the document if its compiler workspace was evicted, and marks
+  // it as recently used. Called by queries before using the workspace.
+  void ensure_analyzed();
+  // Records the results of an analysis in the workspace.
+  void finish_analysis();
+  // Records the files this document's last analysis read in the workspace's
+  // dependency graph.
+  void update_dependencies();
+  // Replaces the compiler workspace, and the token indices built from it.
+  void set_compiler_workspace(
+      std::unique_ptr<Pol::Bscript::Compiler::CompilerWorkspace> new_compiler_workspace );
+  // The encoded semantic tokens, written straight into a new typed array.
+  Napi::Uint32Array encoded_tokens( Napi::Env env ) const;
 
   std::unique_ptr<Pol::Bscript::Compiler::Report> report;
   std::unique_ptr<Pol::Bscript::Compiler::CompilerWorkspace> compiler_workspace;
+  // Sorted semantic and lexer tokens of `compiler_workspace`, built once per
+  // analysis.
+  std::unique_ptr<CompilerExt::SemanticTokensEncoder> semantic_tokens_encoder;
+  std::unique_ptr<CompilerExt::TokenIndex> token_index;
+  std::unique_ptr<CompilerExt::ScopeIndex> scope_index;
   std::string pathname_;
   Napi::ObjectReference workspace;
   LSPDocumentType type;
+  std::shared_ptr<std::atomic<uint64_t>> analysis_generation;
+  bool evicted = false;
+  // Of the last analysis on the main thread, used to analyze again after an
+  // eviction.
+  bool last_continue_on_error = true;
+
+  // The encoded semantic tokens last returned by `semanticTokens()` or
+  // `semanticTokensDelta()`, which the client holds as `semantic_tokens_id`.
+  // Kept as the returned array itself, so it is never copied on our side.
+  Napi::Reference<Napi::Uint32Array> semantic_tokens;
+  std::string semantic_tokens_id;
 };
 }  // namespace VSCodeEscript
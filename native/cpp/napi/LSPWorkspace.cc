@@ -1,5 +1,14 @@
 #include "LSPWorkspace.h"
+#include "../compiler/MemoryUsage.h"
+#include "../misc/Hash.h"
+#include "../misc/MappedFile.h"
+#include "../misc/Tracer.h"
+#include "AnalysisScheduler.h"
+#include "DependentsAnalyzer.h"
+#include "ExtensionConfig.h"
 #include "LSPDocument.h"
+#include "WorkspaceIndexer.h"
+#include "WorkspaceWarmer.h"
 
 #include "bscript/compiler/Compiler.h"
 #include "bscript/compiler/Report.h"
@@ -10,7 +19,10 @@
 #include "plib/pkg.h"
 #include "plib/systemstate.h"
 
+#include <algorithm>
 #include <filesystem>
+#include <future>
+#include <limits>
 #include <set>
 #include <thread>
 
@@ -23,8 +35,11 @@ LSPWorkspace::LSPWorkspace( const Napi::CallbackInfo& info )
     : ObjectWrap( info ),
       SourceFileLoader(),
       _workspaceRoot( "" ),
-      em_parse_tree_cache( *this, profile ),
-      inc_parse_tree_cache( *this, profile )
+      em_parse_tree_cache( std::make_shared<CompilerExt::TrackedSourceFileCache>( *this ) ),
+      inc_parse_tree_cache( std::make_shared<CompilerExt::TrackedSourceFileCache>( *this ) ),
+      references( paths ),
+      main_thread_id( std::this_thread::get_id() ),
+      scheduler( std::make_unique<AnalysisScheduler>( *this ) )
 {
   auto env = info.Env();
 
@@ -38,8 +53,28 @@ LSPWorkspace::LSPWorkspace( const Napi::CallbackInfo& info )
   auto config = info[0].As<Napi::Object>();
   auto getContents_cb = config.Get( "getContents" );
   auto getXmlDocPath_cb = config.Get( "getXmlDocPath" );
+  auto indexCacheDirectory = config.Get( "indexCacheDirectory" );
+  auto analysisDebounceMs = config.Get( "analysisDebounceMs" );
+  auto maxAnalyzedDocuments = config.Get( "maxAnalyzedDocuments" );
+  auto maxAnalyzedBytes = config.Get( "maxAnalyzedBytes" );
 
-  if ( !getContents_cb.IsFunction() )
+  if ( indexCacheDirectory.IsString() )
+    _indexCacheDirectory = indexCacheDirectory.As<Napi::String>().Utf8Value();
+
+  if ( analysisDebounceMs.IsNumber() )
+    scheduler->set_debounce(
+        std::chrono::milliseconds( analysisDebounceMs.As<Napi::Number>().Int64Value() ) );
+
+  // Zero, or no option, means no limit.
+  auto limit = []( const Napi::Value& value )
+  {
+    return value.IsNumber() ? static_cast<size_t>( std::max<int64_t>(
+                                  value.As<Napi::Number>().Int64Value(), 0 ) )
+                            : 0;
+  };
+  analyzed_documents.set_limits( limit( maxAnalyzedDocuments ), limit( maxAnalyzedBytes ) );
+
+  if ( !getContents_cb.IsUndefined() && !getContents_cb.IsFunction() )
   {
     Napi::TypeError::New(
         env, Napi::String::New( env, "Invalid arguments: getContents is not a function" ) )
@@ -47,13 +82,16 @@ LSPWorkspace::LSPWorkspace( const Napi::CallbackInfo& info )
   }
   else
   {
-    GetContents = Napi::Persistent( getContents_cb.As<Napi::Function>() );
+    if ( getContents_cb.IsFunction() )
+      GetContents = Napi::Persistent( getContents_cb.As<Napi::Function>() );
 
     if ( getXmlDocPath_cb.IsFunction() )
       GetXMLDocPath = Napi::Persistent( getXmlDocPath_cb.As<Napi::Function>() );
   }
 }
 
+LSPWorkspace::~LSPWorkspace() = default;
+
 Napi::Function LSPWorkspace::GetClass( Napi::Env env )
 {
   return DefineClass(
@@ -62,41 +100,38 @@ Napi::Function LSPWorkspace::GetClass( Napi::Env env )
         LSPWorkspace::InstanceMethod( "reopen", &LSPWorkspace::Reopen ),
         LSPWorkspace::InstanceMethod( "getConfigValue", &LSPWorkspace::GetConfigValue ),
         LSPWorkspace::InstanceAccessor( "workspaceRoot", &LSPWorkspace::GetWorkspaceRoot, nullptr ),
-        LSPWorkspace::InstanceAccessor( "scripts", &LSPWorkspace::AutoCompiledScripts, nullptr ),
+        LSPWorkspace::InstanceAccessor( "scripts", &LSPWorkspace::GetScripts, nullptr ),
+        LSPWorkspace::InstanceAccessor( "busy", &LSPWorkspace::GetBusy, nullptr ),
         LSPWorkspace::InstanceMethod( "cacheScripts", &LSPWorkspace::CacheCompiledScripts ),
         LSPWorkspace::InstanceMethod( "getDocument", &LSPWorkspace::GetDocument ),
+        LSPWorkspace::InstanceMethod( "indexAll", &LSPWorkspace::IndexAll ),
+        LSPWorkspace::InstanceMethod( "setContents", &LSPWorkspace::SetContents ),
+        LSPWorkspace::InstanceMethod( "removeContents", &LSPWorkspace::RemoveContents ),
+        LSPWorkspace::InstanceMethod( "invalidate", &LSPWorkspace::Invalidate ),
+        LSPWorkspace::InstanceMethod( "dependentsOf", &LSPWorkspace::DependentsOf ),
+        LSPWorkspace::InstanceMethod( "scheduleAnalysis", &LSPWorkspace::ScheduleAnalysis ),
+        LSPWorkspace::InstanceMethod( "analysisMetrics", &LSPWorkspace::GetAnalysisMetrics ),
+        LSPWorkspace::InstanceMethod( "stats", &LSPWorkspace::Stats ),
+        LSPWorkspace::InstanceMethod( "memoryUsage", &LSPWorkspace::MemoryUsage ),
+        LSPWorkspace::InstanceMethod( "reanalyzeDependents", &LSPWorkspace::ReanalyzeDependents ),
+        LSPWorkspace::InstanceMethod( "warmUp", &LSPWorkspace::WarmUp ),
         LSPWorkspace::InstanceAccessor( "autoCompiledScripts", &LSPWorkspace::AutoCompiledScripts,
                                         nullptr ) } );
 }
 
 
-void recurse_collect( const fs::path& basedir, std::set<std::string>* files_src,
-                      std::set<std::string>* files_inc )
+Napi::Array make_pathname_array( Napi::Env env,
+                                 const std::vector<CompilerExt::FileInventory::File>& files )
 {
-  if ( !fs::is_directory( basedir ) )
-    return;
-  std::error_code ec;
-  for ( auto dir_itr = fs::recursive_directory_iterator( basedir, ec );
-        dir_itr != fs::recursive_directory_iterator(); ++dir_itr )
+  auto results = Napi::Array::New( env, files.size() );
+  for ( size_t i = 0; i < files.size(); ++i )
   {
-    if ( auto fn = dir_itr->path().filename().string(); !fn.empty() && *fn.begin() == '.' )
-    {
-      if ( dir_itr->is_directory() )
-        dir_itr.disable_recursion_pending();
-      continue;
-    }
-    else if ( !dir_itr->is_regular_file() )
-      continue;
-    const auto ext = dir_itr->path().extension();
-    if ( !ext.compare( ".inc" ) )
-      files_inc->insert( fs::canonical( dir_itr->path() ).string() );
-    else if ( !ext.compare( ".src" ) || !ext.compare( ".hsr" ) ||
-              ( compilercfg.CompileAspPages && !ext.compare( ".asp" ) ) )
-      files_src->insert( fs::canonical( dir_itr->path() ).string() );
+    results.Set( static_cast<uint32_t>( i ), Napi::String::New( env, files[i].pathname ) );
   }
+  results.Freeze();
+  return results;
 }
 
-
 Napi::Value LSPWorkspace::GetDocument( const Napi::CallbackInfo& info )
 {
   auto env = info.Env();
@@ -108,7 +143,8 @@ Napi::Value LSPWorkspace::GetDocument( const Napi::CallbackInfo& info )
   }
 
   auto path = info[0].As<Napi::String>().Utf8Value();
-  auto existing = _cache.find( path );
+  auto id = paths.intern( path );
+  auto existing = _cache.find( id );
   if ( existing != _cache.end() )
   {
     return existing->second.Value();
@@ -118,14 +154,15 @@ Napi::Value LSPWorkspace::GetDocument( const Napi::CallbackInfo& info )
                               .Get( "LSPDocument" )
                               .As<Napi::Function>();
   auto document = LSPDocument_ctor.New( { Value(), Napi::String::New( env, path ) } );
-  _cache[path] = Persistent( document );
+  _cache[id] = Persistent( document );
   return document;
 }
 
 LSPDocument* LSPWorkspace::create_or_get_from_cache( const std::string& path )
 {
   auto env = Env();
-  auto existing = _cache.find( path );
+  auto id = paths.intern( path );
+  auto existing = _cache.find( id );
   if ( existing != _cache.end() )
   {
     return LSPDocument::Unwrap( existing->second.Value() );
@@ -135,10 +172,436 @@ LSPDocument* LSPWorkspace::create_or_get_from_cache( const std::string& path )
                               .Get( "LSPDocument" )
                               .As<Napi::Function>();
   auto document = LSPDocument_ctor.New( { Value(), Napi::String::New( env, path ) } );
-  _cache[path] = Persistent( document );
+  _cache[id] = Persistent( document );
   return LSPDocument::Unwrap( document );
 }
 
+void LSPWorkspace::document_analyzed( LSPDocument& document )
+{
+  if ( !analyzed_documents.limited() )
+    return;
+
+  auto id = paths.intern( document.pathname() );
+  if ( !document.has_compiler_workspace() )
+  {
+    analyzed_documents.erase( id );
+    return;
+  }
+
+  std::optional<size_t> bytes;
+  if ( analyzed_documents.byte_limited() )
+    bytes = document.memory_usage().total();
+  analyzed_documents.touch( id, bytes );
+
+  auto is_open = [&]( CompilerExt::PathId open_id )
+  { return has_contents( paths.pathname( open_id ) ); };
+  for ( auto evicted_id : analyzed_documents.evict( is_open ) )
+  {
+    auto existing = _cache.find( evicted_id );
+    if ( existing != _cache.end() )
+    {
+      LSPDocument::Unwrap( existing->second.Value() )->evict_compiler_workspace();
+    }
+  }
+}
+
+bool LSPWorkspace::has_contents( const std::string& pathname ) const
+{
+  std::lock_guard<std::mutex> guard( overlay_mutex );
+  return overlays.count( pathname ) > 0;
+}
+
+void LSPWorkspace::document_used( LSPDocument& document )
+{
+  if ( analyzed_documents.limited() )
+    analyzed_documents.touch( paths.intern( document.pathname() ) );
+}
+
+void LSPWorkspace::add_references( const CompilerExt::ReferencesByPathname& references )
+{
+  this->references.add( references );
+}
+
+const CompilerExt::ReferenceStore& LSPWorkspace::reference_store() const
+{
+  return references;
+}
+
+void LSPWorkspace::update_dependencies( const std::string& document,
+                                        const std::vector<std::string>& dependencies )
+{
+  auto document_id = paths.intern( document );
+  auto& previous = dependencies_by_document[document_id];
+  for ( auto dependency : previous )
+  {
+    auto itr = dependents_by_pathname.find( dependency );
+    if ( itr != dependents_by_pathname.end() )
+    {
+      itr->second.erase( document_id );
+      if ( itr->second.empty() )
+        dependents_by_pathname.erase( itr );
+    }
+  }
+
+  previous.clear();
+  for ( const auto& dependency : dependencies )
+  {
+    auto dependency_id = paths.intern( dependency );
+    previous.push_back( dependency_id );
+    dependents_by_pathname[dependency_id].insert( document_id );
+  }
+
+  if ( previous.empty() )
+    dependencies_by_document.erase( document_id );
+}
+
+Napi::Value LSPWorkspace::DependentsOf( const Napi::CallbackInfo& info )
+{
+  auto env = info.Env();
+  if ( info.Length() < 1 || !info[0].IsString() )
+  {
+    Napi::TypeError::New( env, Napi::String::New( env, "Invalid arguments" ) )
+        .ThrowAsJavaScriptException();
+    return Napi::Value();
+  }
+
+  auto id = paths.find( info[0].As<Napi::String>().Utf8Value() );
+  auto itr = id ? dependents_by_pathname.find( *id ) : dependents_by_pathname.end();
+  if ( itr == dependents_by_pathname.end() )
+  {
+    return Napi::Array::New( env );
+  }
+
+  auto results = Napi::Array::New( env, itr->second.size() );
+  uint32_t index = 0;
+  for ( auto dependent : itr->second )
+  {
+    results.Set( index++, Napi::String::New( env, paths.pathname( dependent ) ) );
+  }
+  return results;
+}
+
+Napi::Value LSPWorkspace::ScheduleAnalysis( const Napi::CallbackInfo& info )
+{
+  auto env = info.Env();
+  if ( info.Length() < 1 || !info[0].IsString() ||
+       ( info.Length() > 1 && !info[1].IsUndefined() && !info[1].IsObject() ) )
+  {
+    Napi::TypeError::New( env, Napi::String::New( env, "Invalid arguments" ) )
+        .ThrowAsJavaScriptException();
+    return Napi::Value();
+  }
+
+  auto priority = AnalysisPriority::Foreground;
+  bool continue_on_error = true;
+  if ( info.Length() > 1 && info[1].IsObject() )
+  {
+    auto options = info[1].As<Napi::Object>();
+    auto background = options.Get( "background" );
+    auto continueOnError = options.Get( "continueOnError" );
+    if ( background.IsBoolean() && background.As<Napi::Boolean>().Value() )
+      priority = AnalysisPriority::Background;
+    if ( continueOnError.IsBoolean() )
+      continue_on_error = continueOnError.As<Napi::Boolean>().Value();
+  }
+
+  try
+  {
+    auto* document = create_or_get_from_cache( info[0].As<Napi::String>().Utf8Value() );
+    return scheduler->schedule( env, document, priority, continue_on_error );
+  }
+  catch ( const std::exception& ex )
+  {
+    Napi::Error::New( env, ex.what() ).ThrowAsJavaScriptException();
+  }
+  return Napi::Value();
+}
+
+Napi::Value LSPWorkspace::ReanalyzeDependents( const Napi::CallbackInfo& info )
+{
+  auto env = info.Env();
+  if ( info.Length() < 1 || !info[0].IsString() ||
+       ( info.Length() > 1 && !info[1].IsUndefined() && !info[1].IsObject() ) )
+  {
+    Napi::TypeError::New( env, Napi::String::New( env, "Invalid arguments" ) )
+        .ThrowAsJavaScriptException();
+    return Napi::Value();
+  }
+
+  bool continue_on_error = true;
+  bool open_only = false;
+  unsigned concurrency = 0;
+  if ( info.Length() > 1 && info[1].IsObject() )
+  {
+    auto options = info[1].As<Napi::Object>();
+    auto continueOnError = options.Get( "continueOnError" );
+    auto concurrencyValue = options.Get( "concurrency" );
+    if ( continueOnError.IsBoolean() )
+      continue_on_error = continueOnError.As<Napi::Boolean>().Value();
+    if ( concurrencyValue.IsNumber() )
+      concurrency = concurrencyValue.As<Napi::Number>().Uint32Value();
+    auto openOnly = options.Get( "openOnly" );
+    if ( openOnly.IsBoolean() )
+      open_only = openOnly.As<Napi::Boolean>().Value();
+  }
+
+  auto pathname = info[0].As<Napi::String>().Utf8Value();
+
+  try
+  {
+    std::vector<LSPDocument*> documents;
+    auto id = paths.find( pathname );
+    auto dependents = id ? dependents_by_pathname.find( *id ) : dependents_by_pathname.end();
+    if ( dependents != dependents_by_pathname.end() )
+    {
+      for ( auto dependent : dependents->second )
+      {
+        const auto& dependent_pathname = paths.pathname( dependent );
+        if ( open_only && !has_contents( dependent_pathname ) )
+          continue;
+        documents.push_back( create_or_get_from_cache( dependent_pathname ) );
+      }
+    }
+
+    auto* analyzer = new DependentsAnalyzer( env, this, std::move( pathname ),
+                                             std::move( documents ), continue_on_error,
+                                             concurrency );
+    auto promise = analyzer->GetPromise();
+    analyzer->Queue();
+    return promise;
+  }
+  catch ( const std::exception& ex )
+  {
+    Napi::Error::New( env, ex.what() ).ThrowAsJavaScriptException();
+  }
+  return Napi::Value();
+}
+
+Napi::Value LSPWorkspace::WarmUp( const Napi::CallbackInfo& info )
+{
+  auto env = info.Env();
+  if ( info.Length() > 0 && !info[0].IsUndefined() && !info[0].IsObject() )
+  {
+    Napi::TypeError::New( env, Napi::String::New( env, "Invalid arguments" ) )
+        .ThrowAsJavaScriptException();
+    return Napi::Value();
+  }
+
+  if ( _workspaceRoot.empty() )
+  {
+    Napi::Error::New( env, "Workspace was never open()'ed." ).ThrowAsJavaScriptException();
+    return Napi::Value();
+  }
+
+  unsigned concurrency = 0;
+  if ( info.Length() > 0 && info[0].IsObject() )
+  {
+    auto concurrencyValue = info[0].As<Napi::Object>().Get( "concurrency" );
+    if ( concurrencyValue.IsNumber() )
+      concurrency = concurrencyValue.As<Napi::Number>().Uint32Value();
+  }
+
+  try
+  {
+    std::vector<WorkspaceWarmer::Module> modules;
+    std::error_code ec;
+    for ( const auto& entry : fs::directory_iterator( compilercfg.ModuleDirectory, ec ) )
+    {
+      if ( !entry.is_regular_file( ec ) ||
+           LSPDocument::type_from_pathname( entry.path().string() ) != LSPDocumentType::EM )
+        continue;
+
+      // Named the way the compiler names modules it loads, so analyses find
+      // them in the cache.
+      auto pathname = compilercfg.ModuleDirectory + entry.path().filename().string();
+      auto xml_doc = get_xml_doc_path( pathname );
+      modules.push_back( WorkspaceWarmer::Module{ std::move( pathname ), std::move( xml_doc ) } );
+    }
+
+    auto* warmer = new WorkspaceWarmer( env, this, std::move( modules ), concurrency );
+    auto promise = warmer->GetPromise();
+    warmer->Queue();
+    return promise;
+  }
+  catch ( const std::exception& ex )
+  {
+    Napi::Error::New( env, ex.what() ).ThrowAsJavaScriptException();
+  }
+  return Napi::Value();
+}
+
+Napi::Value LSPWorkspace::GetAnalysisMetrics( const Napi::CallbackInfo& info )
+{
+  auto env = info.Env();
+  auto metrics = scheduler->metrics();
+
+  auto result = Napi::Object::New( env );
+  result["queueDepth"] = Napi::Number::New( env, static_cast<double>( metrics.queue_depth ) );
+  result["running"] = Napi::Boolean::New( env, metrics.running );
+  result["scheduled"] = Napi::Number::New( env, static_cast<double>( metrics.scheduled ) );
+  result["dropped"] = Napi::Number::New( env, static_cast<double>( metrics.dropped ) );
+  result["completed"] = Napi::Number::New( env, static_cast<double>( metrics.completed ) );
+  return result;
+}
+
+void LSPWorkspace::record_analysis( const CompilerExt::AnalysisStats& stats )
+{
+  std::lock_guard<std::mutex> guard( analysis_stats_mutex );
+  analysis_stats += stats;
+}
+
+Napi::Object LSPWorkspace::stats_to_object( Napi::Env env,
+                                            const CompilerExt::AnalysisStats& stats )
+{
+  auto ms = [&]( int64_t micros )
+  { return Napi::Number::New( env, static_cast<double>( micros ) / 1000 ); };
+  auto count = [&]( uint64_t value )
+  { return Napi::Number::New( env, static_cast<double>( value ) ); };
+
+  auto parse_ms = Napi::Object::New( env );
+  parse_ms["src"] = ms( stats.parse_src_micros );
+  parse_ms["inc"] = ms( stats.parse_inc_micros );
+  parse_ms["em"] = ms( stats.parse_em_micros );
+
+  auto parsed_files = Napi::Object::New( env );
+  parsed_files["src"] = count( stats.parse_src_count );
+  parsed_files["inc"] = count( stats.parse_inc_count );
+  parsed_files["em"] = count( stats.parse_em_count );
+
+  auto cache = [&]( const CompilerExt::ParseTreeCacheStats& cache_stats )
+  {
+    auto result = Napi::Object::New( env );
+    result["hits"] = count( cache_stats.hits );
+    result["misses"] = count( cache_stats.misses );
+    return result;
+  };
+
+  auto result = Napi::Object::New( env );
+  result["analyses"] = count( stats.analyses );
+  result["totalMs"] = ms( stats.total_micros );
+  result["buildWorkspaceMs"] = ms( stats.build_workspace_micros );
+  result["parseMs"] = parse_ms;
+  result["parsedFiles"] = parsed_files;
+  result["semanticAnalysisMs"] = ms( stats.semantic_analysis_micros );
+  result["buildReferencesMs"] = ms( stats.build_references_micros );
+  result["emParseTreeCache"] = cache( stats.em_cache );
+  result["incParseTreeCache"] = cache( stats.inc_cache );
+  return result;
+}
+
+Napi::Value LSPWorkspace::Stats( const Napi::CallbackInfo& info )
+{
+  CompilerExt::AnalysisStats stats;
+  {
+    std::lock_guard<std::mutex> guard( analysis_stats_mutex );
+    stats = analysis_stats;
+  }
+  return stats_to_object( info.Env(), stats );
+}
+
+Napi::Value LSPWorkspace::MemoryUsage( const Napi::CallbackInfo& info )
+{
+  auto env = info.Env();
+  CompilerExt::TraceSpan span( "LSPWorkspace::MemoryUsage" );
+  auto bytes = [&]( size_t value )
+  { return Napi::Number::New( env, static_cast<double>( value ) ); };
+  size_t total = 0;
+
+  auto documents = Napi::Array::New( env );
+  for ( const auto& [id, reference] : _cache )
+  {
+    auto usage = LSPDocument::Unwrap( reference.Value() )->memory_usage();
+    auto document = LSPDocument::memory_usage_to_object( env, usage );
+    document["pathname"] = Napi::String::New( env, paths.pathname( id ) );
+    documents[documents.Length()] = document;
+    total += usage.total();
+  }
+
+  // Only the text of cached parse trees is counted, as the trees cannot be
+  // looked at without loading them, which would skew the cache stats.
+  auto parse_tree_cache = [&]( const CompilerExt::TrackedSourceFileCache& cache )
+  {
+    auto files = cache.loaded_files();
+    size_t source_bytes = 0;
+    for ( const auto& file : files )
+    {
+      // The input stream keeps the text as UTF-32.
+      source_bytes += file.characters * sizeof( char32_t );
+    }
+    total += source_bytes;
+    auto result = Napi::Object::New( env );
+    result["files"] = bytes( files.size() );
+    result["sourceBytes"] = bytes( source_bytes );
+    return result;
+  };
+
+  std::shared_ptr<CompilerExt::TrackedSourceFileCache> em_cache, inc_cache;
+  {
+    std::lock_guard<std::mutex> guard( parse_tree_cache_mutex );
+    em_cache = em_parse_tree_cache;
+    inc_cache = inc_parse_tree_cache;
+  }
+
+  size_t contents = 0;
+  {
+    std::lock_guard<std::mutex> guard( overlay_mutex );
+    for ( const auto& [pathname, overlay] : overlays )
+    {
+      contents += CompilerExt::string_memory_usage( pathname ) +
+                  CompilerExt::string_memory_usage( *overlay.text );
+    }
+    contents += CompilerExt::hash_table_memory_usage( overlays );
+  }
+  auto reference_bytes = references.memory_usage() + paths.memory_usage();
+  auto xml_doc_bytes = xml_docs.memory_usage();
+  total += contents + reference_bytes + xml_doc_bytes;
+
+  auto result = Napi::Object::New( env );
+  result["documents"] = documents;
+  result["emParseTreeCache"] = parse_tree_cache( *em_cache );
+  result["incParseTreeCache"] = parse_tree_cache( *inc_cache );
+  result["references"] = bytes( reference_bytes );
+  result["xmlDocs"] = bytes( xml_doc_bytes );
+  result["contents"] = bytes( contents );
+  result["totalBytes"] = bytes( total );
+  return result;
+}
+
+Napi::Value LSPWorkspace::IndexAll( const Napi::CallbackInfo& info )
+{
+  auto env = info.Env();
+
+  if ( ( info.Length() > 0 && !info[0].IsUndefined() && !info[0].IsFunction() ) ||
+       ( info.Length() > 1 && !info[1].IsUndefined() && !info[1].IsObject() ) ||
+       ( info.Length() > 2 && !info[2].IsUndefined() && !info[2].IsNumber() ) )
+  {
+    Napi::TypeError::New( env, Napi::String::New( env, "Invalid arguments" ) )
+        .ThrowAsJavaScriptException();
+    return Napi::Value();
+  }
+
+  auto progress = info.Length() > 0 && info[0].IsFunction() ? info[0].As<Napi::Function>()
+                                                            : Napi::Function();
+  auto signal =
+      info.Length() > 1 && info[1].IsObject() ? info[1].As<Napi::Object>() : Napi::Object();
+  unsigned concurrency =
+      info.Length() > 2 && info[2].IsNumber() ? info[2].As<Napi::Number>().Uint32Value() : 0;
+
+  try
+  {
+    auto* indexer =
+        new WorkspaceIndexer( env, this, concurrency, progress, signal );
+    auto promise = indexer->GetPromise();
+    indexer->Queue();
+    return promise;
+  }
+  catch ( const std::exception& ex )
+  {
+    Napi::Error::New( env, ex.what() ).ThrowAsJavaScriptException();
+  }
+  return Napi::Value();
+}
+
 Napi::Value LSPWorkspace::CacheCompiledScripts( const Napi::CallbackInfo& info )
 {
   auto env = info.Env();
@@ -149,11 +612,7 @@ Napi::Value LSPWorkspace::CacheCompiledScripts( const Napi::CallbackInfo& info )
     return Napi::Value();
   }
 
-  std::set<std::string> files;
-
-  recurse_collect( fs::path( compilercfg.PolScriptRoot ), &files, &files );
-  for ( const auto& pkg : Pol::Plib::systemstate.packages )
-    recurse_collect( fs::path( pkg->dir() ), &files, &files );
+  auto files = file_inventory()->auto_compiled_scripts();
 
   auto LSPWorkspace_ctor = env.GetInstanceData<Napi::Reference<Napi::Object>>()
                                ->Value()
@@ -162,10 +621,11 @@ Napi::Value LSPWorkspace::CacheCompiledScripts( const Napi::CallbackInfo& info )
 
   for ( const auto& path : files )
   {
-    if ( _cache.find( path ) == _cache.end() )
+    auto id = paths.intern( path );
+    if ( _cache.find( id ) == _cache.end() )
     {
       auto document = LSPWorkspace_ctor.New( { Value(), Napi::String::New( env, path ) } );
-      _cache[path] = Persistent( document );
+      _cache[id] = Persistent( document );
       document.Get( "analyze" ).As<Napi::Function>().Call( document, {} );
     }
   }
@@ -181,26 +641,71 @@ Napi::Value LSPWorkspace::AutoCompiledScripts( const Napi::CallbackInfo& info )
     return CompiledScripts.Value();
   }
 
-  std::set<std::string> files;
+  auto env = info.Env();
+  auto files = file_inventory()->auto_compiled_scripts();
+  auto results = Napi::Array::New( env, files.size() );
+  for ( size_t i = 0; i < files.size(); ++i )
+  {
+    results.Set( static_cast<uint32_t>( i ), Napi::String::New( env, files[i] ) );
+  }
 
-  recurse_collect( fs::path( compilercfg.PolScriptRoot ), &files, &files );
-  for ( const auto& pkg : Pol::Plib::systemstate.packages )
-    recurse_collect( fs::path( pkg->dir() ), &files, &files );
+  results.Freeze();
+  CompiledScripts.Reset( results );
+  return results;
+}
 
-  auto env = info.Env();
-  auto results = Napi::Array::New( env );
-  auto push = results.Get( "push" ).As<Napi::Function>();
+Napi::Value LSPWorkspace::GetBusy( const Napi::CallbackInfo& info )
+{
+  return Napi::Boolean::New( info.Env(), has_background_work() );
+}
 
-  for ( const auto& path : files )
+Napi::Value LSPWorkspace::GetScripts( const Napi::CallbackInfo& info )
+{
+  if ( !Scripts.IsEmpty() )
   {
-    push.Call( results, { Napi::String::New( env, path ) } );
+    return Scripts.Value();
   }
 
+  auto env = info.Env();
+  auto files = file_inventory();
+  auto results = Napi::Object::New( env );
+  results["src"] = make_pathname_array( env, files->src() );
+  results["inc"] = make_pathname_array( env, files->inc() );
+  results["em"] = make_pathname_array( env, files->em() );
+
   results.Freeze();
-  CompiledScripts.Reset( results );
+  Scripts.Reset( results );
   return results;
 }
 
+std::shared_ptr<const CompilerExt::FileInventory> LSPWorkspace::file_inventory()
+{
+  if ( !inventory )
+  {
+    set_file_inventory( scan_files() );
+  }
+  return inventory;
+}
+
+void LSPWorkspace::set_file_inventory( std::shared_ptr<const CompilerExt::FileInventory> files )
+{
+  inventory = std::move( files );
+  CompiledScripts.Reset();
+  Scripts.Reset();
+}
+
+std::shared_ptr<const CompilerExt::FileInventory> LSPWorkspace::scan_files(
+    const CompilerExt::FileInventory::Visitor& found )
+{
+  std::vector<fs::path> script_roots{ fs::path( compilercfg.PolScriptRoot ) };
+  for ( const auto& pkg : Pol::Plib::systemstate.packages )
+    script_roots.emplace_back( pkg->dir() );
+
+  return std::make_shared<const CompilerExt::FileInventory>(
+      directory_walker, script_roots, fs::path( compilercfg.ModuleDirectory ),
+      compilercfg.CompileAspPages, found );
+}
+
 Napi::Value LSPWorkspace::Open( const Napi::CallbackInfo& info )
 {
   auto env = info.Env();
@@ -211,6 +716,13 @@ Napi::Value LSPWorkspace::Open( const Napi::CallbackInfo& info )
         .ThrowAsJavaScriptException();
   }
 
+  if ( has_background_work() )
+  {
+    Napi::Error::New( env, "Cannot open() while background work is running." )
+        .ThrowAsJavaScriptException();
+    return Napi::Value();
+  }
+
   _workspaceRoot = std::filesystem::path( info[0].As<Napi::String>().Utf8Value() );
   std::string cfg( ( _workspaceRoot / "scripts" / "ecompile.cfg" ).string() );
 
@@ -228,7 +740,18 @@ Napi::Value LSPWorkspace::Open( const Napi::CallbackInfo& info )
     }
 
     CompiledScripts.Reset();
+    Scripts.Reset();
+    inventory.reset();
+    directory_walker.clear();
     _cache.clear();
+    analyzed_documents.clear();
+    references.clear();
+    dependencies_by_document.clear();
+    dependents_by_pathname.clear();
+    {
+      std::lock_guard<std::mutex> guard( analysis_stats_mutex );
+      analysis_stats = {};
+    }
     Pol::Plib::systemstate.packages.clear();
     Pol::Plib::systemstate.packages_byname.clear();
 
@@ -238,6 +761,8 @@ Napi::Value LSPWorkspace::Open( const Napi::CallbackInfo& info )
     }
     Pol::Plib::replace_packages();
     Pol::Plib::check_package_deps();
+    reset_parse_tree_caches();
+    open_reference_index();
     return env.Undefined();
   }
   catch ( const std::exception& ex )
@@ -264,6 +789,13 @@ Napi::Value LSPWorkspace::Reopen( const Napi::CallbackInfo& info )
     return Napi::Value();
   }
 
+  if ( has_background_work() )
+  {
+    Napi::Error::New( env, "Cannot reopen() while background work is running." )
+        .ThrowAsJavaScriptException();
+    return Napi::Value();
+  }
+
   std::string cfg( ( _workspaceRoot / "scripts" / "ecompile.cfg" ).string() );
 
   try
@@ -313,7 +845,14 @@ Napi::Value LSPWorkspace::Reopen( const Napi::CallbackInfo& info )
     if ( has_changes )
     {
       CompiledScripts.Reset();
+      Scripts.Reset();
+      inventory.reset();
+      directory_walker.clear();
       _cache.clear();
+      analyzed_documents.clear();
+      references.clear();
+      dependencies_by_document.clear();
+      dependents_by_pathname.clear();
       Pol::Plib::systemstate.packages.clear();
       Pol::Plib::systemstate.packages_byname.clear();
 
@@ -323,6 +862,8 @@ Napi::Value LSPWorkspace::Reopen( const Napi::CallbackInfo& info )
       }
       Pol::Plib::replace_packages();
       Pol::Plib::check_package_deps();
+      reset_parse_tree_caches();
+      open_reference_index();
     }
 
     return Napi::Boolean::New( env, has_changes );
@@ -341,6 +882,49 @@ Napi::Value LSPWorkspace::Reopen( const Napi::CallbackInfo& info )
   }
 }
 
+void LSPWorkspace::open_reference_index()
+{
+  if ( _indexCacheDirectory.empty() )
+  {
+    _referenceIndex.reset();
+    return;
+  }
+
+  // Any setting that changes how scripts resolve invalidates the whole index.
+  auto config_hash = CompilerExt::fnv1a_64( compilercfg.ModuleDirectory );
+  config_hash = CompilerExt::fnv1a_64( compilercfg.IncludeDirectory, config_hash );
+  config_hash = CompilerExt::fnv1a_64( compilercfg.PolScriptRoot, config_hash );
+  for ( const auto& packageRoot : compilercfg.PackageRoot )
+  {
+    config_hash = CompilerExt::fnv1a_64( packageRoot, config_hash );
+  }
+  _referenceIndexAllFunctions = gExtensionConfiguration.referenceAllFunctions;
+  config_hash =
+      CompilerExt::fnv1a_64( _referenceIndexAllFunctions ? "all-functions" : "", config_hash );
+  _referenceIndexIncludesOnce = gExtensionConfiguration.indexIncludesOnce;
+  config_hash =
+      CompilerExt::fnv1a_64( _referenceIndexIncludesOnce ? "includes-once" : "", config_hash );
+
+  auto filename =
+      fmt::format( "index-{:016x}.bin", CompilerExt::fnv1a_64( _workspaceRoot.generic_string() ) );
+
+  _referenceIndex = std::make_shared<CompilerExt::ReferenceIndexFile>(
+      ( fs::path( _indexCacheDirectory ) / filename ).string(), config_hash );
+}
+
+std::shared_ptr<CompilerExt::ReferenceIndexFile> LSPWorkspace::reference_index()
+{
+  // `referenceAllFunctions` and `indexIncludesOnce` change which references
+  // are collected for each script.
+  if ( _referenceIndex &&
+       ( _referenceIndexAllFunctions != gExtensionConfiguration.referenceAllFunctions ||
+         _referenceIndexIncludesOnce != gExtensionConfiguration.indexIncludesOnce ) )
+  {
+    open_reference_index();
+  }
+  return _referenceIndex;
+}
+
 void LSPWorkspace::make_absolute( std::string& path )
 {
   std::filesystem::path filepath( path );
@@ -350,7 +934,205 @@ void LSPWorkspace::make_absolute( std::string& path )
   }
 }
 
+Napi::Value LSPWorkspace::SetContents( const Napi::CallbackInfo& info )
+{
+  auto env = info.Env();
+  if ( info.Length() < 2 || !info[0].IsString() || !info[1].IsString() ||
+       ( info.Length() > 2 && !info[2].IsUndefined() && !info[2].IsNumber() ) )
+  {
+    Napi::TypeError::New( env, Napi::String::New( env, "Invalid arguments" ) )
+        .ThrowAsJavaScriptException();
+    return Napi::Value();
+  }
+
+  auto pathname = info[0].As<Napi::String>().Utf8Value();
+  auto text = std::make_shared<const std::string>( info[1].As<Napi::String>().Utf8Value() );
+  int64_t version = info.Length() > 2 && info[2].IsNumber()
+                        ? info[2].As<Napi::Number>().Int64Value()
+                        : std::numeric_limits<int64_t>::min();
+
+  bool changed = true;
+  {
+    std::lock_guard<std::mutex> guard( overlay_mutex );
+    auto existing = overlays.find( pathname );
+    if ( existing != overlays.end() )
+    {
+      // Ignore out-of-order updates for versioned contents.
+      if ( version != std::numeric_limits<int64_t>::min() &&
+           version < existing->second.version )
+      {
+        return Napi::Boolean::New( env, false );
+      }
+      changed = *existing->second.text != *text;
+      existing->second = ContentsOverlay{ std::move( text ), version };
+    }
+    else
+    {
+      overlays.emplace( pathname, ContentsOverlay{ std::move( text ), version } );
+    }
+  }
+
+  if ( changed )
+  {
+    invalidate( pathname );
+  }
+  return Napi::Boolean::New( env, true );
+}
+
+Napi::Value LSPWorkspace::RemoveContents( const Napi::CallbackInfo& info )
+{
+  auto env = info.Env();
+  if ( info.Length() < 1 || !info[0].IsString() )
+  {
+    Napi::TypeError::New( env, Napi::String::New( env, "Invalid arguments" ) )
+        .ThrowAsJavaScriptException();
+    return Napi::Value();
+  }
+
+  auto pathname = info[0].As<Napi::String>().Utf8Value();
+  bool removed;
+  {
+    std::lock_guard<std::mutex> guard( overlay_mutex );
+    removed = overlays.erase( pathname ) > 0;
+  }
+
+  // The contents on disk may differ from the removed ones.
+  if ( removed )
+  {
+    invalidate( pathname );
+  }
+  return Napi::Boolean::New( env, removed );
+}
+
+Napi::Value LSPWorkspace::Invalidate( const Napi::CallbackInfo& info )
+{
+  auto env = info.Env();
+  if ( info.Length() < 1 || !info[0].IsString() )
+  {
+    Napi::TypeError::New( env, Napi::String::New( env, "Invalid arguments" ) )
+        .ThrowAsJavaScriptException();
+    return Napi::Value();
+  }
+
+  return Napi::Boolean::New( env, invalidate( info[0].As<Napi::String>().Utf8Value() ) );
+}
+
+bool LSPWorkspace::invalidate( const std::string& pathname )
+{
+  std::lock_guard<std::mutex> guard( parse_tree_cache_mutex );
+  bool invalidated = false;
+
+  // Compilers still running keep their (stale) caches alive until they finish.
+  if ( em_parse_tree_cache->has_loaded( pathname ) )
+  {
+    em_parse_tree_cache = std::make_shared<CompilerExt::TrackedSourceFileCache>( *this );
+    invalidated = true;
+  }
+  if ( inc_parse_tree_cache->has_loaded( pathname ) )
+  {
+    inc_parse_tree_cache = std::make_shared<CompilerExt::TrackedSourceFileCache>( *this );
+    invalidated = true;
+  }
+  return invalidated;
+}
+
+void LSPWorkspace::preload( const std::string& pathname )
+{
+  auto type = LSPDocument::type_from_pathname( pathname );
+  if ( type == LSPDocumentType::SRC )
+  {
+    return;
+  }
+
+  std::shared_ptr<CompilerExt::TrackedSourceFileCache> cache;
+  {
+    std::lock_guard<std::mutex> guard( parse_tree_cache_mutex );
+    cache = type == LSPDocumentType::EM ? em_parse_tree_cache : inc_parse_tree_cache;
+  }
+
+  Compiler::DiagnosticReporter reporter;
+  Compiler::Report report( reporter );
+  Compiler::SourceFileIdentifier ident( 0, pathname );
+  cache->cache.load( ident, report );
+}
+
+void LSPWorkspace::reset_parse_tree_caches()
+{
+  std::lock_guard<std::mutex> guard( parse_tree_cache_mutex );
+  em_parse_tree_cache = std::make_shared<CompilerExt::TrackedSourceFileCache>( *this );
+  inc_parse_tree_cache = std::make_shared<CompilerExt::TrackedSourceFileCache>( *this );
+}
+
 std::string LSPWorkspace::get_contents( const std::string& pathname ) const
+{
+  CompilerExt::TraceSpan span( "LSPWorkspace::get_contents", pathname );
+  {
+    std::lock_guard<std::mutex> guard( overlay_mutex );
+    auto existing = overlays.find( pathname );
+    if ( existing != overlays.end() )
+    {
+      return *existing->second.text;
+    }
+  }
+
+  if ( GetContents.IsEmpty() )
+  {
+    return get_contents_disk( pathname );
+  }
+  return get_contents_callback( pathname );
+}
+
+std::string LSPWorkspace::get_contents_disk( const std::string& pathname )
+{
+  CompilerExt::MappedFile file;
+  if ( !file.open( pathname ) )
+  {
+    throw std::runtime_error( "Could not get contents of file" );
+  }
+  return std::string( file.view() );
+}
+
+std::string LSPWorkspace::get_contents_callback( const std::string& pathname ) const
+{
+  if ( std::this_thread::get_id() == main_thread_id )
+  {
+    return get_contents_js( pathname );
+  }
+
+  Napi::ThreadSafeFunction tsfn;
+  {
+    std::lock_guard<std::mutex> guard( contents_tsfn_mutex );
+    if ( contents_tsfn_users == 0 )
+    {
+      throw std::runtime_error( "Could not get contents of file: no access to main thread" );
+    }
+    tsfn = contents_tsfn;
+  }
+
+  // Block this worker until the main thread has run the JS callback.
+  std::promise<std::string> contents;
+  auto future = contents.get_future();
+  auto status = tsfn.BlockingCall(
+      [&]( Napi::Env, Napi::Function )
+      {
+        try
+        {
+          contents.set_value( get_contents_js( pathname ) );
+        }
+        catch ( ... )
+        {
+          contents.set_exception( std::current_exception() );
+        }
+      } );
+
+  if ( status != napi_ok )
+  {
+    throw std::runtime_error( "Could not get contents of file" );
+  }
+  return future.get();
+}
+
+std::string LSPWorkspace::get_contents_js( const std::string& pathname ) const
 {
   auto value = GetContents.Call( Value(), { Napi::String::New( Env(), pathname ) } );
   if ( !value.IsString() )
@@ -360,6 +1142,32 @@ std::string LSPWorkspace::get_contents( const std::string& pathname ) const
   return value.As<Napi::String>().Utf8Value();
 }
 
+void LSPWorkspace::acquire_contents_tsfn( Napi::Env env )
+{
+  std::lock_guard<std::mutex> guard( contents_tsfn_mutex );
+  if ( contents_tsfn_users++ == 0 && !GetContents.IsEmpty() )
+  {
+    contents_tsfn = Napi::ThreadSafeFunction::New( env, GetContents.Value(),
+                                                   "LSPWorkspace::getContents", 0, 1 );
+  }
+}
+
+bool LSPWorkspace::has_background_work() const
+{
+  std::lock_guard<std::mutex> guard( contents_tsfn_mutex );
+  return contents_tsfn_users > 0;
+}
+
+void LSPWorkspace::release_contents_tsfn()
+{
+  std::lock_guard<std::mutex> guard( contents_tsfn_mutex );
+  if ( contents_tsfn_users > 0 && --contents_tsfn_users == 0 && !GetContents.IsEmpty() )
+  {
+    contents_tsfn.Release();
+    contents_tsfn = Napi::ThreadSafeFunction();
+  }
+}
+
 std::optional<std::string> LSPWorkspace::get_xml_doc_path( const std::string& moduleEmFile ) const
 {
   if ( GetXMLDocPath.IsEmpty() )
@@ -375,11 +1183,93 @@ std::optional<std::string> LSPWorkspace::get_xml_doc_path( const std::string& mo
   return value.As<Napi::String>().Utf8Value();
 }
 
+std::shared_ptr<const CompilerExt::XmlDocParser> LSPWorkspace::get_xml_doc(
+    const std::string& moduleEmFile, const std::string& function_name )
+{
+  auto xmlDoc = get_xml_doc_path( moduleEmFile );
+  if ( !xmlDoc.has_value() )
+    return {};
+
+  return xml_docs.get( xmlDoc.value(), function_name );
+}
+
+
+std::shared_ptr<Compiler::Compiler> LSPWorkspace::make_compiler(
+    CompilerExt::AnalysisProfiler* profiler )
+{
+  return make_compiler( *this, profiler );
+}
+
+std::shared_ptr<Compiler::Compiler> LSPWorkspace::make_compiler(
+    Compiler::SourceFileLoader& loader, CompilerExt::AnalysisProfiler* profiler )
+{
+  struct CompilerWithCaches
+  {
+    std::shared_ptr<CompilerExt::TrackedSourceFileCache> em_cache;
+    std::shared_ptr<CompilerExt::TrackedSourceFileCache> inc_cache;
+    std::unique_ptr<Compiler::Compiler> compiler;
+  };
+
+  auto holder = std::make_shared<CompilerWithCaches>();
+  {
+    std::lock_guard<std::mutex> guard( parse_tree_cache_mutex );
+    holder->em_cache = em_parse_tree_cache;
+    holder->inc_cache = inc_parse_tree_cache;
+  }
+  if ( profiler )
+  {
+    profiler->start( holder->em_cache, holder->inc_cache );
+  }
+  holder->compiler = std::make_unique<Compiler::Compiler>(
+      loader, holder->em_cache->cache, holder->inc_cache->cache,
+      profiler ? profiler->profile() : profile );
+  return std::shared_ptr<Compiler::Compiler>( holder, holder->compiler.get() );
+}
 
-std::unique_ptr<Compiler::Compiler> LSPWorkspace::make_compiler()
+AnalysisOptions LSPWorkspace::analysis_options( const std::string& pathname,
+                                                bool continue_on_error )
 {
-  return std::make_unique<Compiler::Compiler>( *this, em_parse_tree_cache, inc_parse_tree_cache,
-                                               profile );
+  return analysis_options( pathname, continue_on_error,
+                           gExtensionConfiguration.referenceAllFunctions );
+}
+
+AnalysisOptions LSPWorkspace::analysis_options( const std::string& pathname,
+                                                bool continue_on_error,
+                                                bool reference_all_functions )
+{
+  auto type = LSPDocument::type_from_pathname( pathname );
+  return AnalysisOptions{ type == LSPDocumentType::INC || reference_all_functions,
+                          type == LSPDocumentType::EM, continue_on_error };
+}
+
+LSPWorkspace::AnalysisResult LSPWorkspace::run_analysis(
+    const std::string& pathname, const AnalysisOptions& options,
+    Compiler::SourceFileLoader& loader, Compiler::Report& report,
+    CompilerExt::AnalysisProfiler& profiler, CompilerExt::ReferencesByPathname& references,
+    const std::function<bool()>& superseded,
+    const std::function<bool( const Compiler::SourceFileIdentifier& )>& skip_file )
+{
+  auto compiler = make_compiler( loader, &profiler );
+  if ( options.include_compile_mode )
+  {
+    compiler->set_include_compile_mode();
+  }
+
+  AnalysisResult result;
+  result.compiler_workspace =
+      compiler->analyze( pathname, report, options.is_module, options.continue_on_error );
+
+  profiler.start_build_references();
+  if ( result.compiler_workspace && !( superseded && superseded() ) )
+  {
+    if ( skip_file )
+      CompilerExt::ReferencesBuilder::collect( *result.compiler_workspace, references, skip_file );
+    else
+      CompilerExt::ReferencesBuilder::collect( *result.compiler_workspace, references );
+  }
+  result.stats = profiler.finish();
+  record_analysis( result.stats );
+  return result;
 }
 
 Napi::Value LSPWorkspace::GetWorkspaceRoot( const Napi::CallbackInfo& info )
@@ -3,29 +3,47 @@
 
 #include <filesystem>
 #include <functional>
-#include <map>
+#include <memory>
 #include <mutex>
 #include <napi.h>
 #include <optional>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#include "../compiler/AnalysisProfiler.h"
+#include "../compiler/ReferenceIndexFile.h"
+#include "../compiler/ReferenceStore.h"
+#include "../compiler/ReferencesBuilder.h"
+#include "../compiler/TrackedSourceFileCache.h"
+#include "../misc/DirectoryWalker.h"
+#include "../misc/FileInventory.h"
+#include "../misc/LruBudget.h"
+#include "../misc/PathTable.h"
+#include "../misc/XmlDocCache.h"
+#include "AnalysisOptions.h"
 #include "bscript/compiler/Profile.h"
-#include "bscript/compiler/file/SourceFileCache.h"
 #include "bscript/compiler/file/SourceFileLoader.h"
 
 namespace Pol::Bscript::Compiler
 {
 class Compiler;
-}
+class CompilerWorkspace;
+class Report;
+class SourceFileIdentifier;
+}  // namespace Pol::Bscript::Compiler
 
 namespace VSCodeEscript
 {
+class AnalysisScheduler;
 class LSPDocument;
 class LSPWorkspace : public Napi::ObjectWrap<LSPWorkspace>,
                      public Pol::Bscript::Compiler::SourceFileLoader
 {
 public:
   LSPWorkspace( const Napi::CallbackInfo& info );
+  ~LSPWorkspace();
   static Napi::Function GetClass( Napi::Env );
 
   Napi::Value Open( const Napi::CallbackInfo& );
@@ -33,27 +51,194 @@ public:
   Napi::Value GetConfigValue( const Napi::CallbackInfo& );
   Napi::Value GetWorkspaceRoot( const Napi::CallbackInfo& );
   Napi::Value AutoCompiledScripts( const Napi::CallbackInfo& );
+  Napi::Value GetScripts( const Napi::CallbackInfo& );
+  Napi::Value GetBusy( const Napi::CallbackInfo& );
   Napi::Value CacheCompiledScripts( const Napi::CallbackInfo& );
   Napi::Value GetDocument( const Napi::CallbackInfo& );
+  Napi::Value IndexAll( const Napi::CallbackInfo& );
+  Napi::Value SetContents( const Napi::CallbackInfo& );
+  Napi::Value RemoveContents( const Napi::CallbackInfo& );
+  Napi::Value Invalidate( const Napi::CallbackInfo& );
+  Napi::Value DependentsOf( const Napi::CallbackInfo& );
+  Napi::Value ScheduleAnalysis( const Napi::CallbackInfo& );
+  Napi::Value ReanalyzeDependents( const Napi::CallbackInfo& );
+  Napi::Value WarmUp( const Napi::CallbackInfo& );
+  Napi::Value GetAnalysisMetrics( const Napi::CallbackInfo& );
+  Napi::Value Stats( const Napi::CallbackInfo& );
+  Napi::Value MemoryUsage( const Napi::CallbackInfo& );
 
+  // May be called from any thread. Contents set via `setContents()` are used
+  // first, then the `getContents` callback if one was given, then the file on
+  // disk. Off the main thread, the callback is invoked through a thread-safe
+  // function, which must have been acquired via `acquire_contents_tsfn()`.
   std::string get_contents( const std::string& pathname ) const override;
 
+  // Whether contents were set for `pathname` via `setContents()`, ie. it is
+  // open in the editor. May be called from any thread.
+  bool has_contents( const std::string& pathname ) const;
+
+  // Held by every background worker and scheduled analysis while it runs.
+  void acquire_contents_tsfn( Napi::Env env );
+  void release_contents_tsfn();
+  // Whether any background worker or scheduled analysis is running. They use
+  // the compiler configuration, packages and caches `open()` and `reopen()`
+  // replace, so these refuse to run meanwhile.
+  bool has_background_work() const;
+
   std::optional<std::string> get_xml_doc_path( const std::string& moduleEmFile ) const;
 
-  std::unique_ptr<Pol::Bscript::Compiler::Compiler> make_compiler();
+  // The documentation of `function_name` in the XML file of module
+  // `moduleEmFile`, or nullptr if there is none. Parsed files are cached.
+  std::shared_ptr<const CompilerExt::XmlDocParser> get_xml_doc( const std::string& moduleEmFile,
+                                                                const std::string& function_name );
+  CompilerExt::XmlDocCache& xml_doc_cache() { return xml_docs; }
+
+  // The compiler keeps the parse tree caches it was created with alive, even
+  // if they are replaced by `invalidate()` while it runs. If `profiler` is
+  // given, the compiler records its phases there, so it must outlive the
+  // compiler. May be called from any thread.
+  std::shared_ptr<Pol::Bscript::Compiler::Compiler> make_compiler(
+      CompilerExt::AnalysisProfiler* profiler = nullptr );
+  // A compiler reading source files through `loader` instead of the
+  // workspace. Cached .em and .inc parse trees are still shared.
+  std::shared_ptr<Pol::Bscript::Compiler::Compiler> make_compiler(
+      Pol::Bscript::Compiler::SourceFileLoader& loader,
+      CompilerExt::AnalysisProfiler* profiler = nullptr );
+
+  // How to analyze `pathname` with the current extension configuration. Main
+  // thread only; workers read the configuration up front and pass
+  // `reference_all_functions` to the second form.
+  static AnalysisOptions analysis_options( const std::string& pathname, bool continue_on_error );
+  static AnalysisOptions analysis_options( const std::string& pathname, bool continue_on_error,
+                                           bool reference_all_functions );
+
+  struct AnalysisResult
+  {
+    std::unique_ptr<Pol::Bscript::Compiler::CompilerWorkspace> compiler_workspace;
+    CompilerExt::AnalysisStats stats;
+  };
+
+  // Analyzes `pathname`, reading source files through `loader` and reporting
+  // into `report`. Unless `superseded` returns true once the compiler
+  // finished, collects the references found into `references`, skipping the
+  // included files `skip_file` returns true for. Records the stats of the
+  // analysis, of which `profiler` keeps the parse tree caches used. May be
+  // called from any thread.
+  AnalysisResult run_analysis(
+      const std::string& pathname, const AnalysisOptions& options,
+      Pol::Bscript::Compiler::SourceFileLoader& loader, Pol::Bscript::Compiler::Report& report,
+      CompilerExt::AnalysisProfiler& profiler, CompilerExt::ReferencesByPathname& references,
+      const std::function<bool()>& superseded = {},
+      const std::function<bool( const Pol::Bscript::Compiler::SourceFileIdentifier& )>&
+          skip_file = {} );
+
+  // Adds the stats of an analysis to the totals returned by `stats()`. May be
+  // called from any thread.
+  void record_analysis( const CompilerExt::AnalysisStats& stats );
+  static Napi::Object stats_to_object( Napi::Env env, const CompilerExt::AnalysisStats& stats );
+
+  // Parses an .inc or .em file into its parse tree cache, if not cached yet.
+  // May be called from any thread.
+  void preload( const std::string& pathname );
+
+  // Drops cached parse trees that depend on `pathname`. Returns whether any
+  // cache was dropped.
+  bool invalidate( const std::string& pathname );
 
   LSPDocument* create_or_get_from_cache( const std::string& pathname );
 
+  // Keep the compiler workspaces of at most `maxAnalyzedDocuments` documents,
+  // or `maxAnalyzedBytes` by their estimated memory usage, if either option
+  // was given. Documents with contents set via `setContents()` are open in
+  // the editor, so they are always kept and not counted. Main thread only.
+  //
+  // Called after every analysis of `document`; evicts the compiler
+  // workspaces of the least recently used documents over the limits.
+  void document_analyzed( LSPDocument& document );
+  // Called whenever a query uses the compiler workspace of `document`.
+  void document_used( LSPDocument& document );
+
+  // May be called from any thread.
+  void add_references( const CompilerExt::ReferencesByPathname& references );
+  const CompilerExt::ReferenceStore& reference_store() const;
+
+  // Replaces the files `document` depends on in the reverse dependency graph.
+  // Called on the main thread after every analysis.
+  void update_dependencies( const std::string& document,
+                            const std::vector<std::string>& dependencies );
+
+  // The on-disk reference index for the current configuration, or nullptr if
+  // no `indexCacheDirectory` was given.
+  std::shared_ptr<CompilerExt::ReferenceIndexFile> reference_index();
+
+  // The scripts, includes and modules found by the last walk of the
+  // workspace's directories, walking them first if there is no inventory yet.
+  // Main thread only.
+  std::shared_ptr<const CompilerExt::FileInventory> file_inventory();
+  // Replaces the inventory returned by `file_inventory()`. Main thread only.
+  void set_file_inventory( std::shared_ptr<const CompilerExt::FileInventory> files );
+  // Walks the workspace's directories, calling `found` with each file as it
+  // is found. May be called from any thread while the workspace is not
+  // (re)opened, which `open()` and `reopen()` ensure for background workers.
+  std::shared_ptr<const CompilerExt::FileInventory> scan_files(
+      const CompilerExt::FileInventory::Visitor& found = {} );
+
 private:
   void make_absolute( std::string& path );
+  void open_reference_index();
+  std::string get_contents_js( const std::string& pathname ) const;
+  std::string get_contents_callback( const std::string& pathname ) const;
+  static std::string get_contents_disk( const std::string& pathname );
+
+  struct ContentsOverlay
+  {
+    std::shared_ptr<const std::string> text;
+    int64_t version;
+  };
 
   std::filesystem::path _workspaceRoot;
-  std::map<std::string, Napi::ObjectReference> _cache;
+  CompilerExt::PathTable paths;
+  std::unordered_map<CompilerExt::PathId, Napi::ObjectReference> _cache;
   Pol::Bscript::Compiler::Profile profile;
-  Pol::Bscript::Compiler::SourceFileCache em_parse_tree_cache;
-  Pol::Bscript::Compiler::SourceFileCache inc_parse_tree_cache;
+  void reset_parse_tree_caches();
+
+  mutable std::mutex parse_tree_cache_mutex;
+  std::shared_ptr<CompilerExt::TrackedSourceFileCache> em_parse_tree_cache;
+  std::shared_ptr<CompilerExt::TrackedSourceFileCache> inc_parse_tree_cache;
   Napi::FunctionReference GetContents;
   Napi::FunctionReference GetXMLDocPath;
+  CompilerExt::XmlDocCache xml_docs;
   Napi::ObjectReference CompiledScripts;
+  Napi::ObjectReference Scripts;
+  CompilerExt::DirectoryWalker directory_walker;
+  std::shared_ptr<const CompilerExt::FileInventory> inventory;
+  std::string _indexCacheDirectory;
+  std::shared_ptr<CompilerExt::ReferenceIndexFile> _referenceIndex;
+  bool _referenceIndexAllFunctions = false;
+  bool _referenceIndexIncludesOnce = false;
+  CompilerExt::ReferenceStore references;
+  // The documents holding a compiler workspace, if their number or size is
+  // limited.
+  CompilerExt::LruBudget analyzed_documents;
+
+  mutable std::mutex analysis_stats_mutex;
+  CompilerExt::AnalysisStats analysis_stats;
+
+  // Document -> files its last analysis read, and the reverse.
+  std::unordered_map<CompilerExt::PathId, std::vector<CompilerExt::PathId>>
+      dependencies_by_document;
+  std::unordered_map<CompilerExt::PathId, std::unordered_set<CompilerExt::PathId>>
+      dependents_by_pathname;
+
+  mutable std::mutex overlay_mutex;
+  std::unordered_map<std::string, ContentsOverlay> overlays;
+
+  std::thread::id main_thread_id;
+  mutable std::mutex contents_tsfn_mutex;
+  Napi::ThreadSafeFunction contents_tsfn;
+  size_t contents_tsfn_users = 0;
+
+  // Declared last, so its thread stops before anything it uses is destroyed.
+  std::unique_ptr<AnalysisScheduler> scheduler;
 };
 }  // namespace VSCodeEscript
\ No newline at end of file
@@ -0,0 +1,66 @@
+#include "Tracing.h"
+
+#include "../misc/Tracer.h"
+
+namespace VSCodeEscript
+{
+Napi::Value Tracing::Start( const Napi::CallbackInfo& info )
+{
+  auto env = info.Env();
+  size_t capacity = CompilerExt::Tracer::default_capacity;
+
+  if ( info.Length() > 0 && !info[0].IsUndefined() )
+  {
+    auto capacity_value =
+        info[0].IsObject() ? info[0].As<Napi::Object>().Get( "capacity" ) : Napi::Value();
+    if ( capacity_value.IsNumber() )
+    {
+      capacity = capacity_value.As<Napi::Number>().Uint32Value();
+    }
+    else if ( !info[0].IsObject() || !capacity_value.IsUndefined() )
+    {
+      Napi::TypeError::New( env, Napi::String::New( env, "Invalid arguments" ) )
+          .ThrowAsJavaScriptException();
+      return Napi::Value();
+    }
+  }
+
+  CompilerExt::Tracer::instance().start( capacity );
+  return env.Undefined();
+}
+
+Napi::Value Tracing::Stop( const Napi::CallbackInfo& info )
+{
+  CompilerExt::Tracer::instance().stop();
+  return info.Env().Undefined();
+}
+
+Napi::Value Tracing::Enabled( const Napi::CallbackInfo& info )
+{
+  return Napi::Boolean::New( info.Env(), CompilerExt::Tracer::instance().enabled() );
+}
+
+Napi::Value Tracing::Write( const Napi::CallbackInfo& info )
+{
+  auto env = info.Env();
+
+  if ( info.Length() < 1 || !info[0].IsString() )
+  {
+    Napi::TypeError::New( env, Napi::String::New( env, "Invalid arguments" ) )
+        .ThrowAsJavaScriptException();
+    return Napi::Value();
+  }
+
+  try
+  {
+    auto written =
+        CompilerExt::Tracer::instance().write_json( info[0].As<Napi::String>().Utf8Value() );
+    return Napi::Number::New( env, static_cast<double>( written ) );
+  }
+  catch ( const std::exception& ex )
+  {
+    Napi::Error::New( env, ex.what() ).ThrowAsJavaScriptException();
+  }
+  return Napi::Value();
+}
+}  // namespace VSCodeEscript
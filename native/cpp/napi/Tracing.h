@@ -0,0 +1,20 @@
+#pragma once
+
+#include <napi.h>
+
+namespace VSCodeEscript
+{
+// The `Tracing` export, controlling `CompilerExt::Tracer`.
+class Tracing
+{
+public:
+  // `start({ capacity? })`: starts recording spans.
+  static Napi::Value Start( const Napi::CallbackInfo& info );
+  // `stop()`: stops recording spans. Recorded spans can still be written.
+  static Napi::Value Stop( const Napi::CallbackInfo& info );
+  static Napi::Value Enabled( const Napi::CallbackInfo& info );
+  // `write(filename)`: writes the spans recorded since `start()` as Chrome
+  // trace events, and returns their number.
+  static Napi::Value Write( const Napi::CallbackInfo& info );
+};
+}  // namespace VSCodeEscript
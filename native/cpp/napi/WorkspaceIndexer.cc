@@ -0,0 +1,423 @@
+#include "WorkspaceIndexer.h"
+
+#include "../misc/Hash.h"
+#include "../misc/Parallel.h"
+#include "../misc/Tracer.h"
+#include "ExtensionConfig.h"
+#include "LSPDocument.h"
+#include "LSPWorkspace.h"
+
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <thread>
+
+#include "bscript/compiler/Compiler.h"
+#include "bscript/compiler/Report.h"
+#include "bscript/compiler/file/SourceFileIdentifier.h"
+#include "bscript/compiler/file/SourceFileLoader.h"
+#include "bscript/compiler/model/CompilerWorkspace.h"
+
+using namespace Pol::Bscript;
+
+namespace VSCodeEscript
+{
+namespace
+{
+// Reads files through the workspace, remembering the hash of the text served
+// for each, which may come from an overlay or the `getContents` callback
+// rather than the file on disk.
+class HashingSourceFileLoader : public Compiler::SourceFileLoader
+{
+public:
+  explicit HashingSourceFileLoader( const LSPWorkspace& lsp_workspace )
+      : lsp_workspace( lsp_workspace )
+  {
+  }
+
+  std::string get_contents( const std::string& pathname ) const override
+  {
+    auto contents = lsp_workspace.get_contents( pathname );
+    auto hash = CompilerExt::fnv1a_64( contents );
+    std::lock_guard<std::mutex> guard( mutex );
+    hashes[pathname] = hash;
+    return contents;
+  }
+
+  std::optional<uint64_t> contents_hash( const std::string& pathname ) const
+  {
+    std::lock_guard<std::mutex> guard( mutex );
+    auto itr = hashes.find( pathname );
+    if ( itr == hashes.end() )
+      return {};
+    return itr->second;
+  }
+
+private:
+  const LSPWorkspace& lsp_workspace;
+  mutable std::mutex mutex;
+  mutable std::unordered_map<std::string, uint64_t> hashes;
+};
+}  // namespace
+
+WorkspaceIndexer::WorkspaceIndexer( Napi::Env env, LSPWorkspace* lsp_workspace,
+                                    unsigned concurrency, Napi::Function progress,
+                                    Napi::Object signal )
+    : AsyncProgressQueueWorker( env ),
+      lsp_workspace( lsp_workspace ),
+      workspace( Napi::Persistent( lsp_workspace->Value() ) ),
+      deferred( Napi::Promise::Deferred::New( env ) ),
+      concurrency( concurrency ? concurrency : CompilerExt::default_concurrency() ),
+      reference_all_functions( gExtensionConfiguration.referenceAllFunctions ),
+      include_once( gExtensionConfiguration.indexIncludesOnce ),
+      reference_index( lsp_workspace->reference_index() ),
+      canceled( false )
+{
+  if ( !progress.IsEmpty() )
+    this->progress = Napi::Persistent( progress );
+  if ( !signal.IsEmpty() )
+    this->signal = Napi::Persistent( signal );
+
+  lsp_workspace->acquire_contents_tsfn( env );
+}
+
+Napi::Promise WorkspaceIndexer::GetPromise() const
+{
+  return deferred.Promise();
+}
+
+void WorkspaceIndexer::index_file( const std::string& pathname,
+                                   CompilerExt::ReferencesByPathname& references,
+                                   IndexEntries* entries )
+{
+  CompilerExt::TraceSpan span( "WorkspaceIndexer::index_file", pathname );
+  Compiler::DiagnosticReporter reporter;
+  Compiler::Report report( reporter );
+
+  std::function<bool( const Compiler::SourceFileIdentifier& )> skip_file;
+  if ( include_once && LSPDocument::type_from_pathname( pathname ) == LSPDocumentType::SRC )
+  {
+    skip_file = [&]( const Compiler::SourceFileIdentifier& ident )
+    { return is_indexed_include( ident.pathname ); };
+  }
+
+  CompilerExt::AnalysisProfiler profiler;
+  HashingSourceFileLoader loader( *lsp_workspace );
+  CompilerExt::ReferenceIndexEntry entry;
+  auto analysis = lsp_workspace->run_analysis(
+      pathname, LSPWorkspace::analysis_options( pathname, true, reference_all_functions ), loader,
+      report, profiler, entry.references, {}, skip_file );
+  if ( !analysis.compiler_workspace )
+  {
+    return;
+  }
+
+  if ( entries )
+  {
+    std::set<std::string> dependencies{ pathname };
+    for ( const auto& identifier : analysis.compiler_workspace->referenced_source_file_identifiers )
+    {
+      dependencies.insert( identifier->pathname );
+    }
+    for ( const auto& dependency : dependencies )
+    {
+      // The entry is only valid if the analyzed text is what is on disk: it may
+      // instead have come from an unsaved document, the `getContents`
+      // callback, or a cached parse tree of an older version of the file.
+      auto stamp = stamps.get( dependency );
+      auto hash = loader.contents_hash( dependency );
+      if ( !hash )
+        hash = profiler.contents_hash( dependency );
+      if ( !stamp || !hash || *hash != stamp->hash )
+      {
+        entries = nullptr;
+        break;
+      }
+      entry.dependencies.emplace_back( dependency, *stamp );
+    }
+  }
+
+  if ( entries )
+  {
+    auto copy = entry.references;
+    CompilerExt::merge_references( references, std::move( copy ) );
+    entries->emplace_back( pathname, std::move( entry ) );
+  }
+  else
+  {
+    CompilerExt::merge_references( references, std::move( entry.references ) );
+  }
+}
+
+void WorkspaceIndexer::walk()
+{
+  struct WalkCanceled
+  {
+  };
+
+  try
+  {
+    inventory = lsp_workspace->scan_files(
+        [&]( auto kind, const auto& file )
+        {
+          if ( canceled )
+            throw WalkCanceled();
+          found( kind, file );
+        } );
+  }
+  catch ( const WalkCanceled& )
+  {
+  }
+
+  {
+    std::lock_guard<std::mutex> guard( queue_mutex );
+    walk_finished = true;
+  }
+  queue_ready.notify_all();
+}
+
+void WorkspaceIndexer::found( CompilerExt::FileInventory::Kind kind,
+                              const CompilerExt::FileInventory::File& file )
+{
+  using Kind = CompilerExt::FileInventory::Kind;
+
+  // The walk just read the sizes and modification times, so stamping new
+  // index entries does not stat the files again.
+  stamps.prime( file.pathname, file.size, file.mtime );
+  if ( kind == Kind::EM )
+    return;
+
+  {
+    std::lock_guard<std::mutex> guard( queue_mutex );
+    // Symlinks may lead to the same file twice.
+    if ( !queued.insert( file.pathname ).second )
+      return;
+    if ( kind == Kind::INC )
+    {
+      queued_inc.push_back( file.pathname );
+      if ( include_once )
+        indexed_includes.insert( file.pathname );
+    }
+    else
+    {
+      queued_src.push_back( file.pathname );
+    }
+  }
+  queue_ready.notify_one();
+}
+
+std::optional<std::string> WorkspaceIndexer::next_file()
+{
+  std::unique_lock<std::mutex> lock( queue_mutex );
+  for ( ;; )
+  {
+    if ( canceled )
+      return {};
+
+    // Sources are the entry points most requests are about, so index them
+    // first, unless they have to wait for all includes to be known.
+    if ( !queued_src.empty() && ( walk_finished || !include_once ) )
+    {
+      auto pathname = std::move( queued_src.front() );
+      queued_src.pop_front();
+      return pathname;
+    }
+    if ( !queued_inc.empty() )
+    {
+      auto pathname = std::move( queued_inc.front() );
+      queued_inc.pop_front();
+      return pathname;
+    }
+    if ( walk_finished )
+      return {};
+
+    // Woken by the walk, or polled so a cancellation is noticed.
+    queue_ready.wait_for( lock, std::chrono::milliseconds( 100 ) );
+  }
+}
+
+void WorkspaceIndexer::Execute( const ExecutionProgress& execution_progress )
+{
+  std::unique_lock<std::mutex> index_lock;
+  if ( reference_index )
+  {
+    index_lock = std::unique_lock<std::mutex>( reference_index->mutex() );
+    reference_index->load( stamps );
+  }
+
+  std::exception_ptr walk_error;
+  std::thread walker(
+      [&]()
+      {
+        try
+        {
+          walk();
+        }
+        catch ( ... )
+        {
+          walk_error = std::current_exception();
+          {
+            std::lock_guard<std::mutex> guard( queue_mutex );
+            walk_finished = true;
+          }
+          queue_ready.notify_all();
+        }
+      } );
+
+  std::vector<CompilerExt::ReferencesByPathname> worker_references( concurrency );
+  std::vector<IndexEntries> worker_entries( reference_index ? concurrency : 0 );
+  std::atomic<size_t> processed = 0;
+  std::atomic<size_t> total = 0;
+
+  // Each worker takes files from the walk's queue until it is drained.
+  CompilerExt::parallel_for(
+      concurrency, concurrency,
+      [&]( size_t, unsigned worker )
+      {
+        while ( auto pathname = next_file() )
+        {
+          // The index was loaded before the walk started; entries are only
+          // read here, and updated once all workers have finished.
+          if ( reference_index && reference_index->contains( *pathname ) )
+          {
+            reference_index->read_references( *pathname, worker_references[worker] );
+            continue;
+          }
+
+          ++total;
+          try
+          {
+            index_file( *pathname, worker_references[worker],
+                        reference_index ? &worker_entries[worker] : nullptr );
+          }
+          catch ( ... )
+          {
+            // A file failing to analyze should not fail the whole index.
+          }
+
+          IndexProgress current{ ++processed, total };
+          execution_progress.Send( &current, 1 );
+        }
+      } );
+
+  walker.join();
+  if ( walk_error )
+    std::rethrow_exception( walk_error );
+
+  // Files indexed before a cancellation still provide valid references. The
+  // store is sharded, so the buffers can be added in parallel as well.
+  CompilerExt::parallel_for( worker_references.size(), concurrency,
+                             [&]( size_t index, unsigned )
+                             {
+                               lsp_workspace->add_references( worker_references[index] );
+                               worker_references[index].clear();
+                             } );
+
+  if ( reference_index )
+  {
+    for ( auto& entries : worker_entries )
+    {
+      for ( auto& [pathname, entry] : entries )
+      {
+        reference_index->update( pathname, std::move( entry ) );
+      }
+    }
+    // Only a complete walk tells which scripts no longer exist.
+    if ( !canceled )
+      reference_index->retain( queued );
+    reference_index->save();
+  }
+}
+
+bool WorkspaceIndexer::is_indexed_include( const std::string& pathname )
+{
+  {
+    std::lock_guard<std::mutex> guard( indexed_include_mutex );
+    auto itr = indexed_include_by_pathname.find( pathname );
+    if ( itr != indexed_include_by_pathname.end() )
+      return itr->second;
+  }
+
+  // The compiler may spell the path differently from the directory walk.
+  std::error_code ec;
+  auto canonical = std::filesystem::weakly_canonical( pathname, ec );
+  bool result = !ec && indexed_includes.count( canonical.string() ) > 0;
+
+  std::lock_guard<std::mutex> guard( indexed_include_mutex );
+  indexed_include_by_pathname.emplace( pathname, result );
+  return result;
+}
+
+bool WorkspaceIndexer::is_aborted()
+{
+  return !signal.IsEmpty() && signal.Value().Get( "aborted" ).ToBoolean().Value();
+}
+
+void WorkspaceIndexer::OnProgress( const IndexProgress* data, size_t count )
+{
+  if ( canceled )
+  {
+    return;
+  }
+
+  auto env = Env();
+  for ( size_t i = 0; i < count && !canceled; ++i )
+  {
+    if ( is_aborted() )
+    {
+      canceled = true;
+      break;
+    }
+
+    if ( !progress.IsEmpty() )
+    {
+      auto value = Napi::Object::New( env );
+      value["count"] = Napi::Number::New( env, static_cast<double>( data[i].count ) );
+      value["total"] = Napi::Number::New( env, static_cast<double>( data[i].total ) );
+      try
+      {
+        progress.Call( { value } );
+      }
+      catch ( const Napi::Error& ex )
+      {
+        progress_error = Napi::Persistent( ex.Value() );
+        canceled = true;
+      }
+    }
+  }
+
+  if ( !canceled && is_aborted() )
+  {
+    canceled = true;
+  }
+}
+
+void WorkspaceIndexer::OnOK()
+{
+  auto env = Env();
+
+  lsp_workspace->release_contents_tsfn();
+  if ( inventory )
+  {
+    lsp_workspace->set_file_inventory( inventory );
+  }
+
+  if ( !progress_error.IsEmpty() )
+  {
+    deferred.Reject( progress_error.Value() );
+  }
+  else
+  {
+    deferred.Resolve( Napi::Boolean::New( env, !canceled ) );
+  }
+}
+
+void WorkspaceIndexer::OnError( const Napi::Error& error )
+{
+  lsp_workspace->release_contents_tsfn();
+  deferred.Reject( error.Value() );
+}
+}  // namespace VSCodeEscript
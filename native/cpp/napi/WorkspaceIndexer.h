@@ -0,0 +1,102 @@
+#pragma once
+
+#include "../compiler/ReferenceIndexFile.h"
+#include "../compiler/ReferencesBuilder.h"
+#include "../misc/FileInventory.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <napi.h>
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace VSCodeEscript
+{
+class LSPWorkspace;
+
+struct IndexProgress
+{
+  size_t count;
+  size_t total;
+};
+
+// Walks the workspace's directories and analyzes the sources and includes
+// found on a pool of threads while the walk goes on, sources first, and
+// collects the references of every file. Each thread keeps its own
+// references, which are added to the workspace's reference store once all
+// files are processed. If the workspace has an on-disk reference index,
+// scripts with an up-to-date entry are read from it instead of being
+// analyzed, and the index is rewritten with the newly analyzed scripts. The
+// walk replaces the workspace's file inventory once indexing finishes.
+//
+// With `indexIncludesOnce`, the references inside an include come only from
+// analyzing the include on its own, instead of again for every source
+// including it. Sources then only contribute the references inside
+// themselves, so they are analyzed once the walk has found every include.
+// References within an include to definitions it cannot see on its own are
+// not found.
+class WorkspaceIndexer : public Napi::AsyncProgressQueueWorker<IndexProgress>
+{
+public:
+  WorkspaceIndexer( Napi::Env env, LSPWorkspace* lsp_workspace, unsigned concurrency,
+                    Napi::Function progress, Napi::Object signal );
+
+  Napi::Promise GetPromise() const;
+
+protected:
+  void Execute( const ExecutionProgress& progress ) override;
+  void OnProgress( const IndexProgress* data, size_t count ) override;
+  void OnOK() override;
+  void OnError( const Napi::Error& error ) override;
+
+private:
+  using IndexEntries = std::vector<std::pair<std::string, CompilerExt::ReferenceIndexEntry>>;
+
+  void index_file( const std::string& pathname, CompilerExt::ReferencesByPathname& references,
+                   IndexEntries* entries );
+  // Walks the workspace's directories, queueing the scripts found.
+  void walk();
+  void found( CompilerExt::FileInventory::Kind kind, const CompilerExt::FileInventory::File& file );
+  // The next script to index, waiting for the walk to find one. Empty once all
+  // were handed out, or indexing was canceled.
+  std::optional<std::string> next_file();
+  bool is_aborted();
+  // Whether `pathname` is an include indexed on its own.
+  bool is_indexed_include( const std::string& pathname );
+
+  LSPWorkspace* lsp_workspace;
+  Napi::ObjectReference workspace;
+  Napi::FunctionReference progress;
+  Napi::ObjectReference signal;
+  Napi::Promise::Deferred deferred;
+  Napi::Reference<Napi::Value> progress_error;
+
+  std::mutex queue_mutex;
+  std::condition_variable queue_ready;
+  std::deque<std::string> queued_src;
+  std::deque<std::string> queued_inc;
+  std::set<std::string> queued;
+  bool walk_finished = false;
+  std::shared_ptr<const CompilerExt::FileInventory> inventory;
+
+  unsigned concurrency;
+  bool reference_all_functions;
+  bool include_once;
+  // Canonical pathnames of the includes being indexed, complete once the walk
+  // has finished, and whether each pathname seen in an analysis is one of them.
+  std::unordered_set<std::string> indexed_includes;
+  std::mutex indexed_include_mutex;
+  std::unordered_map<std::string, bool> indexed_include_by_pathname;
+  std::shared_ptr<CompilerExt::ReferenceIndexFile> reference_index;
+  CompilerExt::FileStampCache stamps;
+  std::atomic<bool> canceled;
+};
+}  // namespace VSCodeEscript
@@ -0,0 +1,57 @@
+#include "WorkspaceWarmer.h"
+
+#include "../misc/Parallel.h"
+#include "LSPWorkspace.h"
+
+namespace VSCodeEscript
+{
+WorkspaceWarmer::WorkspaceWarmer( Napi::Env env, LSPWorkspace* lsp_workspace,
+                                  std::vector<Module> modules, unsigned concurrency )
+    : AsyncWorker( env ),
+      lsp_workspace( lsp_workspace ),
+      workspace( Napi::Persistent( lsp_workspace->Value() ) ),
+      deferred( Napi::Promise::Deferred::New( env ) ),
+      modules( std::move( modules ) ),
+      concurrency( concurrency ? concurrency : CompilerExt::default_concurrency() )
+{
+  lsp_workspace->acquire_contents_tsfn( env );
+}
+
+Napi::Promise WorkspaceWarmer::GetPromise() const
+{
+  return deferred.Promise();
+}
+
+void WorkspaceWarmer::Execute()
+{
+  CompilerExt::parallel_for( modules.size(), concurrency,
+                             [&]( size_t index, unsigned )
+                             {
+                               const auto& module = modules[index];
+                               try
+                               {
+                                 lsp_workspace->preload( module.pathname );
+                               }
+                               catch ( ... )
+                               {
+                                 // Analyses using the module report the problem.
+                               }
+                               if ( module.xml_doc )
+                               {
+                                 lsp_workspace->xml_doc_cache().load( *module.xml_doc );
+                               }
+                             } );
+}
+
+void WorkspaceWarmer::OnOK()
+{
+  lsp_workspace->release_contents_tsfn();
+  deferred.Resolve( Napi::Number::New( Env(), static_cast<double>( modules.size() ) ) );
+}
+
+void WorkspaceWarmer::OnError( const Napi::Error& error )
+{
+  lsp_workspace->release_contents_tsfn();
+  deferred.Reject( error.Value() );
+}
+}  // namespace VSCodeEscript
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <napi.h>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace VSCodeEscript
+{
+class LSPWorkspace;
+
+// Parses every module in the module directory into the workspace's .em parse
+// tree cache, and its XML documentation into the documentation cache, on a
+// pool of threads. XML documentation paths are resolved up front on the main
+// thread, as they come from a JavaScript callback. Resolves with the number of
+// modules once done.
+class WorkspaceWarmer : public Napi::AsyncWorker
+{
+public:
+  struct Module
+  {
+    std::string pathname;
+    std::optional<std::string> xml_doc;
+  };
+
+  WorkspaceWarmer( Napi::Env env, LSPWorkspace* lsp_workspace, std::vector<Module> modules,
+                   unsigned concurrency );
+
+  Napi::Promise GetPromise() const;
+
+protected:
+  void Execute() override;
+  void OnOK() override;
+  void OnError( const Napi::Error& error ) override;
+
+private:
+  LSPWorkspace* lsp_workspace;
+  Napi::ObjectReference workspace;
+  Napi::Promise::Deferred deferred;
+
+  std::vector<Module> modules;
+  unsigned concurrency;
+};
+}  // namespace VSCodeEscript
@@ -20,8 +20,107 @@ export type SignatureHelp = {
 }
 
 export type LSPWorkspaceConfig = {
-    getContents: (pathname: string) => string;
+    /**
+     * Called for files without contents set via `setContents`. If omitted,
+     * files are read from disk.
+     */
+    getContents?: (pathname: string) => string;
     getXmlDocPath?: (moduleEmFile: string) => string | null;
+    /**
+     * Directory for the on-disk reference index. When given, `indexAll` only
+     * analyzes scripts whose files changed since the last index was written.
+     */
+    indexCacheDirectory?: string;
+    /**
+     * How long `scheduleAnalysis` waits for further requests for the same
+     * document before analyzing it. Defaults to 0.
+     */
+    analysisDebounceMs?: number;
+    /**
+     * Keep the analyses of at most this many documents, plus the ones with
+     * contents set via `setContents`. The least recently used are dropped
+     * first, and analyzed again when a query needs them. Their diagnostics,
+     * references and dependencies are kept. Unlimited by default.
+     */
+    maxAnalyzedDocuments?: number;
+    /**
+     * Like `maxAnalyzedDocuments`, limiting the analyses kept by their
+     * estimated memory usage, in bytes. Estimating costs a walk over each
+     * analysis' parse tree and AST.
+     */
+    maxAnalyzedBytes?: number;
+}
+
+export type AnalysisMetrics = {
+    /** Requests waiting to be analyzed. */
+    queueDepth: number;
+    running: boolean;
+    scheduled: number;
+    /** Requests coalesced with a later one, or superseded before applying. */
+    dropped: number;
+    completed: number;
+}
+
+export type ParseTreeCacheStats = {
+    hits: number;
+    misses: number;
+}
+
+export type AnalysisStats = {
+    /** Number of analyses added up in these stats. */
+    analyses: number;
+    totalMs: number;
+    /** Loading, parsing and building the syntax tree of the script and its includes. */
+    buildWorkspaceMs: number;
+    /** Lexing and parsing, part of `buildWorkspaceMs`. */
+    parseMs: { src: number, inc: number, em: number };
+    parsedFiles: { src: number, inc: number, em: number };
+    semanticAnalysisMs: number;
+    buildReferencesMs: number;
+    emParseTreeCache: ParseTreeCacheStats;
+    incParseTreeCache: ParseTreeCacheStats;
+}
+
+/**
+ * Estimated bytes held by an analyzed document: sizes of the objects and
+ * container capacities, without allocator overhead, so a lower bound.
+ */
+export type DocumentMemoryUsage = {
+    totalBytes: number;
+    /** The ANTLR parse tree of the document's own source. */
+    parseTree: number;
+    /** Lexer tokens and source text. */
+    tokens: number;
+    /** The syntax tree, including the user functions of includes. */
+    ast: number;
+    /** Semantic tokens and the lookup indices built from the analysis. */
+    indices: number;
+}
+
+export type WorkspaceMemoryUsage = {
+    totalBytes: number;
+    documents: (DocumentMemoryUsage & { pathname: string })[];
+    /**
+     * Files parsed into the module and include parse tree caches. Only their
+     * source text is counted, not the trees.
+     */
+    emParseTreeCache: { files: number, sourceBytes: number };
+    incParseTreeCache: { files: number, sourceBytes: number };
+    /** The reference store and its interned pathnames. */
+    references: number;
+    xmlDocs: number;
+    /** Contents set via `setContents()`. */
+    contents: number;
+}
+
+export type EncodedSemanticTokens = {
+    resultId: string;
+    data: Uint32Array;
+}
+
+export type EncodedSemanticTokensDelta = {
+    resultId: string;
+    edits: { start: number, deleteCount: number, data: Uint32Array }[];
 }
 
 export interface LSPWorkspace {
@@ -29,18 +128,81 @@ export interface LSPWorkspace {
     workspaceRoot: string;
     open(workspaceRoot: string): void;
     reopen(): boolean; // `true` if folder changes occurred in scripts/ecompile.cfg
+	/**
+	 * Whether an analysis, index, warm-up or re-analysis of dependents is
+	 * running in the background. `open` and `reopen` throw while it is.
+	 */
+	busy: boolean;
     getConfigValue(key: 'PackageRoot'): Array<string>;
     getConfigValue(key: 'IncludeDirectory' | 'ModuleDirectory' | 'PolScriptRoot'): string;
-	scripts: { inc: string[], src: string[] };
+	/**
+	 * Sources, includes and modules found by the last walk of the workspace's
+	 * directories, each sorted. `indexAll` walks them again, and replaces them
+	 * once it finishes without being aborted.
+	 */
+	scripts: { readonly src: readonly string[], readonly inc: readonly string[], readonly em: readonly string[] };
+	/** Sources and includes, sorted. */
 	autoCompiledScripts: readonly string[];
 	getDocument(pathname: string): LSPDocument;
+	/**
+	 * Sets the contents used for `pathname` instead of `getContents` or the
+	 * file on disk. Returns `false` if `version` is older than the current one.
+	 */
+	setContents(pathname: string, text: string, version?: number): boolean;
+	removeContents(pathname: string): boolean;
+	/**
+	 * Drops cached parse trees that depend on `pathname`, eg. after it changed
+	 * on disk. `setContents` and `removeContents` do this automatically.
+	 */
+	invalidate(pathname: string): boolean;
+	/** Documents whose last analysis read `pathname`, excluding itself. */
+	dependentsOf(pathname: string): string[];
+	/**
+	 * Queues `pathname` for analysis on the workspace's analysis thread.
+	 * Resolves `false` if a later request for the same document replaced this
+	 * one. Foreground requests run before `background` ones.
+	 */
+	scheduleAnalysis(pathname: string, options?: { background?: boolean, continueOnError?: boolean }): Promise<boolean>;
+	analysisMetrics(): AnalysisMetrics;
+	/** The stats of all analyses since the workspace was opened. */
+	stats(): AnalysisStats;
+	/** Estimated memory held by each document and shared cache. */
+	memoryUsage(): WorkspaceMemoryUsage;
+	/**
+	 * Re-analyzes all documents depending on `pathname` on a pool of native
+	 * threads, and resolves with their diagnostics keyed by pathname. With
+	 * `openOnly`, only documents with contents set via `setContents` are
+	 * analyzed.
+	 */
+	reanalyzeDependents(pathname: string, options?: { continueOnError?: boolean, concurrency?: number, openOnly?: boolean }): Promise<Record<string, Diagnostic[]>>;
+	/**
+	 * Parses every module in the module directory, and its XML documentation,
+	 * on a pool of native threads so the first hover or completion does not
+	 * pay for them. Resolves with the number of modules.
+	 */
+	warmUp(options?: { concurrency?: number }): Promise<number>;
 	cacheScripts(...args: any[]): void;
+	/**
+	 * Walks the workspace's directories and analyzes the auto-compiled scripts
+	 * on a pool of native threads as they are found, building their
+	 * references. Resolves `false` if `signal` was aborted.
+	 */
+	indexAll(progress?: UpdateCacheProgressCallback, signal?: AbortSignal, concurrency?: number): Promise<boolean>;
 	updateCache: typeof updateCache;
 }
 
 export interface LSPDocument {
     new(workspace: LSPWorkspace, pathname: string): LSPDocument;
     analyze(continueOnError?: boolean): void;
+    /** With `stats`, returns the timings and parse tree cache counters of the analysis. */
+    analyze(options: { continueOnError?: boolean, stats: true }): AnalysisStats;
+    analyze(options: { continueOnError?: boolean, stats?: boolean }): AnalysisStats | undefined;
+    /**
+     * Analyzes the document on a background thread. Resolves `false` if a
+     * newer `analyze()` or `analyzeAsync()` superseded this one, in which case
+     * its results are discarded.
+     */
+    analyzeAsync(continueOnError?: boolean): Promise<boolean>;
     dependents(): string[];
     diagnostics(): Diagnostic[];
     hover(position: Position): string | undefined;
@@ -50,10 +212,34 @@ export interface LSPDocument {
     signatureHelp(position: Position): SignatureHelp | undefined;
 	toFormattedString(options?: Partial<Pick<FormattingOptions, 'tabSize'|'insertSpaces'>>, formatRange?: Range): string; // throws
     tokens(): [line: number, startChar: number, length: number, tokenType: number, tokenModifiers: number][];
+    /**
+     * The semantic tokens in the LSP relative encoding (five integers per
+     * token), sorted by position, encoded natively straight into the array.
+     * `SemanticTokens.data` is serialized as a JSON array, so the server
+     * still converts it once with `Array.from`.
+     */
+    tokensEncoded(): Uint32Array;
+    /**
+     * Like `tokensEncoded()`, restricted to the tokens starting on the lines
+     * of `range`.
+     */
+    tokensInRange(range: Range): Uint32Array;
+    /**
+     * Like `tokensEncoded()`, remembering the result for
+     * `semanticTokensDelta()`. The document keeps the returned array itself
+     * rather than a copy, so it must not be modified.
+     */
+    semanticTokens(): EncodedSemanticTokens;
+    /**
+     * The edits from the tokens last returned as `previousResultId` to the
+     * current ones, or the full tokens if that result is no longer known.
+     */
+    semanticTokensDelta(previousResultId: string): EncodedSemanticTokens | EncodedSemanticTokensDelta;
     toStringTree(): string | undefined;
     buildReferences(): undefined;
     references(position: Position): Location[] | undefined;
     symbols(): DocumentSymbol[] | undefined;
+    memoryUsage(): DocumentMemoryUsage;
 }
 
 export interface ExtensionConfiguration {
@@ -62,6 +248,17 @@ export interface ExtensionConfiguration {
     continueAnalysisOnError: boolean;
 	disableWorkspaceReferences: boolean;
 	referenceAllFunctions: boolean;
+	indexIncludesOnce: boolean;
+}
+
+export type BenchmarkResult = {
+    iterations: number;
+    p50Ms: number;
+    p99Ms: number;
+    meanMs: number;
+    allocationsPerOp: number;
+    bytesPerOp: number;
+    peakRssBytes: number;
 }
 
 export interface EscriptVscodeNative {
@@ -74,6 +271,25 @@ export interface EscriptVscodeNative {
         get(setting: 'continueAnalysisOnError'): boolean;
         get(setting: 'disableWorkspaceReferences'): boolean;
         get(setting: 'referenceAllFunctions'): boolean;
+        get(setting: 'indexIncludesOnce'): boolean;
+    }
+    /**
+     * Records spans of native operations (analysis, file loads, queries) into
+     * a ring buffer, which `write` saves as a Chrome trace event file for
+     * chrome://tracing or Perfetto.
+     */
+    Tracing: {
+        /** `capacity` is the number of spans kept; only the first call's is used. */
+        start(options?: { capacity?: number }): void;
+        stop(): void;
+        enabled(): boolean;
+        /** Writes the spans recorded since `start`, and returns their number. */
+        write(filename: string): number;
+    }
+    /** Only in builds configured with `BUILD_BENCHMARKS`; see `bench/run.js`. */
+    Benchmark?: {
+        measure(fn: () => unknown, options?: { iterations?: number, warmup?: number }): BenchmarkResult;
+        peakRss(): number;
     }
 }
 
@@ -120,34 +336,27 @@ function updateCache(this: LSPWorkspace, progress?: UpdateCacheProgressCallback,
         });
     }
 
+    const controller = new AbortController();
     const update = async () => {
-        const { autoCompiledScripts } = this;
-        let count = 0;
-        const total = autoCompiledScripts.length;
-        for (const p of autoCompiledScripts) {
-            await new Promise(resolve => setImmediate(resolve));
-            const existing = updateCacheMap.get(this);
-            const canceled = Boolean(existing?.signals.some(signal => signal.aborted));
-
-            if (canceled) {
+        try {
+            return await this.indexAll((status) => {
+                const existing = updateCacheMap.get(this);
+                if (existing?.signals.some(signal => signal.aborted)) {
+                    controller.abort();
+                    return;
+                }
+                existing?.progresses.forEach(callback => callback(status));
+            }, controller.signal);
+        } catch (e) {
+            // Should never happen
+            console.error(`Failed to update cache: ${e}`);
+            return false;
+        } finally {
+            if (controller.signal.aborted) {
                 // Delete from the map, so a new call to updateCache() creates a new task.
                 updateCacheMap.delete(this);
-                return false;
-            }
-
-            try {
-                this.getDocument(p).buildReferences();
-            } catch (e) {
-                // Should never happen
-                console.error(`Failed to process ${p}: ${e}`);
-            }
-
-            ++count;
-            if (existing) {
-                existing.progresses.forEach(progress => progress({ count, total }));
             }
         }
-        return true;
     };
     const promise = update();
     updateCacheMap.set(this, { promise, progresses: progress ? [progress] : [], signals: signal ? [signal] : [] });
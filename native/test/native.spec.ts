@@ -3,7 +3,8 @@ import { readFileSync, readdirSync } from 'fs';
 import { LSPDocument, LSPWorkspace, native } from '../src/index';
 import { inspect } from 'util';
 import { F_OK } from 'constants';
-import { writeFile, access, mkdir, readFile } from 'fs/promises';
+import { writeFile, access, mkdir, mkdtemp, readFile, rm } from 'fs/promises';
+import { tmpdir } from 'os';
 import { dirname, join } from 'path';
 import type { Range, Position } from 'vscode-languageclient/node';
 
@@ -112,6 +113,204 @@ describe('vscode-escript-native LSPWorkspace', () => {
         expect(calls).toEqual(2);
     });
 
+    it('Can analyze asynchronously', async () => {
+        const src = 'in-memory-file.src';
+        let text = 'var hello := foobar;';
+        const workspace = new LSPWorkspace({
+            getContents: (pathname) => pathname === src ? text : readFileSync(pathname, 'utf-8')
+        });
+        workspace.open(dir);
+
+        const document = workspace.getDocument(src);
+        const promise = document.analyzeAsync();
+
+        // The document contents were read when the analysis was queued.
+        text = 'var hello := 0;';
+
+        expect(await promise).toBe(true);
+        expect(document.diagnostics()).toHaveLength(1); // unknown identifier
+    });
+
+    it('Can return analysis stats', () => {
+        const src = 'in-memory-file.src';
+        const workspace = new LSPWorkspace({
+            getContents: (pathname) => pathname === src ? 'use uo; Print(MOVEOBJECT_FORCELOCATION);' : readFileSync(pathname, 'utf-8')
+        });
+        workspace.open(dir);
+
+        const document = workspace.getDocument(src);
+        expect(document.analyze()).toBeUndefined();
+        const first = workspace.stats();
+        expect(first.analyses).toEqual(1);
+        expect(first.emParseTreeCache.misses).toBeGreaterThan(0);
+
+        // Modules are now parsed and cached.
+        const stats = document.analyze({ stats: true });
+        expect(stats.analyses).toEqual(1);
+        expect(stats.parsedFiles.src).toEqual(1);
+        expect(stats.emParseTreeCache.misses).toEqual(0);
+        expect(stats.emParseTreeCache.hits).toBeGreaterThan(0);
+        expect(stats.totalMs).toBeGreaterThanOrEqual(stats.buildWorkspaceMs);
+
+        const total = workspace.stats();
+        expect(total.analyses).toEqual(2);
+        expect(total.emParseTreeCache.hits).toEqual(first.emParseTreeCache.hits + stats.emParseTreeCache.hits);
+    });
+
+    it('Can report memory usage', () => {
+        const src = 'in-memory-file.src';
+        let reads = 0;
+        const workspace = new LSPWorkspace({
+            getContents: (pathname) => {
+                ++reads;
+                return pathname === src ? 'use uo; Print(MOVEOBJECT_FORCELOCATION);' : readFileSync(pathname, 'utf-8');
+            }
+        });
+        workspace.open(dir);
+
+        const document = workspace.getDocument(src);
+        expect(document.memoryUsage().totalBytes).toEqual(0);
+        document.analyze();
+
+        const usage = document.memoryUsage();
+        expect(usage.parseTree).toBeGreaterThan(0);
+        expect(usage.tokens).toBeGreaterThan(0);
+        expect(usage.ast).toBeGreaterThan(0);
+        expect(usage.totalBytes).toEqual(usage.parseTree + usage.tokens + usage.ast + usage.indices);
+
+        const total = workspace.memoryUsage();
+        expect(total.documents).toEqual([{ pathname: expect.stringContaining(src), ...usage }]);
+        expect(total.emParseTreeCache.files).toBeGreaterThan(0);
+        expect(total.emParseTreeCache.sourceBytes).toBeGreaterThan(0);
+        expect(total.totalBytes).toBeGreaterThan(usage.totalBytes + total.emParseTreeCache.sourceBytes);
+
+        // Reporting does not load anything through the parse tree caches.
+        const readsBefore = reads;
+        workspace.memoryUsage();
+        expect(reads).toEqual(readsBefore);
+    });
+
+    it('Can evict the analyses of documents that are not open', () => {
+        const contents: Record<string, string> = {
+            'first.src': 'use uo; Print(MOVEOBJECT_FORCELOCATION);',
+            'second.src': 'var second := 1; Print(second);',
+            'open.src': 'var open := 1; Print(open);',
+        };
+        const workspace = new LSPWorkspace({
+            getContents: (pathname) => contents[pathname] ?? readFileSync(pathname, 'utf-8'),
+            maxAnalyzedDocuments: 1
+        });
+        workspace.open(dir);
+        workspace.setContents('open.src', contents['open.src']);
+
+        const analyzed = () => workspace.memoryUsage().documents
+            .filter(document => document.ast > 0)
+            .map(document => document.pathname)
+            .sort();
+
+        const first = workspace.getDocument('first.src');
+        const second = workspace.getDocument('second.src');
+        const open = workspace.getDocument('open.src');
+        open.analyze();
+        first.analyze();
+        const diagnostics = first.diagnostics();
+        second.analyze();
+        expect(analyzed()).toEqual(['open.src', 'second.src']);
+        expect(first.diagnostics()).toEqual(diagnostics);
+
+        // Querying an evicted document analyzes it again.
+        expect(first.hover({ line: 1, character: 10 })).toContain('Print');
+        expect(analyzed()).toEqual(['first.src', 'open.src']);
+    });
+
+    it('Can write a trace of native operations', async () => {
+        const src = 'in-memory-file.src';
+        const workspace = new LSPWorkspace({
+            getContents: (pathname) => pathname === src ? 'use uo; Print(MOVEOBJECT_FORCELOCATION);' : readFileSync(pathname, 'utf-8')
+        });
+        workspace.open(dir);
+
+        const tmp = await mkdtemp(join(tmpdir(), 'escript-trace-'));
+        try {
+            native.Tracing.start();
+            expect(native.Tracing.enabled()).toBe(true);
+
+            const document = workspace.getDocument(src);
+            document.analyze();
+            document.hover({ line: 1, character: 10 });
+            native.Tracing.stop();
+
+            const traceFile = join(tmp, 'trace.json');
+            const count = native.Tracing.write(traceFile);
+            const { traceEvents } = JSON.parse(await readFile(traceFile, 'utf-8'));
+            expect(traceEvents).toHaveLength(count);
+
+            const names = new Set(traceEvents.map((event: { name: string }) => event.name));
+            expect(names).toContain('LSPDocument::Analyze');
+            expect(names).toContain('LSPWorkspace::get_contents');
+            expect(names).toContain('HoverBuilder::context');
+            expect(traceEvents[0]).toMatchObject({ ph: 'X', args: { path: expect.any(String) } });
+        } finally {
+            native.Tracing.stop();
+            await rm(tmp, { recursive: true, force: true });
+        }
+    });
+
+    it('Discards superseded asynchronous analysis', async () => {
+        const src = 'in-memory-file.src';
+        let text = 'var hello := foobar;';
+        const workspace = new LSPWorkspace({
+            getContents: (pathname) => pathname === src ? text : readFileSync(pathname, 'utf-8')
+        });
+        workspace.open(dir);
+
+        const document = workspace.getDocument(src);
+        const first = document.analyzeAsync();
+        text = 'var hello := 0;';
+        const second = document.analyzeAsync();
+
+        expect(await Promise.all([first, second])).toEqual([false, true]);
+        expect(document.diagnostics()).toHaveLength(0);
+    });
+
+    it('Can set contents without a callback', () => {
+        const src = resolve('/tmp/in-memory-overlay.src');
+        const workspace = new LSPWorkspace({});
+        workspace.open(dir);
+
+        const document = workspace.getDocument(src);
+
+        expect(workspace.setContents(src, 'var hello := foobar;', 1)).toBe(true);
+        document.analyze();
+        expect(document.diagnostics()).toHaveLength(1); // unknown identifier
+
+        expect(workspace.setContents(src, 'var hello := 0;', 2)).toBe(true);
+        expect(workspace.setContents(src, 'var hello := foobar;', 1)).toBe(false);
+        document.analyze();
+        expect(document.diagnostics()).toHaveLength(0);
+
+        expect(workspace.removeContents(src)).toBe(true);
+        expect(workspace.removeContents(src)).toBe(false);
+    });
+
+    it('Coalesces scheduled analyses', async () => {
+        const src = 'in-memory-file.src';
+        const workspace = new LSPWorkspace({ analysisDebounceMs: 20 });
+        workspace.open(dir);
+
+        workspace.setContents(src, 'var hello := foobar;', 1);
+        const first = workspace.scheduleAnalysis(src);
+        workspace.setContents(src, 'var hello := 0;', 2);
+        const second = workspace.scheduleAnalysis(src);
+
+        expect(workspace.analysisMetrics().queueDepth).toEqual(1);
+        expect(await Promise.all([first, second])).toEqual([false, true]);
+        expect(workspace.getDocument(src).diagnostics()).toHaveLength(0);
+
+        const { scheduled, dropped, completed, queueDepth } = workspace.analysisMetrics();
+        expect({ scheduled, dropped, completed, queueDepth }).toEqual({ scheduled: 2, dropped: 1, completed: 1, queueDepth: 0 });
+    });
+
     it('Module compilation', () => {
         // The SourceFileLoader callback, mocking the LSP TextDocuments utility
         // class
@@ -187,6 +386,127 @@ describe('vscode-escript-native LSPWorkspace', () => {
         ]);
     });
 
+    it('Can get dependents of a file', () => {
+        const pathname = resolve('/tmp/start.src');
+        const incname = resolve(__dirname, '..', 'polserver', 'testsuite', 'pol', 'scripts', 'include', 'testutil.inc');
+
+        const mocks = {
+            [pathname]: 'include "testutil";',
+            [incname]: 'Print(1);'
+        };
+
+        const workspace = new LSPWorkspace({
+            getContents: (pathname) => mocks[pathname] ?? readFileSync(pathname, 'utf-8')
+        });
+        workspace.open(dir);
+
+        const document = workspace.getDocument(pathname);
+        document.analyze();
+
+        expect(workspace.dependentsOf(incname).map(x => resolve(x))).toEqual([pathname]);
+        expect(workspace.dependentsOf(pathname)).toEqual([]);
+
+        mocks[pathname] = 'Print(1);';
+        document.analyze();
+        expect(workspace.dependentsOf(incname)).toEqual([]);
+    });
+
+    it('Can invalidate cached includes', () => {
+        const pathname = resolve('/tmp/start.src');
+        const incname = resolve(__dirname, '..', 'polserver', 'testsuite', 'pol', 'scripts', 'include', 'testutil.inc');
+
+        const mocks = {
+            [pathname]: 'include "testutil"; Foo();',
+            [incname]: 'function Foo() endfunction'
+        };
+
+        const workspace = new LSPWorkspace({
+            getContents: (pathname) => mocks[pathname] ?? readFileSync(pathname, 'utf-8')
+        });
+        workspace.open(dir);
+
+        const document = workspace.getDocument(pathname);
+        document.analyze();
+        expect(document.diagnostics()).toHaveLength(0);
+
+        mocks[incname] = 'function Bar() endfunction';
+        expect(workspace.invalidate(pathname)).toBe(false); // not an include
+        expect(workspace.invalidate(incname)).toBe(true);
+
+        document.analyze();
+        expect(document.diagnostics()).toHaveLength(1); // unknown function Foo
+
+        // Callers may spell the include differently from the compiler.
+        mocks[incname] = 'function Foo() endfunction';
+        const respelled = process.platform === 'win32'
+            ? incname.replace(/^[a-z]:/i, (drive) => drive === drive.toUpperCase() ? drive.toLowerCase() : drive.toUpperCase())
+            : `${dirname(incname)}/./${basename(incname)}`;
+        expect(workspace.invalidate(respelled)).toBe(true);
+
+        document.analyze();
+        expect(document.diagnostics()).toHaveLength(0);
+    });
+
+    it('Can reanalyze dependents in parallel', async () => {
+        const incname = resolve(__dirname, '..', 'polserver', 'testsuite', 'pol', 'scripts', 'include', 'testutil.inc');
+        const sources = [1, 2, 3].map(i => resolve(`/tmp/start${i}.src`));
+
+        const workspace = new LSPWorkspace({});
+        workspace.open(dir);
+        workspace.setContents(incname, 'function Foo() endfunction');
+
+        for (const pathname of sources) {
+            workspace.setContents(pathname, 'include "testutil"; Foo();');
+            const document = workspace.getDocument(pathname);
+            document.analyze();
+            expect(document.diagnostics()).toHaveLength(0);
+        }
+
+        workspace.setContents(incname, 'function Bar() endfunction');
+        const results = await workspace.reanalyzeDependents(incname, { concurrency: 2 });
+
+        expect(Object.keys(results).map(x => resolve(x)).sort()).toEqual([...sources].sort());
+        for (const pathname of sources) {
+            expect(workspace.getDocument(pathname).diagnostics()).toHaveLength(1); // unknown function Foo
+        }
+
+        // Closed documents stay dependents, but are skipped with `openOnly`.
+        workspace.removeContents(sources[0]);
+        const openResults = await workspace.reanalyzeDependents(incname, { openOnly: true });
+        expect(Object.keys(openResults).map(x => resolve(x)).sort()).toEqual(sources.slice(1).sort());
+    });
+
+    it('Can warm up module caches', async () => {
+        const workspace = new LSPWorkspace({});
+        expect(() => workspace.warmUp()).toThrow();
+
+        workspace.open(dir);
+        const count = await workspace.warmUp({ concurrency: 2 });
+        expect(count).toBeGreaterThan(0);
+
+        const src = resolve('/tmp/warm-up.src');
+        workspace.setContents(src, 'use uo; Broadcast( "hello" );');
+        const document = workspace.getDocument(src);
+        document.analyze();
+        expect(document.diagnostics()).toHaveLength(0);
+    });
+
+    it('Cannot reopen while background work is running', async () => {
+        const workspace = new LSPWorkspace({});
+        workspace.open(dir);
+        expect(workspace.busy).toBe(false);
+
+        const warmUp = workspace.warmUp();
+        expect(workspace.busy).toBe(true);
+        expect(() => workspace.reopen()).toThrow();
+        expect(() => workspace.open(dir)).toThrow();
+        expect(workspace.workspaceRoot).not.toEqual('');
+
+        await warmUp;
+        expect(workspace.busy).toBe(false);
+        expect(workspace.reopen()).toBe(false);
+    });
+
     it('Can use relative paths', () => {
         const workspace = new LSPWorkspace({
             getContents: () => ''
@@ -362,6 +682,11 @@ describe('Hover - SRC', () => {
         expect(hover).toEqual(escriptdoc('(user function) static_func( a0 := "::static_func" )'));
     });
 
+    it('Can hover correct user function (class scope, inside function expression)', () => {
+        const hover = getHover('function static_func( a0 := "::static_func" ) endfunction class Foo() function static_func( a0 := "Foo::static_func" ) endfunction function other() var f := @() { static_func(); }; endfunction endclass', 166);
+        expect(hover).toEqual(escriptdoc('(user function) Foo::static_func( a0 := "Foo::static_func" )'));
+    });
+
     it('Can hover parent method inside child class', () => {
         const hover = getHover('class Foo() function Foo( this ) this.foo := "foo"; this.parent_method_func(); endfunction function parent_method_func( this ) this.foo; endfunction endclass class Bar( Foo ) function Bar( this ) super(); this.bar := "bar"; this.child_method_func(); endfunction function child_method_func( this ) this.foo; this.bar; this.parent_method_func(); endfunction endclass Bar::Bar();', 332);
         expect(hover).toEqual(escriptdoc('(class method) Foo::parent_method_func( this )'));
@@ -1062,6 +1387,17 @@ _Errors_:
         expect(hover?.trim()).toEqual(expected);
     });
 
+    it('Can hover module functions with cached XML docs', () => {
+        const source = 'use uo; CreateItemInBackpack( "of_character", "objtype" ); MoveObjectToLocation( 0, 1, 2, 3 );';
+        const first = getHover(source, 15);
+        expect(getHover(source, 15)).toEqual(first);
+
+        const other = getHover(source, 65);
+        expect(other).toContain('(module function) MoveObjectToLocation(');
+        expect(other).toContain('\n---\n');
+        expect(other).not.toEqual(first);
+    });
+
     it('Can hover user functions with multi-line comment docs', () => {
         const hover = getHover(`foo();
 /**
@@ -1140,6 +1476,61 @@ describe('Tokens - SRC', () => {
         const tokens = getTokens('/[a-z]+/i');
         expect(tokens).toEqual([[0, 0, 9, 20 /* regexp */, 0]]);
     });
+
+    it('Can get encoded tokens', () => {
+        const tokens = getTokens('var a := 1;\nprint(a + 2);');
+        const sorted = [...tokens].sort((x1, x2) => x1[0] - x2[0] || x1[1] - x2[1]);
+
+        const expected: number[] = [];
+        let [previousLine, previousChar] = [0, 0];
+        for (const [line, char, length, type, modifiers] of sorted) {
+            expected.push(line - previousLine, line === previousLine ? char - previousChar : char, length, type, modifiers);
+            [previousLine, previousChar] = [line, char];
+        }
+
+        const encoded = document.tokensEncoded();
+        expect(encoded).toBeInstanceOf(Uint32Array);
+        expect(Array.from(encoded)).toEqual(expected);
+    });
+
+    it('Can get encoded tokens in a range', () => {
+        const tokens = getTokens('var a := 1;\nvar b := 2;\nvar c := 3;\nprint(a + b + c);');
+        const sorted = [...tokens].sort((x1, x2) => x1[0] - x2[0] || x1[1] - x2[1]);
+        const inRange = sorted.filter(([line]) => line >= 1 && line <= 2);
+
+        const expected: number[] = [];
+        let [previousLine, previousChar] = [0, 0];
+        for (const [line, char, length, type, modifiers] of inRange) {
+            expected.push(line - previousLine, line === previousLine ? char - previousChar : char, length, type, modifiers);
+            [previousLine, previousChar] = [line, char];
+        }
+
+        const encoded = document.tokensInRange({ start: { line: 1, character: 0 }, end: { line: 2, character: 0 } });
+        expect(expected.length).toBeGreaterThan(0);
+        expect(Array.from(encoded)).toEqual(expected);
+        expect(document.tokensInRange({ start: { line: 10, character: 0 }, end: { line: 20, character: 0 } })).toHaveLength(0);
+    });
+
+    it('Can get semantic token deltas', () => {
+        getTokens('var a := 1;\nprint(a);');
+        const full = document.semanticTokens();
+
+        getTokens('var a := 1;\nprint(a + 2);');
+        const delta = document.semanticTokensDelta(full.resultId);
+        expect(delta.resultId).not.toEqual(full.resultId);
+        if (!('edits' in delta)) {
+            throw new Error('Expected a delta');
+        }
+        expect(delta.edits).toHaveLength(1);
+
+        const [{ start, deleteCount, data }] = delta.edits;
+        const patched = Array.from(full.data);
+        patched.splice(start, deleteCount, ...data);
+        expect(patched).toEqual(Array.from(document.tokensEncoded()));
+
+        expect(document.semanticTokensDelta(delta.resultId)).toEqual({ resultId: expect.any(String), edits: [] });
+        expect(document.semanticTokensDelta('unknown')).toHaveProperty('data');
+    });
 });
 
 describe('Definition - SRC', () => {
@@ -2078,6 +2469,113 @@ describe('Workspace Cache', () => {
         expect(result).toBe(false);
         expect(lastProgress.count / lastProgress.total).toBeGreaterThanOrEqual(0.5);
     });
+
+    it('Can index on multiple threads', async () => {
+        const workspace = getWorkspace();
+
+        let lastProgress = { count: 0, total: 0 };
+        const result = await workspace.indexAll((progress) => lastProgress = progress, undefined, 4);
+
+        expect(result).toBe(true);
+        expect(lastProgress.total).toEqual(workspace.autoCompiledScripts.length);
+        expect(lastProgress.count).toEqual(lastProgress.total);
+    });
+
+    it('Can index includes once', async () => {
+        ExtensionConfiguration.setFromObject({ indexIncludesOnce: true });
+        try {
+            expect(ExtensionConfiguration.get('indexIncludesOnce')).toBe(true);
+
+            const src = resolve(dir, 'scripts', 'in-memory-file.src');
+            const workspace = new LSPWorkspace({
+                getContents: (pathname) => pathname === src ? 'use uo; Print(MOVEOBJECT_FORCELOCATION);' : readFileSync(pathname, 'utf-8')
+            });
+            workspace.open(dir);
+            expect(await workspace.indexAll()).toBe(true);
+
+            const document = workspace.getDocument(src);
+            document.analyze();
+            const references = document.references({ line: 1, character: 19 });
+            expect(references?.length).toBeGreaterThan(1);
+        } finally {
+            ExtensionConfiguration.setFromObject({ indexIncludesOnce: false });
+        }
+    });
+
+    it('Can collect auto-compiled scripts', () => {
+        const scripts: string[] = getWorkspace().autoCompiledScripts;
+
+        expect(scripts.length).toBeGreaterThan(0);
+        expect(new Set(scripts).size).toEqual(scripts.length);
+        for (const pathname of scripts) {
+            expect(resolve(pathname)).toEqual(pathname);
+            expect(pathname).toMatch(/\.(src|hsr|inc|asp)$/);
+            expect(pathname.split(/[\\/]/).some(part => part.startsWith('.'))).toBe(false);
+        }
+    });
+
+    it('Can separate scripts by kind', () => {
+        const workspace = getWorkspace();
+        const { src, inc, em } = workspace.scripts;
+
+        expect(src.every(x => /\.(src|hsr|asp)$/.test(x))).toBe(true);
+        expect(inc.every(x => x.endsWith('.inc'))).toBe(true);
+        expect(em.every(x => x.endsWith('.em'))).toBe(true);
+        expect(em.length).toBeGreaterThan(0);
+        expect([...src, ...inc].sort()).toEqual([...workspace.autoCompiledScripts]);
+        expect(workspace.scripts).toBe(workspace.scripts);
+    });
+
+    it('Can reuse an on-disk index', async () => {
+        const indexCacheDirectory = await mkdtemp(join(tmpdir(), 'escript-index-'));
+        const getIndexedWorkspace = () => {
+            const workspace = new LSPWorkspace({
+                getContents: (pathname) => readFileSync(pathname, 'utf-8'),
+                indexCacheDirectory
+            });
+            workspace.open(dir);
+            return workspace;
+        };
+
+        try {
+            let firstProgress = { count: 0, total: 0 };
+            expect(await getIndexedWorkspace().indexAll((progress) => firstProgress = progress)).toBe(true);
+            expect(firstProgress.total).toBeGreaterThan(0);
+
+            let secondProgressCalls = 0;
+            const workspace = getIndexedWorkspace();
+            expect(await workspace.indexAll(() => ++secondProgressCalls)).toBe(true);
+            expect(secondProgressCalls).toEqual(0);
+        } finally {
+            await rm(indexCacheDirectory, { recursive: true, force: true });
+        }
+    });
+
+    it('Does not store unsaved contents in the on-disk index', async () => {
+        const indexCacheDirectory = await mkdtemp(join(tmpdir(), 'escript-index-'));
+        const getIndexedWorkspace = () => {
+            const workspace = new LSPWorkspace({
+                getContents: (pathname) => readFileSync(pathname, 'utf-8'),
+                indexCacheDirectory
+            });
+            workspace.open(dir);
+            return workspace;
+        };
+
+        try {
+            const first = getIndexedWorkspace();
+            const [src] = first.scripts.src;
+            first.setContents(src, `${readFileSync(src, 'utf-8')}\nPrint("unsaved");`);
+            expect(await first.indexAll()).toBe(true);
+
+            // Only the script analyzed from unsaved contents is indexed again.
+            let secondProgress = { count: 0, total: 0 };
+            expect(await getIndexedWorkspace().indexAll((progress) => secondProgress = progress)).toBe(true);
+            expect(secondProgress.total).toEqual(1);
+        } finally {
+            await rm(indexCacheDirectory, { recursive: true, force: true });
+        }
+    });
 });
 
 describe('Formatter', () => {
@@ -5,18 +5,29 @@ import { parseArgs } from 'node:util';
 import { join } from 'path';
 import { URI } from 'vscode-uri';
 
-const { values: { storageUri = join(process.cwd(), '.escript-lsp') } } = parseArgs({
+const { values: { storageUri = join(process.cwd(), '.escript-lsp'), traceFile = process.env['ESCRIPT_TRACE_FILE'], maxAnalyzedDocuments } } = parseArgs({
     args: process.argv.slice(2),
     strict: false,
     options: {
         'storageUri': {
             type: 'string',
+        },
+        // Records native spans and writes them as a Chrome trace on shutdown.
+        'traceFile': {
+            type: 'string',
+        },
+        // Keeps the analyses of at most this many documents besides the open
+        // ones, analyzing evicted documents again when queried.
+        'maxAnalyzedDocuments': {
+            type: 'string',
         }
     }
 });
 
 const options = {
-    storageFsPath: URI.parse(String(storageUri)).fsPath
+    storageFsPath: URI.parse(String(storageUri)).fsPath,
+    traceFile: traceFile ? String(traceFile) : undefined,
+    maxAnalyzedDocuments: maxAnalyzedDocuments ? Number(maxAnalyzedDocuments) : undefined
 };
 
 console.log(`Escript Language Server started [pid ${process.pid}]`);
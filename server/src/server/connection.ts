@@ -1,7 +1,6 @@
-import { createConnection, TextDocuments, TextDocumentChangeEvent, ProposedFeatures, InitializeParams, DocumentSymbolParams, TextDocumentSyncKind, InitializeResult, SemanticTokensParams, SemanticTokensBuilder, SemanticTokens, Hover, HoverParams, MarkupContent, DefinitionParams, Location, CompletionParams, CompletionItem, SignatureHelpParams, SignatureHelp, ReferenceParams, DocumentDiagnosticParams, DocumentDiagnosticReport, DocumentDiagnosticReportKind, DocumentUri, FullDocumentDiagnosticReport, DocumentFormattingParams, TextEdit, DocumentRangeFormattingParams, FormattingOptions, Range, DidChangeWatchedFilesParams, FileChangeType, DocumentSymbol } from 'vscode-languageserver/node';
+import { createConnection, TextDocuments, TextDocumentChangeEvent, ProposedFeatures, InitializeParams, DocumentSymbolParams, TextDocumentSyncKind, InitializeResult, SemanticTokensParams, SemanticTokensDeltaParams, SemanticTokensRangeParams, SemanticTokens, SemanticTokensDelta, Hover, HoverParams, MarkupContent, DefinitionParams, Location, CompletionParams, CompletionItem, SignatureHelpParams, SignatureHelp, ReferenceParams, DocumentDiagnosticParams, DocumentDiagnosticReport, DocumentDiagnosticReportKind, DocumentUri, FullDocumentDiagnosticReport, DocumentFormattingParams, TextEdit, DocumentRangeFormattingParams, FormattingOptions, Range, DidChangeWatchedFilesParams, FileChangeType, DocumentSymbol } from 'vscode-languageserver/node';
 import { Position, TextDocument } from 'vscode-languageserver-textdocument';
 import { URI } from 'vscode-uri';
-import { readFileSync } from 'fs';
 import { access, mkdir } from 'fs/promises';
 import { join } from 'path';
 import { F_OK } from 'constants';
@@ -16,6 +15,8 @@ const { LSPWorkspace, LSPDocument, ExtensionConfiguration } = native;
 
 type LSPServerOptions = {
     storageFsPath: string;
+    traceFile?: string;
+    maxAnalyzedDocuments?: number;
 }
 
 export interface DidChangeConfigurationParams {
@@ -32,11 +33,18 @@ export class LSPServer {
     private workspace: typeof LSPWorkspace;
     public static options: Readonly<LSPServerOptions>;
     private sources: Map<string, typeof LSPDocument> = new Map();
+    private pendingAnalyses: Map<string, Promise<boolean>> = new Map();
+    // The open document the user last opened or sent a request for. Edits to
+    // other open documents (eg. from a multi-file workspace edit) are
+    // analyzed in the background, after this one.
+    private activeFsPath: string | undefined;
     private downloader: DocsDownloader;
     private configuration: ExtensionConfiguration | undefined;
     private updateCacheAbortController: AbortController | undefined;
+    private reopenTimer: NodeJS.Timeout | undefined;
 
     public hasDiagnosticRelatedInformationCapability: boolean = false;
+    private hasSemanticTokensRefreshCapability: boolean = false;
 
 
     public constructor(options: LSPServerOptions) {
@@ -49,6 +57,8 @@ export class LSPServer {
         this.documents.onDidChangeContent(this.onDidChangeContent);
         this.documents.onDidClose(this.onDidClose);
         this.connection.languages.semanticTokens.on(this.onSemanticTokens);
+        this.connection.languages.semanticTokens.onDelta(this.onSemanticTokensDelta);
+        this.connection.languages.semanticTokens.onRange(this.onSemanticTokensRange);
         this.connection.onHover(this.onHover);
         this.connection.onDocumentFormatting(this.onDocumentFormatting);
         this.connection.onDocumentRangeFormatting(this.onDocumentRangeFormatting);
@@ -60,26 +70,38 @@ export class LSPServer {
         this.connection.languages.diagnostics.on(this.onDocumentDiagnostics);
         this.connection.onDidChangeWatchedFiles(this.onDidChangeWatchedFiles);
         this.connection.onDocumentSymbol(this.onDocumentSymbol);
+        this.connection.onShutdown(this.onShutdown);
 
         this.documents.listen(this.connection);
         this.downloader = new DocsDownloader(LSPServer.options.storageFsPath);
         this.workspace = new LSPWorkspace({
-            getContents: (pathname) => {
-                const uri = URI.file(pathname).toString();
-                const text = this.documents.get(uri)?.getText();
-                if (typeof text !== 'undefined') {
-                    return text;
-                }
-                return readFileSync(pathname, 'utf-8');
-            },
-            getXmlDocPath: this.downloader.getXmlDocPath.bind(this.downloader)
+            getXmlDocPath: this.downloader.getXmlDocPath.bind(this.downloader),
+            indexCacheDirectory: LSPServer.options.storageFsPath,
+            analysisDebounceMs: 100,
+            maxAnalyzedDocuments: LSPServer.options.maxAnalyzedDocuments
         });
     }
 
     public listen() {
+        if (LSPServer.options.traceFile) {
+            native.Tracing.start();
+        }
         this.connection.listen();
     }
 
+    private onShutdown = () => {
+        clearTimeout(this.reopenTimer);
+        const { traceFile } = LSPServer.options;
+        if (traceFile) {
+            try {
+                const count = native.Tracing.write(traceFile);
+                console.log(`Wrote ${count} trace events to ${traceFile}`);
+            } catch (e) {
+                console.error(`Could not write trace to ${traceFile}:`, e);
+            }
+        }
+    };
+
     private onInitialize = async (params: InitializeParams): Promise<InitializeResult> => {
 
         console.log('Got initialization params', params.capabilities);
@@ -111,6 +133,8 @@ export class LSPServer {
         }
 
         if (found) {
+            // After the loop, as the workspace cannot be opened again while warming up.
+            this.warmUp();
             this.onDidChangeConfiguration(initializationOptions);
         } else {
             console.log(`Could not find pol.cfg;scripts/ecompile.cfg in [${workspaceFolders.map(x => x.uri).join(', ')}]`);
@@ -123,6 +147,7 @@ export class LSPServer {
         }
 
         this.hasDiagnosticRelatedInformationCapability = Boolean(params.capabilities.textDocument?.publishDiagnostics?.relatedInformation);
+        this.hasSemanticTokensRefreshCapability = Boolean(params.capabilities.workspace?.semanticTokens?.refreshSupport);
 
         const result: InitializeResult = {
             capabilities: {
@@ -151,8 +176,10 @@ export class LSPServer {
                         tokenTypes: ['namespace', 'type', 'class', 'enum', 'interface', 'struct', 'typeParameter', 'parameter', 'variable', 'property', 'enumMember', 'event', 'function', 'method', 'macro', 'keyword', 'modifier', 'comment', 'string', 'number', 'regexp', 'operator'],
                         tokenModifiers: ['declaration', 'definition', 'readonly', 'static', 'deprecated', 'abstract', 'async', 'modification', 'documentation', 'defaultLibrary']
                     },
-                    range: false,
-                    full: true
+                    range: true,
+                    full: {
+                        delta: true
+                    }
                 },
                 documentSymbolProvider: true
             }
@@ -161,32 +188,69 @@ export class LSPServer {
         return result;
     };
 
+    private setActive(fsPath: string) {
+        if (this.sources.has(fsPath)) {
+            this.activeFsPath = fsPath;
+        }
+    }
+
     private onDidOpen = async (e: TextDocumentChangeEvent<TextDocument>) => {
         const { fsPath } = URI.parse(e.document.uri);
+        this.workspace.setContents(fsPath, e.document.getText(), e.document.version);
         this.sources.set(fsPath, this.workspace.getDocument(fsPath));
+        this.activeFsPath = fsPath;
+        await this.scheduleAnalysis(fsPath);
     };
 
     private onDidClose = async (e: TextDocumentChangeEvent<TextDocument>) => {
         const { uri } = e.document;
         const { fsPath } = URI.parse(uri);
 
+        this.workspace.removeContents(fsPath);
         this.sources.delete(fsPath);
+        this.pendingAnalyses.delete(fsPath);
+        if (this.activeFsPath === fsPath) {
+            this.activeFsPath = undefined;
+        }
     };
 
     private onDidChangeContent = async (e: TextDocumentChangeEvent<TextDocument>) => {
         const { uri } = e.document;
 
         const { fsPath } = URI.parse(uri);
-        const document = this.sources.get(fsPath);
+        this.workspace.setContents(fsPath, e.document.getText(), e.document.version);
+        if (!this.sources.has(fsPath)) {
+            console.error(new Error('Document not opened'));
+            return;
+        }
+        await this.scheduleAnalysis(fsPath);
+    };
+
+    private async scheduleAnalysis(fsPath: string) {
         try {
-            if (!document) {
-                throw new Error('Document not opened');
+            const background = this.activeFsPath !== undefined && this.activeFsPath !== fsPath;
+            const analysis = this.workspace.scheduleAnalysis(fsPath, { background, continueOnError: this.configuration?.continueAnalysisOnError });
+            this.pendingAnalyses.set(fsPath, analysis);
+            // Tokens the client requested meanwhile may come from an older analysis.
+            if (await analysis && this.hasSemanticTokensRefreshCapability) {
+                this.connection.languages.semanticTokens.refresh();
             }
-            document.analyze(this.configuration?.continueAnalysisOnError);
         } catch (ex) {
             console.error(ex);
         }
-    };
+    }
+
+    // Waits for the latest edit to be analyzed, so queries see the current text;
+    // earlier analyses may be superseded.
+    private async waitForAnalysis(fsPath: string) {
+        let pending: Promise<boolean> | undefined;
+        while ((pending = this.pendingAnalyses.get(fsPath)) !== undefined) {
+            await pending.catch(() => false);
+            if (this.pendingAnalyses.get(fsPath) === pending) {
+                this.pendingAnalyses.delete(fsPath);
+            }
+        }
+    }
 
     private onDocumentDiagnostics = async (e: DocumentDiagnosticParams): Promise<DocumentDiagnosticReport> => {
         const { uri } = e.textDocument;
@@ -194,15 +258,19 @@ export class LSPServer {
 
         const document = this.sources.get(fsPath) ?? this.workspace.getDocument(fsPath);
         this.sources.set(fsPath, document);
+
+        await this.waitForAnalysis(fsPath);
         const diagnostics = document.diagnostics();
 
         const relatedDocuments: {[uri: DocumentUri]: FullDocumentDiagnosticReport} = {};
 
-        for (const [dependeePathname, dependeeDoc] of this.sources.entries()) {
-            if (dependeePathname !== fsPath && dependeeDoc.dependents().includes(fsPath)) {
+        const dependeeDiagnostics = await this.workspace.reanalyzeDependents(fsPath, {
+            continueOnError: this.configuration?.continueAnalysisOnError,
+            openOnly: true
+        });
+        for (const [dependeePathname, diagnostics] of Object.entries(dependeeDiagnostics)) {
+            if (this.sources.has(dependeePathname)) {
                 const uri = URI.file(dependeePathname).toString();
-                dependeeDoc.analyze();
-                const diagnostics = dependeeDoc.diagnostics();
                 relatedDocuments[uri] = {
                     kind: DocumentDiagnosticReportKind.Full,
                     items: diagnostics
@@ -220,53 +288,104 @@ export class LSPServer {
         const ecompileCfg = join(this.workspace.workspaceRoot, 'scripts', 'ecompile.cfg');
         const shouldReopen = e.changes.some(change => change.type === FileChangeType.Changed && URI.parse(change.uri).fsPath === ecompileCfg);
 
+        // Drop cached parse trees of includes and modules changed outside the editor.
+        for (const change of e.changes) {
+            this.workspace.invalidate(URI.parse(change.uri).fsPath);
+        }
+
         if (shouldReopen) {
-            const hasChanges = this.workspace.reopen();
-            if (hasChanges && this.configuration?.disableWorkspaceReferences === false) {
-                this.updateCache();
-            }
+            this.reopen();
         }
     };
 
-    private onDocumentSymbol = (params: DocumentSymbolParams): DocumentSymbol[] | null => {
+    private reopen() {
+        // Background work uses the configuration being replaced, so wait for it to finish.
+        if (this.workspace.busy) {
+            this.reopenTimer ??= setTimeout(() => {
+                this.reopenTimer = undefined;
+                this.reopen();
+            }, 250);
+            return;
+        }
+
+        const hasChanges = this.workspace.reopen();
+        if (hasChanges) {
+            this.warmUp();
+        }
+        if (hasChanges && this.configuration?.disableWorkspaceReferences === false) {
+            this.updateCache();
+        }
+    }
+
+    private onDocumentSymbol = async (params: DocumentSymbolParams): Promise<DocumentSymbol[] | null> => {
         const { fsPath } = URI.parse(params.textDocument.uri);
         const document = this.sources.get(fsPath);
+        this.setActive(fsPath);
+        await this.waitForAnalysis(fsPath);
 
         return document?.symbols() ?? null;
     };
 
     private onSemanticTokens = async (params: SemanticTokensParams): Promise<SemanticTokens> => {
-        const builder = new SemanticTokensBuilder();
         const { fsPath } = URI.parse(params.textDocument.uri);
         const document = this.sources.get(fsPath);
+        await this.waitForAnalysis(fsPath);
         try {
             if (!document) {
                 throw new Error('Document not opened');
             }
-            const tokens = document.tokens();
+            const { resultId, data } = document.semanticTokens();
+            return { resultId, data: Array.from(data) };
+        } catch (ex) {
+            console.error(ex);
+        }
+        return { data: [] };
+    };
 
-            const sorted = tokens.sort((tokInfo1, tokInfo2) => {
-                const line = tokInfo1[0] - tokInfo2[0];
-                if (line === 0) {
-                    return tokInfo1[1] - tokInfo2[1];
-                }
-                return line;
-            });
+    private onSemanticTokensRange = async (params: SemanticTokensRangeParams): Promise<SemanticTokens> => {
+        const { fsPath } = URI.parse(params.textDocument.uri);
+        const document = this.sources.get(fsPath);
+        await this.waitForAnalysis(fsPath);
+        try {
+            if (!document) {
+                throw new Error('Document not opened');
+            }
+            return { data: Array.from(document.tokensInRange(params.range)) };
+        } catch (ex) {
+            console.error(ex);
+        }
+        return { data: [] };
+    };
 
-            for (const token of sorted) {
-                builder.push(...token);
+    private onSemanticTokensDelta = async (params: SemanticTokensDeltaParams): Promise<SemanticTokens | SemanticTokensDelta> => {
+        const { fsPath } = URI.parse(params.textDocument.uri);
+        const document = this.sources.get(fsPath);
+        await this.waitForAnalysis(fsPath);
+        try {
+            if (!document) {
+                throw new Error('Document not opened');
+            }
+            const result = document.semanticTokensDelta(params.previousResultId);
+            if ('edits' in result) {
+                return {
+                    resultId: result.resultId,
+                    edits: result.edits.map(({ start, deleteCount, data }) => ({ start, deleteCount, data: Array.from(data) }))
+                };
             }
+            return { resultId: result.resultId, data: Array.from(result.data) };
         } catch (ex) {
             console.error(ex);
         }
-        return builder.build();
+        return { data: [] };
     };
 
-    private onHover = (params: HoverParams): Hover | null => {
+    private onHover = async (params: HoverParams): Promise<Hover | null> => {
         const { fsPath } = URI.parse(params.textDocument.uri);
         const { position: { line, character } } = params;
         const position: Position = { line: line + 1, character: character + 1 };
         const document = this.sources.get(fsPath);
+        this.setActive(fsPath);
+        await this.waitForAnalysis(fsPath);
         if (document) {
             const hover = document.hover(position);
             if (hover) {
@@ -298,6 +417,8 @@ export class LSPServer {
         const { position: { line, character } } = params;
         const position: Position = { line: line + 1, character: character + 1 };
         const document = this.sources.get(fsPath);
+        this.setActive(fsPath);
+        await this.waitForAnalysis(fsPath);
         if (document) {
             const definition = document.definition(position);
             if (definition) {
@@ -315,6 +436,8 @@ export class LSPServer {
         const { position: { line, character } } = params;
         const position: Position = { line: line + 1, character: character + 1 };
         const document = this.sources.get(fsPath);
+        this.setActive(fsPath);
+        await this.waitForAnalysis(fsPath);
         if (document) {
             const completion = document.completion(position);
             if (completion) {
@@ -329,6 +452,8 @@ export class LSPServer {
         const { position: { line, character } } = params;
         const position: Position = { line: line + 1, character: character + 1 };
         const document = this.sources.get(fsPath);
+        this.setActive(fsPath);
+        await this.waitForAnalysis(fsPath);
         return document?.signatureHelp(position) ?? null;
     };
 
@@ -422,6 +547,16 @@ export class LSPServer {
         });
     }
 
+    private warmUp() {
+        // Parse modules and their documentation in the background, so the first
+        // hover or completion does not wait for them.
+        this.workspace.warmUp().then((count) => {
+            console.log(`Preloaded ${count} modules.`);
+        }, (e) => {
+            console.error('Error preloading modules:', e);
+        });
+    }
+
     private getFormattedTextEdit(uri: string, options: FormattingOptions, range?: Range): TextEdit[] | null {
         const { fsPath } = URI.parse(uri);
         const document = this.sources.get(fsPath);